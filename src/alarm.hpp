@@ -0,0 +1,140 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+// Puts the scheduler thread to sleep until a deadline. Other threads move the deadline with set() and
+// interrupt the sleep with wake(); set() and wait() are called under the scheduler lock.
+class Alarm {
+  public:
+	enum class Reason { Deadline, Woken, ClockJump, Other };
+
+	virtual ~Alarm() = default;
+
+	virtual void set(time_point_s deadline) = 0;
+	virtual void wake() = 0;
+	// Releases `lk` while sleeping. May return before the deadline, the caller checks what is due.
+	virtual Reason wait(std::unique_lock<std::mutex>& lk) = 0;
+
+	// A descriptor that is readable when wait() would return, so one thread can sleep on the alarms of
+	// several schedulers; -1 if the alarm has none.
+	virtual int fd() const { return -1; }
+	// wait() that returns at once, Other if nothing happened.
+	virtual Reason poll() { return Reason::Other; }
+
+	std::optional<time_point_s> deadline() const { return _deadline; }
+
+  protected:
+	std::optional<time_point_s> _deadline;
+};
+
+#ifdef __linux__
+// Absolute CLOCK_REALTIME timerfd and an eventfd for wake() under one epoll. set() re-arms the timer from
+// the calling thread without waking the sleeper, so moving the deadline costs a syscall rather than a
+// sweep. The kernel fires the timer when the wall clock reaches the deadline, to the millisecond, and
+// cancels it when the clock is set, so wait() also returns on clock jumps.
+class TimerFdAlarm: public Alarm {
+  public:
+	TimerFdAlarm():
+	    _timer(::timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK)),
+	    _wake(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), _epoll(::epoll_create1(EPOLL_CLOEXEC)) {
+		if (_timer < 0 || _wake < 0 || _epoll < 0) {
+			close();
+			throw std::runtime_error("Can't create the scheduler timer");
+		}
+		for (int fd : {_timer, _wake}) {
+			epoll_event ev{};
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+			::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+		}
+	}
+
+	~TimerFdAlarm() override { close(); }
+
+	TimerFdAlarm(const TimerFdAlarm&) = delete;
+	TimerFdAlarm& operator=(const TimerFdAlarm&) = delete;
+
+	void set(time_point_s deadline) override {
+		if (_deadline == deadline) {
+			return;
+		}
+		itimerspec spec{};
+		spec.it_value.tv_sec = static_cast<time_t>(std::max<std::int64_t>(1, deadline.time_since_epoch().count()));
+		if (::timerfd_settime(_timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr) == 0) {
+			_deadline = deadline;
+		} else {
+			// Set while a clock jump is pending, wait() picks it up and the caller re-arms.
+			_deadline.reset();
+		}
+	}
+
+	void wake() override {
+		const std::uint64_t one = 1;
+		[[maybe_unused]] auto n = ::write(_wake, &one, sizeof(one));
+	}
+
+	Reason wait(std::unique_lock<std::mutex>& lk) override {
+		lk.unlock();
+		epoll_event events[2];
+		const int n = ::epoll_wait(_epoll, events, 2, -1);
+		lk.lock();
+		return consume(events, n);
+	}
+
+	int fd() const override { return _epoll; }
+
+	Reason poll() override {
+		epoll_event events[2];
+		return consume(events, ::epoll_wait(_epoll, events, 2, 0));
+	}
+
+  private:
+	Reason consume(const epoll_event* events, int n) {
+		auto reason = Reason::Other;
+		for (int i = 0; i < n; ++i) {
+			std::uint64_t count = 0;
+			if (events[i].data.fd == _wake) {
+				[[maybe_unused]] auto r = ::read(_wake, &count, sizeof(count));
+				reason = Reason::Woken;
+			} else if (::read(_timer, &count, sizeof(count)) < 0 && errno == ECANCELED) {
+				_deadline.reset();
+				reason = reason == Reason::Woken ? reason : Reason::ClockJump;
+			} else if (reason == Reason::Other) {
+				reason = Reason::Deadline;
+			}
+		}
+		if (reason == Reason::Deadline) {
+			_deadline.reset();
+		}
+		return reason;
+	}
+
+	void close() {
+		for (int fd : {_timer, _wake, _epoll}) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+	}
+
+	const int _timer;
+	const int _wake;
+	const int _epoll;
+};
+#endif
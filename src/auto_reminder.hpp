@@ -1,16 +1,26 @@
 #pragma once
 
+#include "chat_zones.hpp"
 #include "dynamic_storage.hpp"
+#include "edit_queue.hpp"
+#include "keyboard_cache.hpp"
+#include "log.hpp"
+#include "raw_api.hpp"
 #include "reminder_info.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 #include <bitset>
+#include <mutex>
 
-inline void sendAutoReminderMsg(TgBot::Bot& bot, std::int64_t chatId, const std::string& msg) {
-	auto k = std::make_shared<TgBot::InlineKeyboardMarkup>();
-	setButton(k, 0, 0, makeButon("❌ Отмена", "/delete_me"));
-	setButton(k, 1, 0, makeButon("✅ Создать", "/ar_date"));
+inline void sendAutoReminderMsg(const RawApi& api, KeyboardCache& kc, std::int64_t chatId, const std::string& msg) {
+	auto markup = kc.get("ar_start", [] {
+		auto k = std::make_shared<TgBot::InlineKeyboardMarkup>();
+		setButton(k, 0, 0, makeButon("❌ Отмена", "/delete_me"));
+		setButton(k, 1, 0, makeButon("✅ Создать", "/ar_date"));
+		return k;
+	});
 
-	bot.getApi().sendMessage(chatId, msg, false, 0, k);
+	api.sendMessage(chatId, msg, *markup);
 }
 
 inline auto queryFormatToDateTime(std::string cmd) {
@@ -207,8 +217,18 @@ inline TgBot::InlineKeyboardMarkup::Ptr makeArTimeKeyboard(date::time_of_day<std
 	return k;
 }
 
-inline auto ar_date(TgBot::Bot& bot, DynamicStorage& ds) {
+inline KeyboardCache::Markup arDateMarkup(KeyboardCache& kc, date::year_month_day ymd) {
+	return kc.get("ar_date " + arDateStr(ymd), [&] { return makeArDateKeyboard(ymd); });
+}
+
+inline KeyboardCache::Markup arTimeMarkup(KeyboardCache& kc, date::time_of_day<std::chrono::minutes> tod) {
+	return kc.get("ar_time " + arTimeStr(tod), [&] { return makeArTimeKeyboard(tod); });
+}
+
+inline auto ar_date(const RawApi& api, EditQueue& edits, DynamicStorage& ds, KeyboardCache& kc,
+    const ChatZones& zones) {
 	return [&](TgBot::CallbackQuery::Ptr query) {
+		TRACE_SCOPE("ar_date", "handler");
 		try {
 			if (!query->message) {
 				return;
@@ -225,7 +245,7 @@ inline auto ar_date(TgBot::Bot& bot, DynamicStorage& ds) {
 					args.push_back(found->at("date").get_string_or_throw());
 				} else {
 					ds.make(dsKey, up::value::object{});
-					args.push_back(arDateStr(ymdFromTp(now())));
+					args.push_back(arDateStr(ymdFromTp(zones.localNow(chatId))));
 				}
 			}
 
@@ -237,20 +257,22 @@ inline auto ar_date(TgBot::Bot& bot, DynamicStorage& ds) {
 			(*state)["text"] = query->message->text;
 			ds.make(dsKey, *state);
 
-			auto ymd = arStrDate(args[1]);
-			auto k = makeArDateKeyboard(ymd);
+			auto markup = arDateMarkup(kc, arStrDate(args[1]));
 
-			bot.getApi().editMessageText(query->message->text, chatId, query->message->messageId, "", "", false, k);
+			edits.editMessageText(chatId, query->message->messageId, query->message->text, *markup);
 		} catch (const std::exception& e) {
+			logger().warn("wizard_failed handler=ar_date chat={} message={} error={}", chatOf(query->message),
+			    query->message->messageId, e.what());
 			if (query->message->chat) {
-				bot.getApi().sendMessage(query->message->chat->id, e.what());
+				api.sendMessage(query->message->chat->id, e.what());
 			}
 		}
 	};
 }
 
-inline auto ar_time(TgBot::Bot& bot, DynamicStorage& ds) {
+inline auto ar_time(const RawApi& api, EditQueue& edits, DynamicStorage& ds, KeyboardCache& kc) {
 	return [&](TgBot::CallbackQuery::Ptr query) {
+		TRACE_SCOPE("ar_time", "handler");
 		try {
 			if (!query->message) {
 				return;
@@ -280,13 +302,14 @@ inline auto ar_time(TgBot::Bot& bot, DynamicStorage& ds) {
 			(*state)["time"] = args[1];
 			ds.make(dsKey, *state);
 
-			auto tod = arStrTime(args[1]);
-			auto k = makeArTimeKeyboard(tod);
+			auto markup = arTimeMarkup(kc, arStrTime(args[1]));
 
-			bot.getApi().editMessageText(query->message->text, chatId, query->message->messageId, "", "", false, k);
+			edits.editMessageText(chatId, query->message->messageId, query->message->text, *markup);
 		} catch (const std::exception& e) {
+			logger().warn("wizard_failed handler=ar_time chat={} message={} error={}", chatOf(query->message),
+			    query->message->messageId, e.what());
 			if (query->message->chat) {
-				bot.getApi().sendMessage(query->message->chat->id, e.what());
+				api.sendMessage(query->message->chat->id, e.what());
 			}
 		}
 	};
@@ -444,8 +467,35 @@ inline TgBot::InlineKeyboardMarkup::Ptr makeArRepeatKeyboard(Repeating rp) {
 	return k;
 }
 
-inline auto ar_repeat(TgBot::Bot& bot, DynamicStorage& ds) {
+// Only the "Create" button of the repeat keyboard depends on the wizard date and time, so the keyboard
+// is cached per repeat state with placeholders in that button and they are substituted per message.
+inline std::string arRepeatMarkup(KeyboardCache& kc, const Repeating& rp, const std::string& date,
+    const std::string& time) {
+	static const std::string datePlaceholder = "{date}";
+	static const std::string timePlaceholder = "{time}";
+
+	auto tmpl = kc.get("ar_repeat " + rp.to_string(), [&] {
+		auto r = rp;
+		r.all = up::value{};
+		r.all["date"] = datePlaceholder;
+		r.all["time"] = timePlaceholder;
+		return makeArRepeatKeyboard(r);
+	});
+
+	std::string markup = *tmpl;
+	if (auto pos = markup.find(datePlaceholder); pos != std::string::npos) {
+		markup.replace(pos, datePlaceholder.size(), date);
+	}
+	if (auto pos = markup.find(timePlaceholder); pos != std::string::npos) {
+		markup.replace(pos, timePlaceholder.size(), time);
+	}
+
+	return markup;
+}
+
+inline auto ar_repeat(const RawApi& api, EditQueue& edits, DynamicStorage& ds, KeyboardCache& kc) {
 	return [&](TgBot::CallbackQuery::Ptr query) {
+		TRACE_SCOPE("ar_repeat", "handler");
 		try {
 			if (!query->message) {
 				return;
@@ -476,14 +526,46 @@ inline auto ar_repeat(TgBot::Bot& bot, DynamicStorage& ds) {
 			ds.make(dsKey, *state);
 
 			auto rp = Repeating::from_string(args[1]);
-			rp.all = *state;
-			auto k = makeArRepeatKeyboard(rp);
+			auto markup = arRepeatMarkup(kc, rp, state->at("date").get_string_or_throw(),
+			    state->at("time").get_string_or_throw());
 
-			bot.getApi().editMessageText(query->message->text, chatId, query->message->messageId, "", "", false, k);
+			edits.editMessageText(chatId, query->message->messageId, query->message->text, std::move(markup));
 		} catch (const std::exception& e) {
+			logger().warn("wizard_failed handler=ar_repeat chat={} message={} error={}", chatOf(query->message),
+			    query->message->messageId, e.what());
 			if (query->message->chat) {
-				bot.getApi().sendMessage(query->message->chat->id, e.what());
+				api.sendMessage(query->message->chat->id, e.what());
 			}
 		}
 	};
 }
+
+// Offers a reminder read from the text of a private message: one click creates it, "Изменить" opens the wizard
+// with the parsed date, time and repeat already chosen. The message text is the description, as in the wizard.
+// Sends without `dbMutex`, it guards `ds`.
+inline void sendParsedReminderMsg(const RawApi& api, DynamicStorage& ds, std::mutex& dbMutex, std::int64_t chatId,
+    const ReminderInfo& ri) {
+	const date::year_month_day ymd{date::year(ri.year), date::month(ri.month), date::day(ri.day)};
+	const date::time_of_day<std::chrono::minutes> tod{std::chrono::hours(ri.hour) + std::chrono::minutes(ri.minute)};
+	const Repeating rp{.d = static_cast<int>(ri.day_repeat), .m = static_cast<int>(ri.month_repeat),
+	    .y = ri.year_repeat ? 1 : 0, .w = static_cast<unsigned long long>(ri.week_repeat)};
+
+	auto k = std::make_shared<TgBot::InlineKeyboardMarkup>();
+	setButton(k, 0, 0,
+	    makeButon(fmt::format("📅 {:0>2}/{:0>2}/{} {:0>2}:{:0>2}", ri.day, ri.month, ri.year, ri.hour, ri.minute), "_"));
+	if (!rp.noRepeat()) {
+		setButton(k, 0, 1, makeButon(ri.prettyRepeat().substr(1), "_"));
+	}
+	const auto lastRow = k->inlineKeyboard.size();
+	setButton(k, 0, lastRow, makeButon("❌ Отмена", "/delete_me"));
+	setButton(k, 1, lastRow, makeButon("✏️ Изменить", "/ar_date"));
+	setButton(k, 2, lastRow,
+	    makeButon("✅ Создать ", fmt::format("/add {} {} {} ", arDateStr(ymd), arTimeStr(tod), rp.to_command_string())));
+
+	const auto messageId = api.sendMessage(chatId, ri.descr, serializeKeyboard(k));
+	if (messageId != 0) {
+		std::scoped_lock l(dbMutex);
+		ds.make(chatMsgKey(chatId, messageId), up::value::object{{"date", arDateStr(ymd)}, {"time", arTimeStr(tod)},
+		                                           {"repeat", rp.to_string()}, {"text", ri.descr}});
+	}
+}
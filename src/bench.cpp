@@ -0,0 +1,1087 @@
+#include "auto_reminder.hpp"
+#include "chat_zones.hpp"
+#include "clock.hpp"
+#include "db_maintenance.hpp"
+#include "dynamic_storage.hpp"
+#include "flat_hash_map.hpp"
+#include "keyboard_cache.hpp"
+#include "log.hpp"
+#include "phrase_parser.hpp"
+#include "reminder_codec.hpp"
+#include "reminder_io.hpp"
+#include "reminder_query.hpp"
+#include "reminder_storage.hpp"
+#include "reminder_store.hpp"
+#include "replication.hpp"
+#include "scheduler_snapshot.hpp"
+#include "tz_table.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <spdlog/sinks/base_sink.h>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+template<class F>
+void bench(const std::string& name, size_t iterations, F&& f) {
+	const auto start = std::chrono::steady_clock::now();
+	size_t sink = 0;
+	for (size_t i = 0; i != iterations; ++i) {
+		sink += f(i);
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+	std::cout << fmt::format("{:<40} {:>10} ops {:>12.1f} ns/op (sink {})", name, iterations,
+	                 static_cast<double>(ns) / iterations, sink)
+	          << std::endl;
+}
+
+void benchKeyboards() {
+	using namespace std::chrono;
+
+	const auto ymd = ymdFromTp(defaultTzTable().toLocal(nowUtc()));
+	const size_t N = 20000;
+
+	bench("ar_date keyboard build+serialize", N, [&](size_t i) {
+		return serializeKeyboard(makeArDateKeyboard(date::sys_days{ymd} + date::days(i % 31))).size();
+	});
+	{
+		KeyboardCache kc;
+		bench("ar_date keyboard cached", N,
+		    [&](size_t i) { return arDateMarkup(kc, date::sys_days{ymd} + date::days(i % 31))->size(); });
+	}
+
+	bench("ar_time keyboard build+serialize", N, [&](size_t i) {
+		return serializeKeyboard(makeArTimeKeyboard(date::time_of_day<minutes>(minutes(i % 1440)))).size();
+	});
+	{
+		KeyboardCache kc;
+		bench("ar_time keyboard cached", N,
+		    [&](size_t i) { return arTimeMarkup(kc, date::time_of_day<minutes>(minutes(i % 1440)))->size(); });
+	}
+
+	bench("ar_repeat keyboard build+serialize", N, [&](size_t i) {
+		auto rp = Repeating::from_string(fmt::format("d{}", i % 30));
+		rp.all["date"] = std::string("19/10/2026");
+		rp.all["time"] = std::string("9:30");
+		return serializeKeyboard(makeArRepeatKeyboard(rp)).size();
+	});
+	{
+		KeyboardCache kc;
+		bench("ar_repeat keyboard cached", N, [&](size_t i) {
+			return arRepeatMarkup(kc, Repeating::from_string(fmt::format("d{}", i % 30)), "19/10/2026", "9:30").size();
+		});
+	}
+}
+
+void benchTimeZones() {
+	using namespace std::chrono;
+
+	const size_t N = 1000000;
+	const auto base = nowUtc();
+	const auto* zone = date::locate_zone("Europe/Berlin");
+	const auto& table = tzTable("Europe/Berlin");
+
+	bench("utc->local tz database", N, [&](size_t i) {
+		auto tp = date::sys_seconds{base.time_since_epoch() + minutes(i * 37)};
+		return static_cast<size_t>(date::make_zoned(zone, tp).get_local_time().time_since_epoch().count());
+	});
+	bench("utc->local transition table", N, [&](size_t i) {
+		return static_cast<size_t>(table.toLocal(base + minutes(i * 37)).time_since_epoch().count());
+	});
+	bench("local->utc tz database", N, [&](size_t i) {
+		auto tp = date::local_seconds{base.time_since_epoch() + minutes(i * 37)};
+		return static_cast<size_t>(zone->to_sys(tp, date::choose::earliest).time_since_epoch().count());
+	});
+	bench("local->utc transition table", N, [&](size_t i) {
+		return static_cast<size_t>(table.toUtc(base + minutes(i * 37)).time_since_epoch().count());
+	});
+}
+
+// Chat-keyed maps: std::unordered_map vs FlatHashMap for the queue's per-chat map, and string vs packed
+// (chatId, messageId) keys for the keyboard state of DynamicStorage. Keys are Telegram-like ids, lookups
+// are random hits.
+void benchHashMaps() {
+	for (size_t size : {size_t(10000), size_t(1000000)}) {
+		std::mt19937_64 rng(size);
+		std::vector<std::int64_t> chats(size);
+		for (auto& c : chats) {
+			c = rng() % 2 ? static_cast<std::int64_t>(rng() % 7000000000) :
+			                -1000000000000 - static_cast<std::int64_t>(rng() % 2000000000);
+		}
+		std::vector<std::int64_t> probes(1 << 20);
+		for (auto& p : probes) {
+			p = chats[rng() % size];
+		}
+		const size_t mask = probes.size() - 1;
+
+		{
+			std::unordered_map<std::int64_t, std::uint64_t> m;
+			bench(fmt::format("unordered_map insert {}", size), size, [&](size_t i) { return ++m[chats[i]]; });
+			bench(fmt::format("unordered_map find {}", size), 4000000,
+			    [&](size_t i) { return m.find(probes[i & mask])->second; });
+		}
+		{
+			FlatHashMap<std::int64_t, std::uint64_t> m;
+			bench(fmt::format("FlatHashMap insert {}", size), size, [&](size_t i) { return ++m[chats[i]]; });
+			bench(fmt::format("FlatHashMap find {}", size), 4000000,
+			    [&](size_t i) { return m.find(probes[i & mask])->second; });
+		}
+	}
+
+	const size_t MESSAGES = 50000;
+	std::mt19937_64 rng(1);
+	std::vector<std::pair<std::int64_t, std::int64_t>> messages(MESSAGES);
+	for (auto& [chatId, messageId] : messages) {
+		chatId = static_cast<std::int64_t>(rng() % 7000000000);
+		messageId = static_cast<std::int64_t>(rng() % 100000);
+	}
+	{
+		std::unordered_map<std::string, std::uint64_t> m;
+		for (const auto& [chatId, messageId] : messages) {
+			m[std::to_string(chatId) + "_" + std::to_string(messageId)] = 1;
+		}
+		bench("string chatMsgKey find 50000", 2000000, [&](size_t i) {
+			const auto& [chatId, messageId] = messages[i % MESSAGES];
+			return m.find(std::to_string(chatId) + "_" + std::to_string(messageId))->second;
+		});
+	}
+	{
+		FlatHashMap<ChatMsgKey, std::uint64_t, ChatMsgKeyHash> m;
+		for (const auto& [chatId, messageId] : messages) {
+			m[chatMsgKey(chatId, messageId)] = 1;
+		}
+		bench("packed chatMsgKey find 50000", 2000000, [&](size_t i) {
+			const auto& [chatId, messageId] = messages[i % MESSAGES];
+			return m.find(chatMsgKey(chatId, messageId))->second;
+		});
+	}
+}
+
+// Replays a year of fires of a million reminders (60% one-shot, 10% every 1-3 days, 20% weekly, 10% monthly)
+// on a virtual clock and checks every reminder fired exactly as often as nextOccurrence predicts, on time.
+void benchSchedulerSimulation() {
+	using namespace std::chrono;
+
+	const size_t N = 1000000;
+	const std::int64_t CHATS = 50000;
+	const auto start = time_point_s(date::sys_days{date::year(2026) / 1 / 1}.time_since_epoch());
+	const auto end = start + date::years(1);
+
+	std::remove("bench_sim.db");
+	up::db db("bench_sim.db");
+	VirtualClock clock(start);
+	ChatZones zones(db, clock);
+
+	size_t sent = 0;
+	ReminderQuery q([&](std::int64_t, const std::string&) { ++sent; }, zones, clock);
+
+	std::vector<ReminderInfo> reminders(N);
+	std::vector<std::uint32_t> fires(N);
+	size_t late = 0;
+	q.setFireHook([&](std::int64_t, const ReminderInfo& r, time_point_s deadline, time_point_s firedAt) {
+		++fires[r._id];
+		if (firedAt != deadline) {
+			++late;
+		}
+	});
+
+	std::mt19937_64 rng(42);
+	const auto& zone = defaultTzTable();
+	const auto localStart = zone.toLocal(start);
+	const auto localEnd = zone.toLocal(end);
+	for (size_t i = 0; i != N; ++i) {
+		auto& r = reminders[i];
+		auto [ymd, tod] = ymdTodFromTp(localStart + minutes(rng() % (365 * 24 * 60)));
+		r._id = i;
+		r.descr = "bench";
+		r.day = static_cast<unsigned>(ymd.day());
+		r.month = static_cast<unsigned>(ymd.month());
+		r.year = static_cast<int>(ymd.year());
+		r.hour = tod.hours().count();
+		r.minute = tod.minutes().count();
+		if (i % 10 >= 9) {
+			r.month_repeat = 1;
+		} else if (i % 10 >= 7) {
+			r.week_repeat = 1 << (i % 7);
+		} else if (i % 10 == 6) {
+			r.day_repeat = 1 + static_cast<std::int64_t>(i / 10 % 3);
+		}
+	}
+
+	const auto loadStart = steady_clock::now();
+	for (const auto& r : reminders) {
+		auto nextTp = nextOccurrence(r, localStart);
+		if (nextTp > localStart) {
+			q.addTimer(static_cast<std::int64_t>(r._id % CHATS), zone.toUtc(nextTp), r);
+		}
+	}
+	const auto loadTime = steady_clock::now() - loadStart;
+
+	const auto runStart = steady_clock::now();
+	q.runUntil(end);
+	const auto runTime = steady_clock::now() - runStart;
+
+	size_t expectedTotal = 0;
+	size_t mismatched = 0;
+	for (const auto& r : reminders) {
+		size_t expected = 0;
+		for (auto tp = nextOccurrence(r, localStart); tp > localStart && tp <= localEnd;
+		     tp = nextOccurrence(r, tp)) {
+			++expected;
+			if (!r.isRepeatable()) {
+				break;
+			}
+		}
+		expectedTotal += expected;
+		if (expected != fires[r._id]) {
+			++mismatched;
+		}
+	}
+
+	const auto runS = duration_cast<duration<double>>(runTime).count();
+	std::cout << fmt::format("scheduler simulation: {} reminders, {} chats, load {:.2f}s\n", N, CHATS,
+	                 duration_cast<duration<double>>(loadTime).count())
+	          << fmt::format("  fired {} (expected {}, sent {}) in {:.2f}s, {:.0f} fires/s\n", q.fired(),
+	                 expectedTotal, sent, runS, q.fired() / runS)
+	          << fmt::format("  mismatched reminders {}, late fires {}", mismatched, late) << std::endl;
+}
+
+// Top-of-hour burst: 100k reminders in 10k chats at 09:00-09:02 with a skewed per-chat count, sent as
+// one message per reminder vs coalesced per chat with growing windows.
+void benchTopOfHourBurst() {
+	using namespace std::chrono;
+
+	const auto start = time_point_s(date::sys_days{date::year(2026) / 1 / 2}.time_since_epoch());
+	const auto& zone = defaultTzTable();
+	const auto localStart = zone.toLocal(start);
+	const auto [ymd, tod] = ymdTodFromTp(localStart);
+
+	std::mt19937_64 rng(35);
+	std::geometric_distribution<std::int64_t> chatOf(0.001);
+	std::vector<std::pair<std::int64_t, ReminderInfo>> reminders(100000);
+	for (size_t i = 0; i != reminders.size(); ++i) {
+		auto& [chatId, r] = reminders[i];
+		chatId = chatOf(rng) % 10000;
+		r._id = i;
+		r.descr = fmt::format("burst {}", i);
+		r.day = static_cast<unsigned>(ymd.day());
+		r.month = static_cast<unsigned>(ymd.month());
+		r.year = static_cast<int>(ymd.year());
+		r.hour = 9;
+		r.minute = i % 10 < 8 ? 0 : i % 10 - 7;
+	}
+
+	for (auto window : {0, 60, 180}) {
+		std::remove("bench_burst.db");
+		up::db db("bench_burst.db");
+		VirtualClock clock(start);
+		ChatZones zones(db, clock);
+
+		size_t calls = 0;
+		size_t maxSize = 0;
+		ReminderQuery q(
+		    [&](std::int64_t, const std::string& text) {
+			    ++calls;
+			    maxSize = std::max(maxSize, text.size());
+		    },
+		    zones, clock);
+		q.setCoalesceWindow(seconds(window));
+		for (const auto& [chatId, r] : reminders) {
+			q.addTimer(chatId, zone.toUtc(r.getNearTs(localStart)), r);
+		}
+
+		const auto runStart = steady_clock::now();
+		q.runUntil(start + days(1));
+		const auto runTime = duration_cast<duration<double, std::milli>>(steady_clock::now() - runStart).count();
+
+		std::cout << fmt::format("top-of-hour burst, window {:>3}s: {} fired, {} sendMessage calls ({} saved, "
+		                         "{:.1f}%), largest message {} bytes, {:.1f} ms",
+		                 window, q.fired(), calls, q.fired() - calls, 100.0 * (q.fired() - calls) / q.fired(), maxSize,
+		                 runTime)
+		          << std::endl;
+	}
+}
+
+// Heap bytes and fire throughput of 200k weekly reminders queued for a month: one trigger each, three
+// triggers sharing one record (two pre-reminders), and three independent copies per reminder.
+void benchPreReminders() {
+	using namespace std::chrono;
+
+	const auto start = time_point_s(date::sys_days{date::year(2026) / 2 / 1}.time_since_epoch());
+	const auto& zone = defaultTzTable();
+	const auto localStart = zone.toLocal(start);
+
+	std::mt19937_64 rng(36);
+	std::vector<ReminderInfo> reminders(200000);
+	for (size_t i = 0; i != reminders.size(); ++i) {
+		auto& r = reminders[i];
+		auto [ymd, tod] = ymdTodFromTp(localStart + days(1) + minutes(rng() % (7 * 24 * 60)));
+		r._id = i;
+		r.descr = fmt::format("Созвон с командой {}", i);
+		r.day = static_cast<unsigned>(ymd.day());
+		r.month = static_cast<unsigned>(ymd.month());
+		r.year = static_cast<int>(ymd.year());
+		r.hour = tod.hours().count();
+		r.minute = tod.minutes().count();
+		r.week_repeat = 1 << (i % 7);
+	}
+
+	enum class Mode { Single, Shared, Copies };
+	for (auto mode : {Mode::Single, Mode::Shared, Mode::Copies}) {
+		std::remove("bench_pre.db");
+		up::db db("bench_pre.db");
+		VirtualClock clock(start);
+		ChatZones zones(db, clock);
+		ReminderQuery q([](std::int64_t, const std::string&) {}, zones, clock);
+
+		const auto heapBefore = mallinfo2().uordblks;
+		for (auto r : reminders) {
+			const auto chatId = static_cast<std::int64_t>(r._id % 20000);
+			const auto tp = zone.toUtc(r.getNearTs(localStart));
+			if (mode == Mode::Shared) {
+				r.setPreReminders({15, 60});
+			}
+			q.addTimer(chatId, tp, r);
+			if (mode == Mode::Copies) {
+				// A copy is the same weekly reminder moved earlier by the offset.
+				for (auto offset : {minutes(15), minutes(60)}) {
+					auto copy = r;
+					auto localTp = zone.toLocal(tp - offset);
+					auto [ymd, tod] = ymdTodFromTp(localTp);
+					copy.day = static_cast<unsigned>(ymd.day());
+					copy.month = static_cast<unsigned>(ymd.month());
+					copy.year = static_cast<int>(ymd.year());
+					copy.hour = tod.hours().count();
+					copy.minute = tod.minutes().count();
+					copy.week_repeat = 1 << (date::weekday(date::sys_days{ymd}).iso_encoding() - 1);
+					q.addTimer(chatId, tp - offset, copy);
+				}
+			}
+		}
+		const auto heapBytes = mallinfo2().uordblks - heapBefore;
+		const auto triggers = q.size();
+
+		const auto runStart = steady_clock::now();
+		q.runUntil(start + days(28));
+		const auto runS = duration_cast<duration<double>>(steady_clock::now() - runStart).count();
+
+		std::cout << fmt::format("pre-reminders {:<7} {} triggers, {:.0f} heap bytes/reminder, {} fired in {:.2f}s "
+		                         "({:.0f} fires/s)",
+		                 mode == Mode::Single ? "off" : mode == Mode::Shared ? "shared" : "copies", triggers,
+		                 static_cast<double>(heapBytes) / reminders.size(), q.fired(), runS, q.fired() / runS)
+		          << std::endl;
+	}
+}
+
+// 100k-row CSV import: one commit per row as /add does vs batched commits, then one bulk addTimers and a
+// streaming export of the result.
+void benchImport() {
+	using namespace std::chrono;
+	auto ms = [](auto d) { return duration_cast<duration<double, std::milli>>(d).count(); };
+
+	const size_t ROWS = 100000;
+	std::string csv = "date,time,repeat,descr,pre\n";
+	for (size_t i = 0; i != ROWS; ++i) {
+		static const char* const REPEATS[] = {"n", "d1", "w135", "m1", "y"};
+		csv += fmt::format("{}.{}.2027,{}:{:0>2},{},\"Импорт, строка {}\",{}\n", 1 + i % 28, 1 + i % 12, i % 24, i % 60,
+		    REPEATS[i % 5], i, i % 3 ? "" : "15;60");
+	}
+
+	const auto& zone = defaultTzTable();
+	for (size_t batch : {size_t(1), size_t(1000)}) {
+		// Per-row commits are measured on a slice, they are too slow for the whole file.
+		const size_t rows = batch == 1 ? 2000 : ROWS;
+		size_t end = 0;
+		for (size_t i = 0; i != rows + 1; ++i) {
+			end = csv.find('\n', end) + 1;
+		}
+		std::istringstream in(csv.substr(0, end));
+
+		std::remove("bench_import.db");
+		std::remove("bench_import.kv");
+		up::db db("bench_import.db");
+		ReminderStore store("bench_import.kv");
+
+		const auto importStart = steady_clock::now();
+		auto result = importReminders(store, 1, in, ReminderFormat::Csv, zone, nowUtc(), batch);
+		const auto importTime = steady_clock::now() - importStart;
+
+		ChatZones zones(db);
+		ReminderQuery q([](std::int64_t, const std::string&) {}, zones);
+		const auto addStart = steady_clock::now();
+		q.addTimers(result.timers);
+		const auto addTime = steady_clock::now() - addStart;
+
+		std::ostringstream out;
+		const auto exportStart = steady_clock::now();
+		const auto exported = exportReminders(store, 1, out, ReminderFormat::Csv);
+		const auto exportTime = steady_clock::now() - exportStart;
+
+		std::cout << fmt::format("import batch {:>4}: {} rows ({} failed) in {:.1f} ms ({:.0f} rows/s), addTimers "
+		                         "{:.1f} ms, export {} rows {:.1f} ms",
+		                 batch, result.stats.imported, result.stats.failed, ms(importTime),
+		                 result.stats.imported / (ms(importTime) / 1000), ms(addTime), exported, ms(exportTime))
+		          << std::endl;
+	}
+}
+
+// A stored reminder of the cold start and load benchmarks.
+ReminderInfo benchReminder(int i) {
+	ReminderInfo ri;
+	ri.descr = fmt::format("Напоминание {}", i);
+	ri.day = 1 + i % 28;
+	ri.month = 1 + i % 12;
+	ri.year = 2030;
+	ri.hour = i % 24;
+	ri.minute = i;
+	ri.week_repeat = i % 3 == 0 ? 0b11111 : 0;
+	return ri;
+}
+
+// Reading every chat's reminders: documents with per-field lookups vs the binary records of ReminderStore,
+// and the one-time migration between them.
+void benchLoadReminders() {
+	using namespace std::chrono;
+
+	const std::int64_t CHATS = 2000;
+	const int PER_CHAT = 50;
+
+	std::remove("bench_load.db");
+	std::remove("bench_load.kv");
+	up::db db("bench_load.db");
+	ReminderStore store("bench_load.kv");
+	for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+		const auto collection = fmt::format("reminders_{}", chatId);
+		db.compile_or_throw("db_create($col);").bind_or_throw("col", collection).exec_or_throw();
+		up::vm_store_record(db).store_or_throw("users", up::value::object{{"id", chatId}, {"chat_id", chatId}});
+		for (int i = 0; i != PER_CHAT; ++i) {
+			up::value v;
+			benchReminder(i).toValue(v);
+			up::vm_store_record(db).store_or_throw(collection, v);
+		}
+	}
+	commitOrThrow(db);
+
+	auto ms = [](auto d) { return duration_cast<duration<double, std::milli>>(d).count(); };
+
+	const auto migrateStart = steady_clock::now();
+	const auto migrated = migrateReminders(db, store);
+	const auto migrateTime = steady_clock::now() - migrateStart;
+
+	size_t documents = 0;
+	const auto documentsStart = steady_clock::now();
+	for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+		documents += loadReminderDocuments(db, chatId).size();
+	}
+	const auto documentsTime = steady_clock::now() - documentsStart;
+
+	size_t records = 0;
+	const auto recordsStart = steady_clock::now();
+	for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+		records += loadReminders(store, chatId).size();
+	}
+	const auto recordsTime = steady_clock::now() - recordsStart;
+
+	std::cout << fmt::format("load {} chats x {} reminders: documents {:.1f} ms ({:.0f} reminders/s), records "
+	                         "{:.1f} ms ({:.0f} reminders/s), migration {} reminders {:.1f} ms",
+	                 CHATS, PER_CHAT, ms(documentsTime), documents / (ms(documentsTime) / 1000), ms(recordsTime),
+	                 records / (ms(recordsTime) / 1000), migrated, ms(migrateTime))
+	          << std::endl;
+
+	std::string packed;
+	appendReminder(packed, benchReminder(1));
+	bench("readReminder", 1000000, [&](size_t) {
+		const char* pos = packed.data();
+		ReminderInfo ri;
+		readReminder(pos, pos + packed.size(), ri);
+		return ri.descr.size();
+	});
+}
+
+// Time from process start to the first poll: full database scan vs mapping a queue snapshot.
+void benchColdStart() {
+	using namespace std::chrono;
+
+	const std::int64_t CHATS = 10000;
+	const int PER_CHAT = 20;
+
+	std::remove("bench_cold.db");
+	std::remove("bench_cold.kv");
+	std::remove("bench_cold.snap");
+	{
+		up::db db("bench_cold.db");
+		ReminderStore store("bench_cold.kv");
+		for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+			db.compile_or_throw("db_create($col);")
+			    .bind_or_throw("col", fmt::format("reminders_{}", chatId))
+			    .exec_or_throw();
+			up::vm_store_record(db).store_or_throw("users", up::value::object{{"id", chatId}, {"chat_id", chatId}});
+			for (int i = 0; i != PER_CHAT; ++i) {
+				storeReminder(store, chatId, benchReminder(i));
+			}
+		}
+		commitOrThrow(db);
+		store.commit();
+	}
+
+	up::db db("bench_cold.db");
+	ReminderStore store("bench_cold.kv");
+	ChatZones zones(db);
+	auto noop = [](std::int64_t, const std::string&) {};
+
+	const auto scanStart = steady_clock::now();
+	ReminderQuery scanned(noop, zones);
+	for (const auto& uc : loadUserChats(db)) {
+		scanned.replaceChat(uc.chatId, nextTimers(loadReminders(store, uc.chatId), zones.zone(uc.chatId), nowUtc()), 0);
+	}
+	const auto scanTime = steady_clock::now() - scanStart;
+
+	const auto writeStart = steady_clock::now();
+	writeSchedulerSnapshot("bench_cold.snap", scanned.timers(), nowUtc());
+	const auto writeTime = steady_clock::now() - writeStart;
+
+	const auto loadStart = steady_clock::now();
+	ReminderQuery loaded(noop, zones);
+	auto snapshot = loadSchedulerSnapshot("bench_cold.snap");
+	if (snapshot) {
+		loaded.addTimers(resumeTimers(std::move(snapshot->timers), zones, nowUtc()));
+	}
+	const auto loadTime = steady_clock::now() - loadStart;
+
+	auto ms = [](auto d) { return duration_cast<duration<double, std::milli>>(d).count(); };
+	std::cout << fmt::format("cold start {} chats x {} reminders: full scan {:.1f} ms ({} timers), snapshot write "
+	                         "{:.1f} ms, snapshot load {:.1f} ms ({} timers)",
+	                 CHATS, PER_CHAT, ms(scanTime), scanned.size(), ms(writeTime), ms(loadTime), loaded.size())
+	          << std::endl;
+}
+
+// Hot standby over a unix socket: lag from a journal append on the primary to the follower applying it,
+// and takeover time from the primary going away to a follower queue ready to run.
+// Stand-in for a slow stderr (a terminal, a pipe to a busy journald): every write takes about 20 us.
+class SlowSink: public spdlog::sinks::base_sink<std::mutex> {
+  public:
+	size_t written = 0;
+
+  protected:
+	void sink_it_(const spdlog::details::log_msg& msg) override {
+		spdlog::memory_buf_t formatted;
+		formatter_->format(msg, formatted);
+		const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+		while (std::chrono::steady_clock::now() < until) {
+		}
+		written += formatted.size() > 0;
+	}
+
+	void flush_() override {}
+};
+
+// Time spent in the log call by 4 sender-like threads, each logging a failed send every 200 us, with the
+// synchronous logger the handlers used to have and with the async one.
+void benchLogging() {
+	using namespace std::chrono;
+
+	const int THREADS = 4;
+	const int PER_THREAD = 5000;
+	auto run = [&](const char* name, spdlog::logger& logger, auto overruns) {
+		std::vector<std::vector<double>> perThread(THREADS);
+		std::vector<std::thread> threads;
+		const auto start = steady_clock::now();
+		for (int t = 0; t != THREADS; ++t) {
+			threads.emplace_back([&, t] {
+				auto next = steady_clock::now();
+				for (int i = 0; i != PER_THREAD; ++i) {
+					const auto before = steady_clock::now();
+					logger.error("send_failed chat={} reminders={} error={}", -1001234567890 - t, i,
+					    "Too Many Requests: retry after 5");
+					perThread[t].push_back(duration<double, std::nano>(steady_clock::now() - before).count());
+					next += microseconds(200);
+					while (steady_clock::now() < next) {
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		const auto elapsed = steady_clock::now() - start;
+		const auto overwritten = overruns();
+		std::vector<double> all;
+		for (auto& v : perThread) {
+			all.insert(all.end(), v.begin(), v.end());
+		}
+		std::sort(all.begin(), all.end());
+		auto pct = [&](double p) { return all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+		std::cout << fmt::format("log call {:<6} {} calls in {:.0f} ms: p50 {:.0f} ns p99 {:.0f} ns max {:.0f} ns, "
+		                         "{} overwritten",
+		                 name, all.size(), duration<double, std::milli>(elapsed).count(), pct(0.5), pct(0.99),
+		                 all.back(), overwritten)
+		          << std::endl;
+	};
+
+	auto syncSink = std::make_shared<SlowSink>();
+	spdlog::logger sync("bench_sync", syncSink);
+	sync.set_pattern("%Y-%m-%dT%H:%M:%S.%e %l %v");
+	run("sync", sync, [] { return 0; });
+
+	auto pool = std::make_shared<spdlog::details::thread_pool>(LOG_QUEUE_SIZE, 1);
+	auto async = makeAsyncLogger("bench_async", std::make_shared<SlowSink>(), pool);
+	run("async", *async, [&] {
+		while (pool->queue_size() != 0) {
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return pool->overrun_counter();
+	});
+}
+
+// The scheduler's sleep before the timerfd alarm: every change of the queue made on another thread
+// notifies it, and it sleeps a relative wait_for from a whole-second now().
+class NotifyingClock: public SystemClock {
+  public:
+	std::unique_ptr<Alarm> makeAlarm() override {
+		struct NotifyingAlarm: CondAlarm {
+			using CondAlarm::CondAlarm;
+
+			void set(time_point_s deadline) override {
+				CondAlarm::set(deadline);
+				if (std::this_thread::get_id() != waiter) {
+					wake();
+				}
+			}
+
+			Reason wait(std::unique_lock<std::mutex>& lk) override {
+				waiter = std::this_thread::get_id();
+				return CondAlarm::wait(lk);
+			}
+
+			std::thread::id waiter;
+		};
+		return std::make_unique<NotifyingAlarm>(*this);
+	}
+};
+
+// Real-time scheduler run: three probe timers 1-3 s ahead while another thread adds and removes timers an
+// hour ahead every 2 ms, as chats editing their reminders do. Reports wakeups, the ones with nothing due
+// and how late the probes fired.
+void benchSchedulerWakeups() {
+	using namespace std::chrono;
+
+	std::remove("bench_wakeups.db");
+	up::db db("bench_wakeups.db");
+	ChatZones zones(db);
+	auto run = [&](const char* name, Clock& clock) {
+		auto& wakeups = metrics().counter("scheduler_wakeups_total", "");
+		auto& spurious = metrics().counter("scheduler_spurious_wakeups_total", "");
+		const auto wakeupsBefore = wakeups.value();
+		const auto spuriousBefore = spurious.value();
+
+		std::vector<double> lateMs;
+		ReminderQuery q([](std::int64_t, const std::string&) {}, zones, clock);
+		q.setFireHook([&](std::int64_t chatId, const ReminderInfo&, time_point_s deadline, time_point_s) {
+			if (chatId == 1) {
+				lateMs.push_back(duration<double, std::milli>(system_clock::now().time_since_epoch() -
+				                                              deadline.time_since_epoch())
+				                     .count());
+			}
+		});
+		const auto start = steady_clock::now();
+		const auto now = nowUtc();
+		for (int i = 1; i <= 3; ++i) {
+			auto ri = benchReminder(1);
+			ri._id = i;
+			q.addTimer(1, now + seconds(i), ri);
+		}
+		std::thread scheduler([&] { q.run(); });
+		int changes = 0;
+		for (; steady_clock::now() - start < milliseconds(3500); ++changes) {
+			auto ri = benchReminder(1);
+			ri._id = changes;
+			q.addTimer(2 + changes % 1000, now + hours(1) + seconds(changes), ri);
+			if (changes >= 100) {
+				q.removeTimer(2 + (changes - 100) % 1000, changes - 100);
+			}
+			std::this_thread::sleep_for(milliseconds(2));
+		}
+		q.stop();
+		scheduler.join();
+
+		const auto elapsed = duration<double>(steady_clock::now() - start).count();
+		const auto spuriousCount = spurious.value() - spuriousBefore;
+		std::sort(lateMs.begin(), lateMs.end());
+		std::cout << fmt::format("scheduler {:<9} {} changes in {:.1f} s: {} wakeups, {} with nothing due "
+		                         "({:.0f}/hour), probes {} late {:.1f}..{:.1f} ms",
+		                 name, changes, elapsed, wakeups.value() - wakeupsBefore, spuriousCount,
+		                 spuriousCount / elapsed * 3600, lateMs.size(), lateMs.empty() ? 0.0 : lateMs.front(),
+		                 lateMs.empty() ? 0.0 : lateMs.back())
+		          << std::endl;
+	};
+
+	NotifyingClock notifying;
+	run("notifying", notifying);
+	run("timerfd", systemClock());
+	std::remove("bench_wakeups.db");
+}
+
+// Wizard clicks on db.bin: the file size they leave behind, then a compaction and a snapshot run while a
+// handler thread keeps clicking, with the lock pauses they take and how long the clicks waited.
+void benchDbChurn() {
+	using namespace std::chrono;
+
+	const std::int64_t CHATS = 2000;
+	const int CLICKS = 200000;
+	const auto start = time_point_s(date::sys_days{date::year(2026) / 1 / 1}.time_since_epoch());
+
+	std::remove("bench_churn.db");
+	std::remove("bench_churn.kv");
+	up::db db("bench_churn.db");
+	ReminderStore store("bench_churn.kv");
+	VirtualClock clock(start);
+	ChatZones zones(db, clock);
+	DynamicStorage ds(db, "dynamic_storage", clock);
+	std::mutex dbMutex;
+	DbMaintenance maintenance(db, "bench_churn.db", store, dbMutex, ds, zones);
+	std::string error;
+	ReminderInfo ri;
+	ri.parseCommand("/add 01.01.2026 12:00 - Запись", error);
+	for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+		registerChat(db, chatId, chatId);
+		if (chatId % 4 == 0) {
+			zones.set(chatId, "Europe/Moscow");
+		}
+	}
+	commitOrThrow(db);
+
+	int click = 0;
+	auto clickOnce = [&] {
+		// A wizard is five clicks on one message, its state lives for ten minutes.
+		const auto wizard = click / 5;
+		up::value state = up::value::object{{"date", "01.01.2026"}, {"time", fmt::format("12:{:02}", click % 60)}};
+		ds.make(chatMsgKey(1 + wizard % CHATS, wizard), std::move(state), 600);
+		if (click % 5 == 4) {
+			storeReminder(store, 1 + wizard % CHATS, ri);
+		}
+		if (++click % 100 == 0) {
+			ds.flush();
+			commitOrThrow(db);
+			store.commit();
+			clock.advance(seconds(10));
+			ds.find(chatMsgKey(0, 0));
+		}
+	};
+	for (int i = 0; i != CLICKS; ++i) {
+		clickOnce();
+	}
+	ds.flush();
+	commitOrThrow(db);
+	store.commit();
+
+	auto underLoad = [&](const char* name, auto&& f) {
+		std::atomic_bool done = false;
+		std::vector<double> waits;
+		std::thread handler([&] {
+			while (!done) {
+				const auto before = steady_clock::now();
+				std::scoped_lock l(dbMutex);
+				waits.push_back(duration<double, std::micro>(steady_clock::now() - before).count());
+				clickOnce();
+			}
+		});
+		const auto result = f();
+		done = true;
+		handler.join();
+		std::sort(waits.begin(), waits.end());
+		auto pct = [&](double p) { return waits[std::min(waits.size() - 1, size_t(p * waits.size()))]; };
+		std::cout << fmt::format("db {:<8} {} -> {} bytes in {:.0f} ms, {} pauses, longest {:.0f} us; "
+		                         "{} clicks meanwhile waited p50 {:.0f} us p99 {:.0f} us max {:.0f} us",
+		                 name, result.bytesBefore, result.bytesAfter,
+		                 duration<double, std::milli>(result.elapsed).count(), result.pauses,
+		                 duration<double, std::micro>(result.maxPause).count(), waits.size(), pct(0.5), pct(0.99),
+		                 waits.back())
+		          << std::endl;
+	};
+
+	underLoad("snapshot", [&] { return maintenance.snapshot("bench_churn.backup"); });
+	underLoad("compact", [&] { return maintenance.compact(); });
+	{
+		std::scoped_lock l(dbMutex);
+		ds.flush();
+		commitOrThrow(db);
+		store.commit();
+	}
+	std::cout << fmt::format("db after compaction: {} live wizard states, {} registered chats, files {} + {} bytes",
+	                 ds.records().size(), loadUserChats(db).size(), DbMaintenance::fileSize("bench_churn.db"),
+	                 DbMaintenance::fileSize("bench_churn.kv"))
+	          << std::endl;
+	for (const auto& path : {"bench_churn.db", "bench_churn.kv", "bench_churn.backup/bench_churn.db",
+	         "bench_churn.backup/bench_churn.kv"}) {
+		std::remove(path);
+	}
+	::rmdir("bench_churn.backup");
+}
+
+void benchReplication() {
+	using namespace std::chrono;
+
+	const std::int64_t CHATS = 10000;
+	const int PER_CHAT = 20;
+	const int LIVE = 20000;
+	const auto heartbeat = milliseconds(50);
+
+	std::remove("bench_repl.db");
+	std::remove("bench_repl.wal");
+	up::db db("bench_repl.db");
+	ChatZones zones(db);
+	auto noop = [](std::int64_t, const std::string&) {};
+	SchedulerWal wal("bench_repl.wal");
+	ReminderQuery primary(noop, zones);
+	primary.setJournal(&wal);
+	const auto tp = nowUtc() + hours(24 * 30);
+	std::vector<ReminderQuery::Timer> timers;
+	for (std::int64_t chatId = 1; chatId <= CHATS; ++chatId) {
+		for (int i = 0; i != PER_CHAT; ++i) {
+			auto ri = benchReminder(i);
+			ri._id = i;
+			timers.push_back({chatId, tp + minutes(i), ri});
+		}
+	}
+	primary.addTimers(timers);
+
+	PrimaryLock primaryLock("bench_repl.sock");
+	primaryLock.tryLock();
+	ReplicationServer server("bench_repl.sock", wal, [&] {
+		ReplicationSnapshot snapshot;
+		auto [queued, lsn] = primary.checkpoint();
+		snapshot.lsn = lsn;
+		for (auto& t : queued) {
+			WalRecord r;
+			r.op = WalOp::Add;
+			r.chatId = t.chatId;
+			r.tp = t.tp;
+			r.reminder = std::move(t.reminder);
+			snapshot.records.push_back(std::move(r));
+		}
+		return snapshot;
+	}, heartbeat);
+
+	std::mutex m;
+	std::unordered_map<std::uint64_t, steady_clock::time_point> appendedAt;
+	std::vector<double> lags;
+	std::atomic<std::uint64_t> applied = 0;
+	steady_clock::time_point syncStart = steady_clock::now(), syncedAt;
+	std::map<std::int64_t, std::multimap<time_point_s, ReminderInfo>> image;
+	ReplicationFollower follower("bench_repl.sock",
+	    {[&] { image.clear(); },
+	        [&](const WalRecord& r) {
+		        applyWalRecord(image, r);
+		        std::scoped_lock l(m);
+		        if (auto found = appendedAt.find(r.lsn); found != appendedAt.end()) {
+			        lags.push_back(duration<double, std::micro>(steady_clock::now() - found->second).count());
+			        appendedAt.erase(found);
+		        }
+		        applied = r.lsn;
+	        },
+	        [&](std::uint64_t lsn) {
+		        syncedAt = steady_clock::now();
+		        applied = lsn;
+	        }});
+	std::atomic_bool stop = false;
+	bool complete = false;
+	steady_clock::time_point returnedAt;
+	std::thread followerThread([&] {
+		complete = follower.run(stop);
+		returnedAt = steady_clock::now();
+	});
+
+	while (applied < wal.lsn()) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+	const auto syncTime = syncedAt - syncStart;
+
+	// Live writes at about 20k/s.
+	for (int i = 0; i != LIVE; ++i) {
+		auto ri = benchReminder(i);
+		ri._id = PER_CHAT + i;
+		{
+			std::scoped_lock l(m);
+			primary.addTimer(1 + i % CHATS, tp + minutes(i), ri);
+			appendedAt[wal.lsn()] = steady_clock::now();
+		}
+		if (i % 100 == 99) {
+			std::this_thread::sleep_for(milliseconds(5));
+		}
+	}
+	while (applied < wal.lsn()) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+
+	const auto primaryGone = steady_clock::now();
+	server.stop();
+	primaryLock.unlock();
+	followerThread.join();
+	std::vector<ReminderQuery::Timer> replicated;
+	for (auto& [chatId, reminders] : image) {
+		for (auto& [t, r] : reminders) {
+			replicated.push_back({chatId, t, std::move(r)});
+		}
+	}
+	ReminderQuery standby(noop, zones);
+	standby.addTimers(resumeTimers(std::move(replicated), zones, nowUtc()));
+	const auto ready = steady_clock::now();
+
+	std::sort(lags.begin(), lags.end());
+	auto pct = [&](double p) { return lags.empty() ? 0.0 : lags[std::min(lags.size() - 1, size_t(p * lags.size()))]; };
+	auto ms = [](auto d) { return duration_cast<duration<double, std::milli>>(d).count(); };
+	std::cout << fmt::format("replication {} timers: initial sync {:.1f} ms, lag over {} live records p50 {:.0f} us "
+	                         "p99 {:.0f} us max {:.0f} us",
+	                 CHATS * PER_CHAT, ms(syncTime), lags.size(), pct(0.5), pct(0.99), lags.empty() ? 0.0 : lags.back())
+	          << std::endl;
+	std::cout << fmt::format("replication takeover: primary gone to follower returning {:.1f} ms, "
+	                         "queue ready {:.1f} ms, {} timers, {} (queue sizes {} / {})",
+	                 ms(returnedAt - primaryGone), ms(ready - primaryGone), standby.timers().size(),
+	                 complete ? "complete" : "partial", standby.size(), primary.size())
+	          << std::endl;
+	std::remove("bench_repl.db");
+	std::remove("bench_repl.wal");
+	std::remove("bench_repl.sock");
+	std::remove("bench_repl.sock.lock");
+}
+
+// Phrases of private messages with the reminder the parser should offer for them at Monday 19/10/2026 10:00
+// (ReminderInfo::toString()), or none: how many it gets right, how many plain messages it mistakes for a
+// reminder, and how long a phrase takes.
+void benchPhraseParser() {
+	using namespace std::chrono;
+
+	const time_point_s now{date::sys_days{date::year(2026) / 10 / 19}.time_since_epoch() + hours(10)};
+	const std::pair<std::string, std::string> corpus[] = {
+	    {"завтра в 9 позвонить маме", "20/10/2026 09:00  позвонить маме"},
+	    {"каждый понедельник 10:30 планёрка", "19/10/2026 10:30 w1 планёрка"},
+	    {"через 15 минут выключить плиту", "19/10/2026 10:15  выключить плиту"},
+	    {"Напомни мне послезавтра в 18:00 забрать посылку", "21/10/2026 18:00  забрать посылку"},
+	    {"в пятницу в 7 вечера кино", "23/10/2026 19:00  кино"},
+	    {"через полчаса проверить духовку", "19/10/2026 10:30  проверить духовку"},
+	    {"через час созвон", "19/10/2026 11:00  созвон"},
+	    {"через 2 дня оплатить счёт", "21/10/2026 10:00  оплатить счёт"},
+	    {"через неделю вернуть книгу", "26/10/2026 10:00  вернуть книгу"},
+	    {"через месяц продлить подписку", "19/11/2026 10:00  продлить подписку"},
+	    {"5 марта день рождения Пети", "05/03/2027 09:00  день рождения Пети"},
+	    {"23.12 корпоратив в 19:00", "23/12/2026 19:00  корпоратив"},
+	    {"23.12.2026 14:30 обед", "23/12/2026 14:30  обед"},
+	    {"по будням в 8:00 зарядка", "19/10/2026 08:00 w12345 зарядка"},
+	    {"по понедельникам и средам в 19 бассейн", "19/10/2026 19:00 w13 бассейн"},
+	    {"каждый день в 22:00 таблетки", "19/10/2026 22:00 d1 таблетки"},
+	    {"ежедневно в 9 утра витамины", "19/10/2026 09:00 d1 витамины"},
+	    {"каждые 2 недели в 10 уборка", "19/10/2026 10:00 d14 уборка"},
+	    {"каждый месяц оплатить квартиру", "19/10/2026 09:00 m1 оплатить квартиру"},
+	    {"сегодня в 3 дня встреча", "19/10/2026 15:00  встреча"},
+	    {"в 12 ночи выключить свет", "20/10/2026 00:00  выключить свет"},
+	    {"в полдень обед", "19/10/2026 12:00  обед"},
+	    {"утром пробежка", "20/10/2026 09:00  пробежка"},
+	    {"вечером позвонить папе", "19/10/2026 19:00  позвонить папе"},
+	    {"в среду купить молоко", "21/10/2026 09:00  купить молоко"},
+	    {"в следующий понедельник отчёт", "26/10/2026 09:00  отчёт"},
+	    {"по выходным в 11 завтрак", "19/10/2026 11:00 w67 завтрак"},
+	    {"в 9.30 стендап", "20/10/2026 09:30  стендап"},
+	    {"tomorrow at 9 call mom", "20/10/2026 09:00  call mom"},
+	    {"every monday at 10:30 standup", "19/10/2026 10:30 w1 standup"},
+	    {"in 15 minutes turn off the stove", "19/10/2026 10:15  turn off the stove"},
+	    {"in an hour check email", "19/10/2026 11:00  check email"},
+	    {"at 6pm gym", "19/10/2026 18:00  gym"},
+	    {"on friday at 7pm movie", "23/10/2026 19:00  movie"},
+	    {"every day at 8am pills", "19/10/2026 08:00 d1 pills"},
+	    {"remind me to pay rent on march 1", "01/03/2027 09:00  pay rent"},
+	    {"weekdays at 9:00 standup", "19/10/2026 09:00 w12345 standup"},
+	    {"every tue and thu at 18:00 yoga", "19/10/2026 18:00 w24 yoga"},
+	    {"on sat clean the house", "24/10/2026 09:00  clean the house"},
+	    {"next friday dinner with Anna", "23/10/2026 09:00  dinner with Anna"},
+	    {"daily 10pm read", "19/10/2026 22:00 d1 read"},
+	    {"купить хлеб", ""},
+	    {"позвонить 3 раза", ""},
+	    {"сходить в магазин", ""},
+	    {"у меня 2 кота", ""},
+	    {"на работе всё хорошо", ""},
+	    {"I have 3 cats", ""},
+	    {"meeting with the team", ""},
+	    {"sun is shining", ""},
+	    {"ЗАВТРА В 10 ВРАЧ", "20/10/2026 10:00  ВРАЧ"},
+	    {"в 25:00 ошибка", ""},
+	    {"31.02 странная дата", ""},
+	    {"осталось 2 дня до отпуска", ""},
+	    {"купить 2 кг яблок", ""},
+	    {"посмотреть 1 серию", ""},
+	    {"квартира на 2 комнаты", ""},
+	    {"напомни про встречу", ""},
+	    {"в пн и ср в 9:15 английский", "19/10/2026 09:15 w13 английский"},
+	    {"к 10 утра сдать отчёт", "20/10/2026 10:00  сдать отчёт"},
+	    {"через 3 часа забрать детей", "19/10/2026 13:00  забрать детей"},
+	    {"ежегодно 14 февраля цветы", "14/02/2027 09:00 y цветы"},
+	    {"every 2 weeks water plants", "19/10/2026 09:00 d14 water plants"},
+	    {"wednesday 6:30pm dentist", "21/10/2026 18:30  dentist"},
+	};
+
+	size_t accepted = 0, correct = 0, falsePositives = 0, missed = 0;
+	for (const auto& [phrase, expected] : corpus) {
+		const auto parsed = parsePhrase(phrase, now);
+		const auto got = parsed ? parsed->toString() : std::string();
+		accepted += parsed.has_value();
+		if (got == expected) {
+			correct += parsed.has_value();
+			continue;
+		}
+		if (expected.empty()) {
+			++falsePositives;
+		} else if (!parsed) {
+			++missed;
+		}
+		std::cout << fmt::format("phrase mismatch \"{}\": got \"{}\", expected \"{}\"", phrase, got, expected)
+		          << std::endl;
+	}
+	const auto reminders = static_cast<size_t>(
+	    std::count_if(std::begin(corpus), std::end(corpus), [](const auto& c) { return !c.second.empty(); }));
+	std::cout << fmt::format("phrase parser {} phrases, {} reminders: {} accepted, {} correct, {} false positives, "
+	                         "{} missed, precision {:.1f}%, recall {:.1f}%",
+	                 std::size(corpus), reminders, accepted, correct, falsePositives, missed,
+	                 accepted ? 100.0 * correct / accepted : 0.0, reminders ? 100.0 * correct / reminders : 0.0)
+	          << std::endl;
+
+	bench("parsePhrase", 200000, [&](size_t i) {
+		const auto parsed = parsePhrase(corpus[i % std::size(corpus)].first, now);
+		return parsed ? static_cast<size_t>(parsed->hour) : 0;
+	});
+}
+
+int main() {
+	benchKeyboards();
+	benchTimeZones();
+	benchHashMaps();
+	benchSchedulerSimulation();
+	benchTopOfHourBurst();
+	benchPreReminders();
+	benchImport();
+	benchLoadReminders();
+	benchColdStart();
+	benchReplication();
+	benchLogging();
+	benchSchedulerWakeups();
+	benchDbChurn();
+	benchPhraseParser();
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "chat_zones.hpp"
+#include "clock.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "reminder_info.hpp"
+#include "reminder_query.hpp"
+#include "trace.hpp"
+#include "tz_table.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Occurrences missed while the bot was down, grouped by chat.
+struct MissedReminder {
+	ReminderInfo reminder;
+	std::vector<time_point_s> occurrences; // local time
+};
+using MissedByChat = std::map<std::int64_t /*chatId*/, std::vector<MissedReminder>>;
+
+// Repeats are capped, a daily reminder missed for a year is reported as one line anyway.
+constexpr size_t MAX_MISSED_OCCURRENCES = 100;
+
+// Occurrences (local time) of `r` in (fromUtc, toUtc].
+inline std::vector<time_point_s> occurrencesBetween(const ReminderInfo& r, const TzTable& zone, time_point_s fromUtc,
+    time_point_s toUtc, size_t limit = MAX_MISSED_OCCURRENCES) {
+	std::vector<time_point_s> out;
+	auto localTp = zone.toLocal(fromUtc);
+	const auto localEnd = zone.toLocal(toUtc);
+	while (out.size() < limit) {
+		auto nextTp = nextOccurrence(r, localTp);
+		if (nextTp <= localTp || nextTp > localEnd) {
+			break;
+		}
+		out.push_back(nextTp);
+		localTp = nextTp;
+	}
+
+	return out;
+}
+
+// Missed occurrences of a recovered queue: every timer due before `utcTp` never fired.
+inline MissedByChat missedFromTimers(const std::vector<ReminderQuery::Timer>& timers, const ChatZones& zones,
+    time_point_s utcTp) {
+	TRACE_SCOPE("missedFromTimers", "catch_up");
+	MissedByChat out;
+	for (const auto& t : timers) {
+		if (t.tp > utcTp) {
+			continue;
+		}
+		auto occurrences = occurrencesBetween(t.reminder, zones.zone(t.chatId), t.tp - std::chrono::seconds(1), utcTp);
+		if (!occurrences.empty()) {
+			out[t.chatId].push_back({t.reminder, std::move(occurrences)});
+		}
+	}
+
+	return out;
+}
+
+// Missed occurrences of reminders loaded from the database, for a cold start without a queue image.
+inline void addMissed(MissedByChat& out, std::int64_t chatId, const std::vector<ReminderInfo>& reminders,
+    const TzTable& zone, time_point_s lastAlive, time_point_s utcTp) {
+	for (const auto& r : reminders) {
+		auto occurrences = occurrencesBetween(r, zone, lastAlive, utcTp);
+		if (!occurrences.empty()) {
+			out[chatId].push_back({r, std::move(occurrences)});
+		}
+	}
+}
+
+// One summary per chat, split into messages of at most MAX_MESSAGE_SIZE bytes.
+inline std::vector<std::string> renderMissed(std::vector<MissedReminder> missed) {
+	std::sort(missed.begin(), missed.end(),
+	    [](const auto& a, const auto& b) { return a.occurrences.front() < b.occurrences.front(); });
+
+	std::vector<std::string> out;
+	std::string msg = "😴 Пока бот был недоступен, пропущены напоминания:\n";
+	for (const auto& m : missed) {
+		auto line = fmt::format("\n⏰ {}: {}", prettyDateTime(m.occurrences.front()), m.reminder.descr);
+		if (m.occurrences.size() > 1) {
+			line += fmt::format(" (×{}, последнее {})", m.occurrences.size(), prettyDateTime(m.occurrences.back()));
+		}
+		if (msg.size() + line.size() > MAX_MESSAGE_SIZE) {
+			out.push_back(std::move(msg));
+			msg.clear();
+		}
+		msg += line;
+	}
+	out.push_back(std::move(msg));
+
+	return out;
+}
+
+// Last moment the bot was known to be running, written periodically and on shutdown.
+inline std::optional<time_point_s> readHeartbeat(const std::string& path) {
+	std::ifstream in(path);
+	std::int64_t seconds;
+	if (!(in >> seconds)) {
+		return {};
+	}
+
+	return time_point_s(std::chrono::seconds(seconds));
+}
+
+inline void writeHeartbeat(const std::string& path, time_point_s utcTp) {
+	const auto tmp = path + ".tmp";
+	std::ofstream(tmp, std::ios::trunc) << utcTp.time_since_epoch().count();
+	std::rename(tmp.c_str(), path.c_str());
+}
+
+// Delivers queued messages on its own schedule: at most `perSecond` messages a second overall and one a
+// second per chat (the limits Telegram asks bulk senders to keep). Failed sends are retried a few times.
+class BatchSender {
+  public:
+	using Sender = ReminderQuery::Sender;
+
+	BatchSender(Sender sender, size_t perSecond = 25, Clock& clock = systemClock()):
+	    _sender(std::move(sender)), _perSecond(perSecond), _clock(clock) {}
+
+	void enqueue(std::int64_t chatId, std::string text) {
+		std::scoped_lock l(_m);
+		_queue.push_back({chatId, std::move(text), 0});
+	}
+
+	// Sends until the queue is empty or stop() is called.
+	void drain() {
+		TRACE_SCOPE("BatchSender::drain", "catch_up");
+		std::unique_lock lk(_m);
+		while (!_queue.empty() && !_stopped) {
+			const auto second = _clock.now();
+			std::set<std::int64_t> chats;
+			std::vector<Item> batch;
+			for (auto it = _queue.begin(); it != _queue.end() && batch.size() < _perSecond;) {
+				if (chats.insert(it->chatId).second) {
+					batch.push_back(std::move(*it));
+					it = _queue.erase(it);
+				} else {
+					++it;
+				}
+			}
+
+			lk.unlock();
+			std::vector<Item> failed;
+			for (auto& item : batch) {
+				try {
+					_sender(item.chatId, item.text);
+					++_sent;
+					_sentTotal.inc();
+				} catch (const std::exception& e) {
+					_errors.inc();
+					logger().warn("catch_up_send_failed chat={} attempt={} error={}", item.chatId, item.attempts + 1,
+					    e.what());
+					if (++item.attempts < MAX_ATTEMPTS) {
+						failed.push_back(std::move(item));
+					}
+				}
+			}
+			lk.lock();
+			_queue.insert(_queue.end(), std::make_move_iterator(failed.begin()), std::make_move_iterator(failed.end()));
+
+			if (!_queue.empty() && !_stopped) {
+				_clock.waitUntil(lk, _cond, second + std::chrono::seconds(1));
+			}
+		}
+	}
+
+	void stop() {
+		std::scoped_lock l(_m);
+		_stopped = true;
+		_cond.notify_all();
+	}
+
+	size_t sent() const { return _sent; }
+
+  private:
+	static constexpr size_t MAX_ATTEMPTS = 3;
+
+	struct Item {
+		std::int64_t chatId;
+		std::string text;
+		size_t attempts;
+	};
+
+	Sender _sender;
+	const size_t _perSecond;
+	Clock& _clock;
+
+	std::mutex _m;
+	std::condition_variable _cond;
+	std::deque<Item> _queue;
+	bool _stopped = false;
+	std::atomic<size_t> _sent = 0;
+
+	Counter& _sentTotal = metrics().counter("catch_up_messages_total", "Sent catch-up summaries");
+	Counter& _errors = metrics().counter("catch_up_send_errors_total", "Failed catch-up summary sends");
+};
+
+// Queues one summary per chat, returns the number of missed occurrences.
+inline size_t enqueueMissed(BatchSender& sender, const MissedByChat& missed) {
+	size_t occurrences = 0;
+	for (const auto& [chatId, reminders] : missed) {
+		for (const auto& m : reminders) {
+			occurrences += m.occurrences.size();
+		}
+		for (auto& msg : renderMissed(reminders)) {
+			sender.enqueue(chatId, std::move(msg));
+		}
+	}
+	metrics().counter("catch_up_missed_total", "Reminder occurrences missed during downtime").inc(occurrences);
+
+	return occurrences;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "chat_zones.hpp"
+#include "reminder_codec.hpp"
+#include "reminder_info.hpp"
+#include "reminder_storage.hpp"
+#include "reminder_store.hpp"
+
+#include <nlohmann/json.hpp>
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Everything a worker keeps about a chat, moved between workers when the shard ring changes. Keyboard
+// wizard state isn't moved, it expires within minutes anyway.
+struct ChatTransfer {
+	std::int64_t chatId = 0;
+	std::vector<std::int64_t> users;
+	bool withUsers = true; // false if `users` wasn't collected and the chat's registrations stay as they are
+	std::string zone; // empty for DEFAULT_TIME_ZONE
+	std::vector<ReminderInfo> reminders;
+};
+
+// A JSON header line followed by the reminders as PackedReminder records.
+inline std::string encodeChatTransfer(const ChatTransfer& t) {
+	nlohmann::json header = nlohmann::json::object();
+	header["chat_id"] = t.chatId;
+	if (t.withUsers) {
+		header["users"] = t.users;
+	}
+	header["zone"] = t.zone;
+	auto out = header.dump() + '\n';
+	for (const auto& ri : t.reminders) {
+		appendReminder(out, ri);
+	}
+
+	return out;
+}
+
+inline std::optional<ChatTransfer> decodeChatTransfer(const std::string& data) {
+	const auto eol = data.find('\n');
+	if (eol == std::string::npos) {
+		return {};
+	}
+	auto header = nlohmann::json::parse(data.substr(0, eol), nullptr, false);
+	if (header.is_discarded() || !header.is_object()) {
+		return {};
+	}
+
+	ChatTransfer t;
+	t.chatId = header.value("chat_id", std::int64_t(0));
+	t.users = header.value("users", std::vector<std::int64_t>{});
+	t.withUsers = header.contains("users");
+	t.zone = header.value("zone", std::string());
+	const char* pos = data.data() + eol + 1;
+	const char* end = data.data() + data.size();
+	while (pos != end) {
+		ReminderInfo ri;
+		if (!readReminder(pos, end, ri)) {
+			return {};
+		}
+		t.reminders.push_back(std::move(ri));
+	}
+
+	return t;
+}
+
+// Collecting the users scans every registration, changes that can't touch them skip it.
+inline ChatTransfer exportChat(up::db& db, ReminderStore& store, const ChatZones& zones, std::int64_t chatId,
+    bool withUsers = true) {
+	ChatTransfer t;
+	t.chatId = chatId;
+	t.withUsers = withUsers;
+	if (withUsers) {
+		for (const auto& uc : loadUserChats(db)) {
+			if (uc.chatId == chatId) {
+				t.users.push_back(uc.userId);
+			}
+		}
+	}
+	if (const auto& zone = zones.zone(chatId); &zone != &defaultTzTable()) {
+		t.zone = zone.name();
+	}
+	t.reminders = loadReminders(store, chatId);
+
+	return t;
+}
+
+// Replaces whatever the worker had for the chat, reminders keep their ids.
+inline void importChat(up::db& db, ReminderStore& store, ChatZones& zones, const ChatTransfer& t) {
+	if (t.withUsers) {
+		if (isChatRegistered(db, t.chatId)) {
+			unregisterChat(db, t.chatId);
+		}
+		for (auto userId : t.users) {
+			registerChat(db, userId, t.chatId);
+		}
+	}
+	if (t.zone.empty()) {
+		zones.erase(t.chatId);
+	} else {
+		zones.set(t.chatId, t.zone);
+	}
+	store.put(t.chatId, t.reminders);
+	store.commit();
+}
+
+inline void dropChat(up::db& db, ReminderStore& store, ChatZones& zones, std::int64_t chatId) {
+	unregisterChat(db, chatId);
+	zones.erase(chatId);
+	store.put(chatId, {});
+	store.commit();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "clock.hpp"
+#include "log.hpp"
+#include "tz_table.hpp"
+
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Per-chat time zone setting, stored in the "chat_zones" collection. Chats without a record use
+// DEFAULT_TIME_ZONE.
+class ChatZones {
+  public:
+	ChatZones(up::db& db, const Clock& clock = systemClock()): _db(db), _clock(clock) {
+		up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw(COLLECTION);
+
+		if (!value.is_array()) {
+			return;
+		}
+		value.foreach_array([&](int64_t, const up::value& v) {
+			try {
+				_zones.insert_or_assign(v.at("chat_id").get_int_or_throw(),
+				    Zone{&tzTable(v.at("zone").get_string_or_throw()), v.at("__id").get_int_or_throw()});
+			} catch (const std::exception& e) { logger().warn("zone_load_failed error={}", e.what()); }
+
+			return true;
+		});
+	}
+
+	const TzTable& zone(std::int64_t chatId) const {
+		std::shared_lock l(_m);
+		auto found = _zones.find(chatId);
+
+		return found == _zones.end() ? defaultTzTable() : *found->second.table;
+	}
+
+	// Throws if the zone name is unknown.
+	const TzTable& set(std::int64_t chatId, const std::string& name) {
+		const auto& table = tzTable(name);
+
+		std::scoped_lock l(_m);
+		auto found = _zones.find(chatId);
+		if (found != _zones.end()) {
+			up::vm_drop_record(_db).drop(COLLECTION, found->second.id);
+		}
+		auto id = up::vm_store_record(_db).store_or_throw(COLLECTION,
+		    up::value::object{{"chat_id", chatId}, {"zone", table.name()}});
+		commitOrThrow(_db);
+		_zones.insert_or_assign(chatId, Zone{&table, id});
+
+		return table;
+	}
+
+	// Back to DEFAULT_TIME_ZONE.
+	void erase(std::int64_t chatId) {
+		std::scoped_lock l(_m);
+		auto found = _zones.find(chatId);
+		if (found == _zones.end()) {
+			return;
+		}
+		up::vm_drop_record(_db).drop(COLLECTION, found->second.id);
+		commitOrThrow(_db);
+		_zones.erase(found);
+	}
+
+	time_point_s localNow(std::int64_t chatId) const { return zone(chatId).toLocal(_clock.now()); }
+
+	// Chat and zone name of a stored setting, as copied into another database by the compaction.
+	using Record = std::pair<std::int64_t, std::string>;
+
+	std::vector<Record> records() const {
+		std::shared_lock l(_m);
+		std::vector<Record> out;
+		for (const auto& [chatId, zone] : _zones) {
+			out.emplace_back(chatId, zone.table->name());
+		}
+		return out;
+	}
+
+	// Stores `records` in a fresh database, returns their ids there.
+	static std::vector<std::int64_t> copyTo(up::db& db, const std::vector<Record>& records) {
+		std::vector<std::int64_t> ids;
+		for (const auto& [chatId, name] : records) {
+			ids.push_back(up::vm_store_record(db).store_or_throw(COLLECTION,
+			    up::value::object{{"chat_id", chatId}, {"zone", name}}));
+		}
+		return ids;
+	}
+
+	// Switches to the copy made by copyTo(), which now stands in place of the old database. Settings changed
+	// since records() are written to it again.
+	void rebase(const std::vector<Record>& copied, const std::vector<std::int64_t>& ids) {
+		std::scoped_lock l(_m);
+		std::unordered_map<std::int64_t /*chatId*/, std::pair<std::int64_t /*id*/, std::string>> copies;
+		for (size_t i = 0; i != copied.size(); ++i) {
+			copies.insert_or_assign(copied[i].first, std::make_pair(ids[i], copied[i].second));
+		}
+		for (auto& [chatId, zone] : _zones) {
+			auto found = copies.find(chatId);
+			if (found != copies.end() && found->second.second == zone.table->name()) {
+				zone.id = found->second.first;
+				copies.erase(found);
+				continue;
+			}
+			if (found != copies.end()) {
+				up::vm_drop_record(_db).drop(COLLECTION, found->second.first);
+				copies.erase(found);
+			}
+			zone.id = up::vm_store_record(_db).store_or_throw(COLLECTION,
+			    up::value::object{{"chat_id", chatId}, {"zone", zone.table->name()}});
+		}
+		for (const auto& [chatId, copy] : copies) {
+			up::vm_drop_record(_db).drop(COLLECTION, copy.first);
+		}
+		commitOrThrow(_db);
+	}
+
+  private:
+	static constexpr const char* COLLECTION = "chat_zones";
+
+	struct Zone {
+		const TzTable* table;
+		std::int64_t id;
+	};
+
+	up::db& _db;
+	const Clock& _clock;
+
+	mutable std::shared_mutex _m;
+	std::unordered_map<std::int64_t /*chatId*/, Zone> _zones;
+};
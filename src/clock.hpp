@@ -0,0 +1,97 @@
+#pragma once
+
+#include "alarm.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Source of UTC time for the scheduler and storages. Waiting goes through the clock too, so a
+// virtual clock can jump straight to the deadline instead of sleeping.
+class Clock {
+  public:
+	virtual ~Clock() = default;
+
+	virtual time_point_s now() const = 0;
+	// Waits on `cond` until `deadline` or a notification.
+	virtual void waitUntil(std::unique_lock<std::mutex>& lk, std::condition_variable& cond, time_point_s deadline) = 0;
+	// Alarm for the scheduler, by default one that sleeps with waitUntil().
+	virtual std::unique_ptr<Alarm> makeAlarm();
+};
+
+// Alarm over a condition variable and Clock::waitUntil(). set() wakes the sleeper only if the deadline
+// moved earlier, a sleeper left with a later one wakes early and goes back to sleep.
+class CondAlarm: public Alarm {
+  public:
+	explicit CondAlarm(Clock& clock): _clock(clock) {}
+
+	void set(time_point_s deadline) override {
+		if (_deadline && deadline < *_deadline) {
+			_cond.notify_all();
+		}
+		_deadline = deadline;
+	}
+
+	void wake() override {
+		_woken = true;
+		_cond.notify_all();
+	}
+
+	Reason wait(std::unique_lock<std::mutex>& lk) override {
+		if (!_woken && _deadline) {
+			_clock.waitUntil(lk, _cond, *_deadline);
+		}
+		const bool woken = std::exchange(_woken, false);
+		return woken ? Reason::Woken : _deadline && _clock.now() >= *_deadline ? Reason::Deadline : Reason::Other;
+	}
+
+  private:
+	Clock& _clock;
+	std::condition_variable _cond;
+	bool _woken = false; // under the caller's lock
+};
+
+inline std::unique_ptr<Alarm> Clock::makeAlarm() { return std::make_unique<CondAlarm>(*this); }
+
+class SystemClock: public Clock {
+  public:
+	time_point_s now() const override { return nowUtc(); }
+
+	void waitUntil(std::unique_lock<std::mutex>& lk, std::condition_variable& cond, time_point_s deadline) override {
+		cond.wait_for(lk, deadline - now());
+	}
+
+#ifdef __linux__
+	std::unique_ptr<Alarm> makeAlarm() override { return std::make_unique<TimerFdAlarm>(); }
+#endif
+};
+
+class VirtualClock: public Clock {
+  public:
+	explicit VirtualClock(time_point_s start): _now(start.time_since_epoch().count()) {}
+
+	time_point_s now() const override { return time_point_s(std::chrono::seconds(_now.load())); }
+
+	void waitUntil(std::unique_lock<std::mutex>&, std::condition_variable&, time_point_s deadline) override {
+		if (deadline > now()) {
+			set(deadline);
+		}
+	}
+
+	void set(time_point_s tp) { _now = tp.time_since_epoch().count(); }
+	void advance(std::chrono::seconds d) { _now += d.count(); }
+
+  private:
+	std::atomic<std::int64_t> _now;
+};
+
+inline Clock& systemClock() {
+	static SystemClock clock;
+
+	return clock;
+}
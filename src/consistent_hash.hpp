@@ -0,0 +1,58 @@
+#pragma once
+
+#include "flat_hash_map.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+// Assigns chats to named workers. Every worker owns VNODES points of a 64-bit ring and a chat belongs to
+// the first point at or after its hash, so adding or removing a worker only moves the chats of the arcs
+// it gains or loses.
+class ConsistentHashRing {
+  public:
+	static constexpr int VNODES = 128;
+
+	void add(const std::string& worker) {
+		if (!_workers.insert(worker).second) {
+			return;
+		}
+		for (int i = 0; i != VNODES; ++i) {
+			_ring.emplace(point(worker, i), worker);
+		}
+	}
+
+	void remove(const std::string& worker) {
+		if (!_workers.erase(worker)) {
+			return;
+		}
+		for (int i = 0; i != VNODES; ++i) {
+			auto found = _ring.find(point(worker, i));
+			if (found != _ring.end() && found->second == worker) {
+				_ring.erase(found);
+			}
+		}
+	}
+
+	// Throws if the ring is empty.
+	const std::string& owner(std::int64_t chatId) const {
+		if (_ring.empty()) {
+			throw std::runtime_error("no workers");
+		}
+		auto found = _ring.lower_bound(FlatHash<std::int64_t>{}(chatId));
+		return found == _ring.end() ? _ring.begin()->second : found->second;
+	}
+
+	const std::set<std::string>& workers() const { return _workers; }
+
+  private:
+	static std::uint64_t point(const std::string& worker, int i) {
+		return FlatHash<std::uint64_t>{}(std::hash<std::string>{}(worker) + static_cast<std::uint64_t>(i));
+	}
+
+	std::map<std::uint64_t, std::string> _ring;
+	std::set<std::string> _workers;
+};
@@ -0,0 +1,354 @@
+#pragma once
+
+#include "chat_zones.hpp"
+#include "dynamic_storage.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "reminder_storage.hpp"
+#include "reminder_store.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Moves `from` over `path` and reopens `path` in the same object, so everything holding a reference to the
+// database moves to the new file. `db` stays open on the old file (kept as path.previous meanwhile) until the
+// new one has been opened and read. If the move or that read fails the old file is put back and false is
+// returned with `db` untouched.
+inline bool replaceDbFile(up::db& db, const std::string& from, const std::string& path) {
+	const auto previous = path + ".previous";
+	std::remove(previous.c_str());
+	if (::link(path.c_str(), previous.c_str()) != 0) {
+		return false;
+	}
+	if (std::rename(from.c_str(), path.c_str()) != 0) {
+		std::remove(previous.c_str());
+		return false;
+	}
+	try {
+		up::db probe(path);
+		loadUserChats(probe);
+	} catch (const std::exception& e) {
+		logger().error("db_replace_failed path={} error={}", path, e.what());
+		std::rename(previous.c_str(), path.c_str());
+		return false;
+	}
+
+	// Everything referencing `db` needs a database again before the lock is released, so a reopen that
+	// still fails (out of descriptors or memory) is retried, on the old file after the first failure.
+	db.~db();
+	bool replaced = true;
+	for (int attempt = 1;; ++attempt) {
+		try {
+			new (&db) up::db(path);
+			break;
+		} catch (const std::exception& e) {
+			logger().critical("db_reopen_failed path={} attempt={} error={}", path, attempt, e.what());
+			if (replaced) {
+				std::rename(previous.c_str(), path.c_str());
+				replaced = false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+	}
+	std::remove(previous.c_str());
+
+	return replaced;
+}
+
+// Online compaction and backups of db.bin and reminders.kv. UnQLite never gives back the space of dropped
+// records, and the wizard state in DynamicStorage is dropped and stored again on every click, as is a chat's
+// reminder value on every change, so the files only grow.
+//
+// Both build fresh files from the live state: the users, the chat zones and the dynamic storage cache (which
+// hold every live record of their collections) and the packed reminders of ReminderStore. The legacy reminder
+// documents are left out, the copy of the store is marked migrated, so a restored db.bin can't bring them
+// back. dbMutex is taken only to copy that state into memory, the reminders a batch of chats at a time, and
+// the files are written without it. The compaction then takes the lock once more to swap the files in and
+// re-store what changed meanwhile, so handlers wait at most for a memory copy or for the changes made during
+// one run.
+class DbMaintenance {
+  public:
+	struct Result {
+		std::uint64_t bytesBefore = 0;
+		std::uint64_t bytesAfter = 0;
+		size_t pauses = 0;
+		std::chrono::nanoseconds maxPause{};
+		std::chrono::nanoseconds elapsed{};
+	};
+
+	DbMaintenance(up::db& db, std::string path, ReminderStore& store, std::mutex& dbMutex, DynamicStorage& ds,
+	    ChatZones& zones):
+	    _db(db), _path(std::move(path)), _store(store), _dbMutex(dbMutex), _ds(ds), _zones(zones),
+	    _compactedSize(filesSize()) {
+		_fileBytes.set(static_cast<std::int64_t>(_compactedSize));
+	}
+
+	// Writes a copy of the database and the reminder store as of one moment to the directory `target`, under
+	// the names of the live files. Restoring is copying both back.
+	Result snapshot(const std::string& target) {
+		TRACE_SCOPE("DbMaintenance::snapshot", "storage");
+		const auto start = std::chrono::steady_clock::now();
+		Result result;
+		result.bytesBefore = filesSize();
+		const auto image = capture(result);
+		const auto tmp = target + ".tmp";
+		const auto dbFile = tmp + "/" + fileName(_path);
+		const auto storeFile = tmp + "/" + fileName(_store.path());
+		::mkdir(tmp.c_str(), 0755);
+		write(image, dbFile, storeFile);
+		if (std::rename(tmp.c_str(), target.c_str()) != 0) {
+			std::remove(dbFile.c_str());
+			std::remove(storeFile.c_str());
+			::rmdir(tmp.c_str());
+			throw std::runtime_error("Can't replace " + target);
+		}
+		result.bytesAfter =
+		    fileSize(target + "/" + fileName(_path)) + fileSize(target + "/" + fileName(_store.path()));
+		result.elapsed = std::chrono::steady_clock::now() - start;
+		logger().info("db_snapshot path={} bytes={} max_pause_us={}", target, result.bytesAfter,
+		    std::chrono::duration_cast<std::chrono::microseconds>(result.maxPause).count());
+		return result;
+	}
+
+	Result compact() {
+		TRACE_SCOPE("DbMaintenance::compact", "storage");
+		const auto start = std::chrono::steady_clock::now();
+		Result result;
+		result.bytesBefore = filesSize();
+		const auto image = capture(result);
+		const auto tmp = _path + ".compact";
+		const auto storeTmp = _store.path() + ".compact";
+		const auto ids = write(image, tmp, storeTmp);
+
+		paused(result, [&] {
+			commitOrThrow(_db);
+			_store.commit();
+			const auto users = loadUserChats(_db);
+			std::vector<ReminderStore::Packed> changed;
+			for (auto chatId : _store.takeChanged()) {
+				changed.push_back(_store.packed(chatId));
+			}
+			if (!replaceDbFile(_db, tmp, _path)) {
+				std::remove(tmp.c_str());
+				std::remove(storeTmp.c_str());
+				throw std::runtime_error("Can't replace " + _path);
+			}
+			syncUsers(image.users, users);
+			_zones.rebase(image.zones, ids.zones);
+			_ds.rebase(image.dynamic, ids.dynamic);
+			commitOrThrow(_db);
+			if (!_store.replaceFile(storeTmp)) {
+				std::remove(storeTmp.c_str());
+				throw std::runtime_error("Can't replace " + _store.path());
+			}
+			for (const auto& p : changed) {
+				_store.putPacked(p);
+			}
+			_store.commit();
+		});
+
+		_compactedSize = result.bytesAfter = filesSize();
+		result.elapsed = std::chrono::steady_clock::now() - start;
+		_fileBytes.set(static_cast<std::int64_t>(result.bytesAfter));
+		_compactions.inc();
+		logger().info("db_compacted bytes_before={} bytes_after={} pauses={} max_pause_us={} ms={}",
+		    result.bytesBefore, result.bytesAfter, result.pauses,
+		    std::chrono::duration_cast<std::chrono::microseconds>(result.maxPause).count(),
+		    std::chrono::duration_cast<std::chrono::milliseconds>(result.elapsed).count());
+		return result;
+	}
+
+	// Compacts once the files are twice the size the last compaction left, and at least MIN_COMPACT_SIZE.
+	std::optional<Result> compactIfGrown() {
+		const auto size = filesSize();
+		_fileBytes.set(static_cast<std::int64_t>(size));
+		if (size < std::max<std::uint64_t>(MIN_COMPACT_SIZE, 2 * _compactedSize)) {
+			return {};
+		}
+		return compact();
+	}
+
+	static std::uint64_t fileSize(const std::string& path) {
+		struct stat st {};
+		return ::stat(path.c_str(), &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : 0;
+	}
+
+  private:
+	static constexpr std::uint64_t MIN_COMPACT_SIZE = 1 << 20;
+	static constexpr size_t CHATS_PER_PAUSE = 64;
+
+	struct Image {
+		std::vector<UserChat> users;
+		std::vector<ChatZones::Record> zones;
+		std::vector<DynamicStorage::Record> dynamic;
+		std::vector<ReminderStore::Packed> reminders;
+	};
+
+	struct Ids {
+		std::vector<std::int64_t> zones;
+		std::vector<std::int64_t> dynamic;
+	};
+
+	template<class F>
+	void paused(Result& result, F&& f) {
+		std::scoped_lock l(_dbMutex);
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto pause = std::chrono::steady_clock::now() - start;
+		_pause.observe(pause);
+		result.maxPause = std::max<std::chrono::nanoseconds>(result.maxPause, pause);
+		++result.pauses;
+	}
+
+	// The reminders are copied a batch of chats at a time and the chats written meanwhile once more in the
+	// last pause, which copies the rest of the state, so the image is the state as of that pause. Documents
+	// not migrated yet are migrated first, the image leaves them out.
+	Image capture(Result& result) {
+		Image image;
+		std::vector<std::int64_t> chats;
+		paused(result, [&] {
+			migrateReminders(_db, _store);
+			_store.takeChanged();
+			chats = _store.chats();
+		});
+		for (size_t i = 0; i < chats.size(); i += CHATS_PER_PAUSE) {
+			paused(result, [&] {
+				for (size_t j = i; j != std::min(chats.size(), i + CHATS_PER_PAUSE); ++j) {
+					image.reminders.push_back(_store.packed(chats[j]));
+				}
+			});
+		}
+		paused(result, [&] {
+			image.users = loadUserChats(_db);
+			image.zones = _zones.records();
+			image.dynamic = _ds.records();
+			std::unordered_map<std::int64_t, size_t> copied;
+			for (size_t i = 0; i != image.reminders.size(); ++i) {
+				copied.emplace(image.reminders[i].chatId, i);
+			}
+			for (auto chatId : _store.takeChanged()) {
+				auto found = copied.find(chatId);
+				if (found != copied.end()) {
+					image.reminders[found->second] = _store.packed(chatId);
+				} else {
+					image.reminders.push_back(_store.packed(chatId));
+				}
+			}
+		});
+		return image;
+	}
+
+	Ids write(const Image& image, const std::string& path, const std::string& storePath) {
+		TRACE_SCOPE("DbMaintenance::write", "storage");
+		std::remove(path.c_str());
+		std::remove(storePath.c_str());
+		{
+			ReminderStore out(storePath);
+			for (const auto& p : image.reminders) {
+				out.putPacked(p);
+			}
+			out.setFormat(REMINDER_STORE_FORMAT);
+			out.commit();
+		}
+
+		Ids ids;
+		up::db out(path);
+		std::vector<std::int64_t> chats;
+		for (const auto& uc : image.users) {
+			chats.push_back(uc.chatId);
+			storeUser(out, uc);
+		}
+		std::sort(chats.begin(), chats.end());
+		chats.erase(std::unique(chats.begin(), chats.end()), chats.end());
+		for (auto chatId : chats) {
+			createCollection(out, collection(chatId));
+		}
+		ids.zones = ChatZones::copyTo(out, image.zones);
+		ids.dynamic = _ds.copyTo(out, image.dynamic);
+		commitOrThrow(out);
+		return ids;
+	}
+
+	// Brings the registrations of the swapped in copy from `copied` to `current`.
+	void syncUsers(std::vector<UserChat> copied, std::vector<UserChat> current) {
+		auto byChat = [](const UserChat& a, const UserChat& b) {
+			return std::make_pair(a.chatId, a.userId) < std::make_pair(b.chatId, b.userId);
+		};
+		auto sameChat = [](const UserChat& a, const UserChat& b) { return a.chatId == b.chatId; };
+		std::sort(copied.begin(), copied.end(), byChat);
+		std::sort(current.begin(), current.end(), byChat);
+		if (std::equal(copied.begin(), copied.end(), current.begin(), current.end(),
+		        [](const UserChat& a, const UserChat& b) { return a.chatId == b.chatId && a.userId == b.userId; })) {
+			return;
+		}
+		std::vector<UserChat> gone, added;
+		std::set_difference(copied.begin(), copied.end(), current.begin(), current.end(), std::back_inserter(gone),
+		    [](const UserChat& a, const UserChat& b) { return a.chatId < b.chatId; });
+		std::set_difference(current.begin(), current.end(), copied.begin(), copied.end(), std::back_inserter(added),
+		    [](const UserChat& a, const UserChat& b) { return a.chatId < b.chatId; });
+		gone.erase(std::unique(gone.begin(), gone.end(), sameChat), gone.end());
+		added.erase(std::unique(added.begin(), added.end(), sameChat), added.end());
+		for (const auto& uc : gone) {
+			dropCollection(_db, collection(uc.chatId));
+		}
+		for (const auto& uc : added) {
+			createCollection(_db, collection(uc.chatId));
+		}
+		dropCollection(_db, "users");
+		for (const auto& uc : current) {
+			storeUser(_db, uc);
+		}
+	}
+
+	static std::string collection(std::int64_t chatId) { return fmt::format("reminders_{}", chatId); }
+
+	static std::string fileName(const std::string& path) { return path.substr(path.rfind('/') + 1); }
+
+	std::uint64_t filesSize() const { return fileSize(_path) + fileSize(_store.path()); }
+
+	static void createCollection(up::db& db, const std::string& name) {
+		db.compile_or_throw("db_create($col);").bind_or_throw("col", name).exec_or_throw();
+	}
+
+	static void dropCollection(up::db& db, const std::string& name) {
+		db.compile_or_throw("db_drop_collection($col);").bind_or_throw("col", name).exec_or_throw();
+	}
+
+	static void storeUser(up::db& db, const UserChat& uc) {
+		up::vm_store_record(db).store_or_throw("users", up::value::object{{"id", uc.userId}, {"chat_id", uc.chatId}});
+	}
+
+  private:
+	up::db& _db;
+	const std::string _path;
+	ReminderStore& _store;
+	std::mutex& _dbMutex;
+	DynamicStorage& _ds;
+	ChatZones& _zones;
+	std::uint64_t _compactedSize;
+
+	Histogram& _pause = metrics().histogram("db_maintenance_pause_seconds",
+	    "Time db compaction and snapshots hold the database lock, per pause", latencyBuckets());
+	Gauge& _fileBytes = metrics().gauge("db_file_bytes", "Size of db.bin and reminders.kv");
+	Counter& _compactions = metrics().counter("db_compactions_total", "Compactions of db.bin and reminders.kv");
+};
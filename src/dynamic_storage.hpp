@@ -1,31 +1,56 @@
 #pragma once
 
+#include "clock.hpp"
+#include "flat_hash_map.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
 #include <unqlite_cpp/unqlite_cpp.hpp>
 
 #include <atomic>
 #include <chrono>
 #include <mutex>
 #include <optional>
-#include <unordered_map>
+#include <vector>
 
+// Short-lived per-message state (the reminder wizard) cached in memory over a database collection. Writes
+// only mark the entry dirty, flush() stores the latest state of each, so a burst of clicks on one message
+// costs a single record write.
 class DynamicStorage {
-	using Key = std::string;
+	using Key = ChatMsgKey;
 	using Data = up::value;
 
   public:
-	DynamicStorage(up::db& db, std::string collection): _db(db), _collection(std::move(collection)) {
+	DynamicStorage(up::db& db, std::string collection, const Clock& clock = systemClock()):
+	    _db(db), _collection(std::move(collection)), _clock(clock),
+	    _cacheSize(metrics().gauge("dynamic_storage_cache_size", "Entries in the dynamic storage cache",
+	        fmt::format("collection=\"{}\"", _collection))) {
 		auto recs = up::vm_fetch_all_records(db).fetch_or_throw(_collection).make_value();
 
 		recs.foreach_if_array([&](auto, const up::value& v) {
-			_cache.emplace(v.at("key").get_string(),
-			    Cache{std::chrono::steady_clock::time_point{std::chrono::seconds(v.at("dp").get_int())}, v.at("data"),
-			        v.at("__id").get_int()});
+			if (auto key = ChatMsgKey::parse(v.at("key").get_string())) {
+				_cache.emplace(*key, Cache{time_point_s{std::chrono::seconds(v.at("dp").get_int())}, v.at("data"),
+				                         v.at("__id").get_int()});
+			}
 			return true;
 		});
+		_cacheSize.set(_cache.size());
+	}
+
+	~DynamicStorage() {
+		try {
+			flush();
+		} catch (const std::exception& e) {
+			logger().error("dynamic_storage_flush_failed collection={} error={}", _collection, e.what());
+		}
 	}
 
-	std::optional<Data> find(const std::string& key) {
-		const auto now = std::chrono::steady_clock::now();
+	std::optional<Data> find(const Key& key) {
+		TRACE_SCOPE("DynamicStorage::find", "storage");
+		const auto now = _clock.now();
 		if (_nextVacuum < now) {
 			vacuum(now);
 			_nextVacuum = now + std::chrono::seconds(1000);
@@ -36,25 +61,98 @@ class DynamicStorage {
 
 	void removeCache(const Key& key) {
 		_cache.erase(key);
-		_db.remove_or_throw(key);
+		_cacheSize.set(_cache.size());
+		_db.remove_or_throw(key.toString());
 	}
 
 	void make(const Key& key, Data data, std::uint64_t timeout = 1000) {
-		const auto now = std::chrono::steady_clock::now();
-		if (_cache.count(key)) {
-			up::vm_drop_record(_db).drop(_collection, _cache[key].id);
+		TRACE_SCOPE("DynamicStorage::make", "storage");
+		const auto deadPoint = _clock.now() + std::chrono::seconds(timeout);
+		if (auto found = _cache.find(key); found != _cache.end()) {
+			if (found->second.dirty) {
+				_writesSaved.inc();
+			} else {
+				_dirty.push_back(key);
+			}
+			found->second.deadPoint = deadPoint;
+			found->second.data = std::move(data);
+			found->second.dirty = true;
+			++found->second.version;
+		} else {
+			_cache.emplace(key, Cache{deadPoint, std::move(data), -1, true});
+			_dirty.push_back(key);
 		}
-		up::value d;
-		d["key"] = key;
-		d["data"] = data;
-		d["dp"] =
-		    std::chrono::duration_cast<std::chrono::seconds>((now + std::chrono::seconds(timeout)).time_since_epoch())
-		        .count();
-		auto id = up::vm_store_record(_db).store_or_throw(_collection, d);
-		_cache.insert_or_assign(key, Cache{now + std::chrono::seconds(timeout), std::move(data), id});
+		_cacheSize.set(_cache.size());
 	}
 
-	void vacuum(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+	// Writes the latest state of every entry changed since the last flush.
+	void flush() {
+		TRACE_SCOPE("DynamicStorage::flush", "storage");
+		auto dirty = std::move(_dirty);
+		_dirty.clear();
+		for (const auto& key : dirty) {
+			auto found = _cache.find(key);
+			if (found == _cache.end() || !found->second.dirty) {
+				continue;
+			}
+			auto& entry = found->second;
+			if (entry.id >= 0) {
+				up::vm_drop_record(_db).drop(_collection, entry.id);
+			}
+			entry.id = up::vm_store_record(_db).store_or_throw(_collection, toValue(key, entry.data, entry.deadPoint));
+			entry.dirty = false;
+		}
+	}
+
+	// Live entry, as copied into another database by the compaction.
+	struct Record {
+		Key key;
+		Data data;
+		time_point_s deadPoint;
+		std::uint64_t version;
+	};
+
+	std::vector<Record> records() const {
+		std::vector<Record> out;
+		out.reserve(_cache.size());
+		for (const auto& [key, entry] : _cache) {
+			out.push_back({key, entry.data, entry.deadPoint, entry.version});
+		}
+		return out;
+	}
+
+	// Stores `records` in a fresh database, returns their ids there.
+	std::vector<std::int64_t> copyTo(up::db& db, const std::vector<Record>& records) const {
+		std::vector<std::int64_t> ids;
+		ids.reserve(records.size());
+		for (const auto& r : records) {
+			ids.push_back(up::vm_store_record(db).store_or_throw(_collection, toValue(r.key, r.data, r.deadPoint)));
+		}
+		return ids;
+	}
+
+	// Switches to the copy made by copyTo(), which now stands in place of the old database. Entries changed
+	// or made since records() are stored again by the next flush.
+	void rebase(const std::vector<Record>& copied, const std::vector<std::int64_t>& ids) {
+		FlatHashMap<Key, std::pair<std::int64_t, std::uint64_t>, ChatMsgKeyHash> copies;
+		copies.reserve(copied.size());
+		for (size_t i = 0; i != copied.size(); ++i) {
+			copies.insert_or_assign(copied[i].key, std::make_pair(ids[i], copied[i].version));
+		}
+		for (auto& [key, entry] : _cache) {
+			auto found = copies.find(key);
+			entry.id = found == copies.end() ? -1 : found->second.first;
+			if ((found == copies.end() || found->second.second != entry.version) && !entry.dirty) {
+				entry.dirty = true;
+				_dirty.push_back(key);
+			}
+		}
+	}
+
+	void vacuum() { vacuum(_clock.now()); }
+
+	void vacuum(time_point_s now) {
+		TRACE_SCOPE("DynamicStorage::vacuum", "storage");
 		for (auto cacheIt = _cache.begin(); cacheIt != _cache.end();) {
 			if (cacheIt->second.deadPoint < now) {
 				cacheIt = _cache.erase(cacheIt);
@@ -62,9 +160,18 @@ class DynamicStorage {
 				++cacheIt;
 			}
 		}
+		_cacheSize.set(_cache.size());
 	}
 
   private:
+	static up::value toValue(const Key& key, const Data& data, time_point_s deadPoint) {
+		up::value d;
+		d["key"] = key.toString();
+		d["data"] = data;
+		d["dp"] = deadPoint.time_since_epoch().count();
+		return d;
+	}
+
 	std::optional<Data> findImpl(const Key& key) {
 		auto found = _cache.find(key);
 		if (found == _cache.end()) {
@@ -77,13 +184,20 @@ class DynamicStorage {
   private:
 	up::db& _db;
 	const std::string _collection;
+	const Clock& _clock;
+	Gauge& _cacheSize;
 
-	std::chrono::steady_clock::time_point _nextVacuum{};
+	time_point_s _nextVacuum{};
 	struct Cache {
-		std::chrono::steady_clock::time_point deadPoint;
+		time_point_s deadPoint;
 		Data data;
-		int64_t id;
+		int64_t id; // -1 until the entry is first stored
+		bool dirty = false;
+		std::uint64_t version = 0; // bumped by make()
 	};
 
-	std::unordered_map<Key, Cache> _cache;
+	FlatHashMap<Key, Cache, ChatMsgKeyHash> _cache;
+	std::vector<Key> _dirty;
+	Counter& _writesSaved =
+	    metrics().counter("dynamic_storage_writes_saved_total", "State changes overwritten before they were stored");
 };
@@ -0,0 +1,345 @@
+#pragma once
+
+#include "flat_hash_map.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "raw_api.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <tgbot/Bot.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs the acknowledgements and edits of callback queries on a few worker threads, so the dispatch thread
+// only does the storage and keyboard work. A chat's calls always go to the same worker and keep their
+// order; acknowledgements are served before the edits queued on that worker.
+//
+// An edit waits `window` before it is sent and a later edit of the same message posted meanwhile takes
+// its place, so a burst of clicks on a keyboard ends in one edit with the latest state. An edit that
+// would leave the message as it was last sent is skipped, Telegram rejects those as "not modified".
+//
+// Bots hosted in one process share the workers, each posts as its own tenant: chat and message ids repeat
+// across bots, so they are only compared within a tenant.
+class EditWorkers {
+  public:
+	using Call = std::function<void()>;
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	explicit EditWorkers(size_t workers = 4, std::chrono::milliseconds window = std::chrono::milliseconds(150)):
+	    _window(window) {
+		for (size_t i = 0; i != workers; ++i) {
+			_workers.push_back(std::make_unique<Worker>());
+		}
+		for (auto& w : _workers) {
+			w->thread = std::thread([this, w = w.get()] { run(*w); });
+		}
+	}
+
+	~EditWorkers() { stop(); }
+
+	EditWorkers(const EditWorkers&) = delete;
+	EditWorkers& operator=(const EditWorkers&) = delete;
+
+	size_t addTenant() { return _tenants++; }
+
+	void acknowledge(size_t tenant, std::int64_t chatId, Call call, std::optional<TimePoint> clickedAt) {
+		auto& w = worker(tenant, chatId);
+		std::scoped_lock l(w.m);
+		auto& task = w.acks.emplace_back();
+		task.call = std::move(call);
+		task.tenant = tenant;
+		task.chatId = chatId;
+		task.clickedAt = clickedAt;
+		queued(tenant);
+		w.cond.notify_one();
+	}
+
+	void post(size_t tenant, std::int64_t chatId, Call call, std::optional<TimePoint> clickedAt) {
+		auto& w = worker(tenant, chatId);
+		std::scoped_lock l(w.m);
+		auto& task = w.edits.emplace_back();
+		task.call = std::move(call);
+		task.tenant = tenant;
+		task.chatId = chatId;
+		task.clickedAt = clickedAt;
+		task.due = std::chrono::steady_clock::now();
+		queued(tenant);
+		_depth.add(1);
+		w.cond.notify_one();
+	}
+
+	// `hash` identifies the state the edit leaves the message in.
+	void edit(size_t tenant, std::int64_t chatId, std::int32_t messageId, size_t hash, Call call,
+	    std::optional<TimePoint> clickedAt) {
+		const Key key{tenant, {chatId, messageId}};
+		auto& w = worker(tenant, chatId);
+		std::scoped_lock l(w.m);
+		if (auto found = w.pending.find(key); found != w.pending.end()) {
+			found->second->call = std::move(call);
+			found->second->hash = hash;
+			found->second->clickedAt = clickedAt;
+			_coalesced.inc();
+			return;
+		}
+		auto& task = w.edits.emplace_back();
+		task.call = std::move(call);
+		task.tenant = tenant;
+		task.chatId = chatId;
+		task.clickedAt = clickedAt;
+		task.due = std::chrono::steady_clock::now() + _window;
+		task.message = key;
+		task.hash = hash;
+		w.pending.emplace(key, &task);
+		queued(tenant);
+		_depth.add(1);
+		w.cond.notify_one();
+	}
+
+	// Drops the pending edit of the message, if any.
+	void cancel(size_t tenant, std::int64_t chatId, std::int32_t messageId) {
+		const Key key{tenant, {chatId, messageId}};
+		auto& w = worker(tenant, chatId);
+		std::scoped_lock l(w.m);
+		if (auto found = w.pending.find(key); found != w.pending.end()) {
+			found->second->call = nullptr;
+			w.pending.erase(found);
+			_coalesced.inc();
+		}
+	}
+
+	// Waits until the calls the tenant has queued so far are done, edits after their window.
+	void drain(size_t tenant) {
+		std::unique_lock lk(_inFlightMutex);
+		_drained.wait(lk, [&] { return _inFlight.find(tenant) == _inFlight.end(); });
+	}
+
+	// Finishes the queued calls, without waiting out the windows, and joins the workers.
+	void stop() {
+		for (auto& w : _workers) {
+			std::scoped_lock l(w->m);
+			w->stopped = true;
+			w->cond.notify_one();
+		}
+		for (auto& w : _workers) {
+			if (w->thread.joinable()) {
+				w->thread.join();
+			}
+		}
+	}
+
+	std::uint64_t coalesced() const { return _coalesced.value(); }
+	std::uint64_t unchanged() const { return _unchanged.value(); }
+
+  private:
+	static constexpr size_t MAX_SENT = 1 << 16;
+
+	struct Key {
+		size_t tenant;
+		ChatMsgKey message;
+
+		bool operator==(const Key& o) const { return tenant == o.tenant && message == o.message; }
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& k) const { return ChatMsgKeyHash{}(k.message) * 31 + k.tenant; }
+	};
+
+	struct Task {
+		Call call; // empty once cancelled
+		size_t tenant = 0;
+		std::int64_t chatId = 0;
+		std::optional<TimePoint> clickedAt;
+		TimePoint due{};
+		std::optional<Key> message; // set for coalescable edits
+		size_t hash = 0;
+	};
+
+	struct Worker {
+		std::mutex m;
+		std::condition_variable cond;
+		std::deque<Task> acks;
+		std::deque<Task> edits;                   // in post order, so by due time
+		FlatHashMap<Key, Task*, KeyHash> pending; // edits not taken by the worker yet
+		FlatHashMap<Key, size_t, KeyHash> sent;   // hash of the last edit sent per message
+		bool stopped = false;
+		std::thread thread;
+	};
+
+	Worker& worker(size_t tenant, std::int64_t chatId) {
+		return *_workers[(static_cast<std::uint64_t>(chatId) + tenant) % _workers.size()];
+	}
+
+	void queued(size_t tenant) {
+		std::scoped_lock l(_inFlightMutex);
+		++_inFlight[tenant];
+	}
+
+	void finished(size_t tenant) {
+		std::scoped_lock l(_inFlightMutex);
+		auto found = _inFlight.find(tenant);
+		if (--found->second == 0) {
+			_inFlight.erase(found);
+			_drained.notify_all();
+		}
+	}
+
+	void run(Worker& w) {
+		std::unique_lock lk(w.m);
+		while (true) {
+			w.cond.wait(lk, [&] { return w.stopped || !w.acks.empty() || !w.edits.empty(); });
+			if (w.acks.empty() && w.edits.empty()) {
+				return;
+			}
+			const bool ack = !w.acks.empty();
+			if (!ack && !w.stopped && w.edits.front().due > std::chrono::steady_clock::now()) {
+				w.cond.wait_until(lk, w.edits.front().due);
+				continue;
+			}
+			auto& queue = ack ? w.acks : w.edits;
+			auto task = std::move(queue.front());
+			queue.pop_front();
+			if (task.message) {
+				w.pending.erase(*task.message);
+				auto found = w.sent.find(*task.message);
+				if (task.call && found != w.sent.end() && found->second == task.hash) {
+					task.call = nullptr;
+					_unchanged.inc();
+				}
+			}
+			if (!ack) {
+				_depth.add(-1);
+			}
+			if (!task.call) {
+				finished(task.tenant);
+				continue;
+			}
+			lk.unlock();
+
+			bool ok = false;
+			try {
+				TRACE_SCOPE(ack ? "EditQueue::ack" : "EditQueue::edit", "api");
+				task.call();
+				ok = true;
+			} catch (const std::exception& e) {
+				_errors.inc();
+				logger().warn("edit_queue_failed kind={} chat={} message={} error={}", ack ? "ack" : "edit", task.chatId,
+				    task.message ? task.message->message.messageId : 0, e.what());
+			}
+			if (task.clickedAt) {
+				(ack ? _ackLatency : _editLatency).observe(std::chrono::steady_clock::now() - *task.clickedAt);
+			}
+
+			lk.lock();
+			if (ok && task.message) {
+				if (w.sent.size() >= MAX_SENT) {
+					w.sent.clear();
+				}
+				w.sent.insert_or_assign(*task.message, task.hash);
+			}
+			finished(task.tenant);
+		}
+	}
+
+  private:
+	const std::chrono::milliseconds _window;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::atomic<size_t> _tenants = 0;
+
+	std::mutex _inFlightMutex;
+	std::condition_variable _drained;
+	std::map<size_t, size_t> _inFlight; // tenant -> calls queued or running
+
+	Histogram& _ackLatency =
+	    metrics().histogram("callback_ack_seconds", "Callback arrival to its answerCallbackQuery", latencyBuckets());
+	Histogram& _editLatency =
+	    metrics().histogram("callback_edit_seconds", "Callback arrival to the edit it caused", latencyBuckets());
+	Gauge& _depth = metrics().gauge("edit_queue_depth", "Edits waiting for a worker");
+	Counter& _errors = metrics().counter("edit_queue_errors_total", "Failed acknowledgements and edits");
+	Counter& _coalesced =
+	    metrics().counter("edit_queue_coalesced_total", "Edits replaced by a later edit of the same message");
+	Counter& _unchanged =
+	    metrics().counter("edit_queue_unchanged_total", "Edits skipped as the message already looks like that");
+};
+
+// A bot's view of the edit workers: answers its callback queries and edits its messages through its API.
+// Owns its workers unless given the ones shared by the bots of the process.
+class EditQueue {
+  public:
+	using Call = EditWorkers::Call;
+	using TimePoint = EditWorkers::TimePoint;
+
+	explicit EditQueue(const RawApi& api, size_t workers = 4,
+	    std::chrono::milliseconds window = std::chrono::milliseconds(150)):
+	    _api(api), _own(std::make_unique<EditWorkers>(workers, window)), _workers(*_own),
+	    _tenant(_workers.addTenant()) {}
+
+	EditQueue(const RawApi& api, EditWorkers& shared): _api(api), _workers(shared), _tenant(shared.addTenant()) {}
+
+	~EditQueue() { stop(); }
+
+	EditQueue(const EditQueue&) = delete;
+	EditQueue& operator=(const EditQueue&) = delete;
+
+	// Queues the acknowledgement of a callback that has just arrived. Edits posted by its handler, which
+	// runs next on the same thread, count their latency from here.
+	void acknowledge(const TgBot::CallbackQuery::Ptr& query) {
+		_clickedAt = std::chrono::steady_clock::now();
+		std::int64_t chatId = 0;
+		if (query->message && query->message->chat) {
+			chatId = query->message->chat->id;
+		} else if (query->from) {
+			chatId = query->from->id;
+		}
+		_workers.acknowledge(_tenant, chatId, [this, id = query->id] { _api.answerCallbackQuery(id); }, _clickedAt);
+	}
+
+	void post(std::int64_t chatId, Call call) { _workers.post(_tenant, chatId, std::move(call), _clickedAt); }
+
+	void editMessageText(std::int64_t chatId, std::int32_t messageId, std::string text, std::string markup = {}) {
+		const auto hash = std::hash<std::string>{}(text) * 31 + std::hash<std::string>{}(markup);
+		_workers.edit(_tenant, chatId, messageId, hash,
+		    [this, chatId, messageId, text = std::move(text), markup = std::move(markup)] {
+			    _api.editMessageText(text, chatId, messageId, markup);
+		    },
+		    _clickedAt);
+	}
+
+	// A pending edit of the message is dropped, it would fail on the deleted message anyway.
+	void deleteMessage(std::int64_t chatId, std::int32_t messageId) {
+		_workers.cancel(_tenant, chatId, messageId);
+		post(chatId, [this, chatId, messageId] { _api.deleteMessage(chatId, messageId); });
+	}
+
+	// Finishes the queued calls. Own workers are joined without waiting out the windows, on shared ones
+	// only this bot's calls are waited for.
+	void stop() {
+		if (_own) {
+			_own->stop();
+		} else {
+			_workers.drain(_tenant);
+		}
+	}
+
+	std::uint64_t coalesced() const { return _workers.coalesced(); }
+	std::uint64_t unchanged() const { return _workers.unchanged(); }
+
+  private:
+	const RawApi& _api;
+	std::unique_ptr<EditWorkers> _own;
+	EditWorkers& _workers;
+	const size_t _tenant;
+	std::optional<TimePoint> _clickedAt; // dispatch thread only
+};
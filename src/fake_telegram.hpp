@@ -0,0 +1,190 @@
+#pragma once
+
+#include "http_server.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Local stand-in for api.telegram.org: serves getUpdates from a queue filled by the test and answers
+// the methods the bot calls with plausible results.
+class FakeTelegram {
+  public:
+	using Args = std::unordered_map<std::string, std::string>;
+
+	struct Listener {
+		// An update was handed to the bot by getUpdates.
+		std::function<void(const nlohmann::json& update)> onDelivered;
+		// The bot called `method`, `result` is what it gets back.
+		std::function<void(const std::string& method, const Args& args, const nlohmann::json& result)> onCall;
+	};
+
+	static constexpr std::int64_t BOT_ID = 1;
+
+	explicit FakeTelegram(Listener listener, unsigned short port = 0):
+	    _listener(std::move(listener)), _server("127.0.0.1", port, [this](const HttpRequest& r) { return handle(r); }) {}
+
+	~FakeTelegram() { stop(); }
+
+	unsigned short port() const { return _server.port(); }
+	std::string url() const { return "http://127.0.0.1:" + std::to_string(port()); }
+
+	void stop() {
+		{
+			std::scoped_lock l(_m);
+			_stopped = true;
+			_cond.notify_all();
+		}
+		_server.stop();
+	}
+
+	void pushUpdate(nlohmann::json update) {
+		std::scoped_lock l(_m);
+		update["update_id"] = _nextUpdateId++;
+		_updates.push_back(std::move(update));
+		_cond.notify_all();
+	}
+
+	void pushMessage(std::int64_t userId, std::int64_t chatId, const std::string& text) {
+		nlohmann::json msg = message(userId, chatId, nextMessageId(chatId), text);
+		if (!text.empty() && text.front() == '/') {
+			nlohmann::json entity = nlohmann::json::object();
+			entity["type"] = "bot_command";
+			entity["offset"] = 0;
+			entity["length"] = static_cast<std::int64_t>(text.find(' ') == std::string::npos ? text.size() : text.find(' '));
+			msg["entities"] = nlohmann::json::array();
+			msg["entities"].push_back(std::move(entity));
+		}
+		nlohmann::json update = nlohmann::json::object();
+		update["message"] = std::move(msg);
+		pushUpdate(std::move(update));
+	}
+
+	void pushCallback(std::int64_t userId, std::int64_t chatId, std::int32_t messageId, const std::string& messageText,
+	    const std::string& data) {
+		nlohmann::json query = nlohmann::json::object();
+		query["id"] = std::to_string(_nextQueryId++);
+		query["from"] = user(userId);
+		query["message"] = message(BOT_ID, chatId, messageId, messageText);
+		query["chat_instance"] = std::to_string(chatId);
+		query["data"] = data;
+
+		nlohmann::json update = nlohmann::json::object();
+		update["callback_query"] = std::move(query);
+		pushUpdate(std::move(update));
+	}
+
+	static nlohmann::json user(std::int64_t id) {
+		nlohmann::json u = nlohmann::json::object();
+		u["id"] = id;
+		u["is_bot"] = id == BOT_ID;
+		u["first_name"] = id == BOT_ID ? "bot" : "user" + std::to_string(id);
+
+		return u;
+	}
+
+	static nlohmann::json message(std::int64_t fromId, std::int64_t chatId, std::int32_t messageId,
+	    const std::string& text) {
+		nlohmann::json chat = nlohmann::json::object();
+		chat["id"] = chatId;
+		chat["type"] = chatId > 0 ? "private" : "group";
+
+		nlohmann::json msg = nlohmann::json::object();
+		msg["message_id"] = messageId;
+		msg["from"] = user(fromId);
+		msg["chat"] = std::move(chat);
+		msg["date"] = static_cast<std::int64_t>(
+		    std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+		        .count());
+		msg["text"] = text;
+
+		return msg;
+	}
+
+  private:
+	std::int32_t nextMessageId(std::int64_t chatId) {
+		std::scoped_lock l(_m);
+		return ++_messageIds[chatId];
+	}
+
+	HttpResponse handle(const HttpRequest& req) {
+		const auto path = req.path();
+		const auto method = path.substr(path.rfind('/') + 1);
+		const auto args = parseForm(req);
+
+		nlohmann::json result = true;
+		if (method == "getUpdates") {
+			result = getUpdates(args);
+		} else if (method == "sendMessage" || method == "sendDocument") {
+			const auto chatId = std::stoll(args.at("chat_id"));
+			result = message(BOT_ID, chatId, nextMessageId(chatId), args.count("text") ? args.at("text") : "");
+		} else if (method == "editMessageText") {
+			result = message(BOT_ID, std::stoll(args.at("chat_id")), std::stoi(args.at("message_id")), args.at("text"));
+		} else if (method == "getMe") {
+			result = user(BOT_ID);
+		}
+
+		if (method != "getUpdates" && _listener.onCall) {
+			_listener.onCall(method, args, result);
+		}
+
+		nlohmann::json resp = nlohmann::json::object();
+		resp["ok"] = true;
+		resp["result"] = std::move(result);
+
+		return HttpResponse{200, "application/json", resp.dump()};
+	}
+
+	nlohmann::json getUpdates(const Args& args) {
+		const std::int64_t offset = args.count("offset") ? std::stoll(args.at("offset")) : 0;
+		const size_t limit = args.count("limit") ? std::stoul(args.at("limit")) : 100;
+		const auto timeout = std::chrono::seconds(args.count("timeout") ? std::stoll(args.at("timeout")) : 0);
+
+		auto out = nlohmann::json::array();
+		std::vector<nlohmann::json> delivered;
+		{
+			std::unique_lock lk(_m);
+			while (!_updates.empty() && _updates.front()["update_id"].get<std::int64_t>() < offset) {
+				_updates.pop_front();
+			}
+			_cond.wait_for(lk, timeout, [&] { return _stopped || !_updates.empty(); });
+
+			for (size_t i = 0; i != _updates.size() && i != limit; ++i) {
+				out.push_back(_updates[i]);
+				if (_updates[i]["update_id"].get<std::int64_t>() >= _nextDelivered) {
+					delivered.push_back(_updates[i]);
+					_nextDelivered = _updates[i]["update_id"].get<std::int64_t>() + 1;
+				}
+			}
+		}
+		if (_listener.onDelivered) {
+			for (const auto& u : delivered) {
+				_listener.onDelivered(u);
+			}
+		}
+
+		return out;
+	}
+
+  private:
+	Listener _listener;
+
+	std::mutex _m;
+	std::condition_variable _cond;
+	bool _stopped = false;
+	std::deque<nlohmann::json> _updates;
+	std::int64_t _nextUpdateId = 1;
+	std::int64_t _nextDelivered = 1;
+	std::atomic<std::int64_t> _nextQueryId = 1;
+	std::unordered_map<std::int64_t /*chatId*/, std::int32_t> _messageIds;
+
+	HttpServer _server;
+};
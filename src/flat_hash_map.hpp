@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Hash of FlatHashMap keys. The low 7 bits of the hash are stored in the control bytes and the rest picks
+// the group, so integers are mixed first: std::hash of an integer is the integer itself.
+template<class K>
+struct FlatHash {
+	size_t operator()(const K& key) const {
+		std::uint64_t h;
+		if constexpr (std::is_integral_v<K>) {
+			h = static_cast<std::uint64_t>(key);
+		} else {
+			h = std::hash<K>{}(key);
+		}
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+
+		return static_cast<size_t>(h);
+	}
+};
+
+// Open addressing hash map with the slots in one array and a control byte per slot: EMPTY, DELETED or the
+// low 7 bits of the key's hash. Lookups compare a group of 16 control bytes at once (SSE2, or a plain
+// loop elsewhere) and touch a slot only on a control byte match.
+// Iterators and references are invalidated by inserting, erasing keeps them to other elements.
+template<class K, class V, class Hash = FlatHash<K>>
+class FlatHashMap {
+  public:
+	using key_type = K;
+	using mapped_type = V;
+	using value_type = std::pair<const K, V>;
+
+	template<bool Const>
+	class Iterator {
+	  public:
+		using Map = std::conditional_t<Const, const FlatHashMap, FlatHashMap>;
+		using Ref = std::conditional_t<Const, const value_type&, value_type&>;
+		using Ptr = std::conditional_t<Const, const value_type*, value_type*>;
+
+		Iterator(Map* map, size_t i): _map(map), _i(i) { skip(); }
+		operator Iterator<true>() const { return {_map, _i}; }
+
+		Ref operator*() const { return *_map->slot(_i); }
+		Ptr operator->() const { return _map->slot(_i); }
+		Iterator& operator++() {
+			++_i;
+			skip();
+			return *this;
+		}
+		bool operator==(const Iterator& other) const { return _i == other._i; }
+		bool operator!=(const Iterator& other) const { return _i != other._i; }
+
+	  private:
+		friend class FlatHashMap;
+
+		void skip() {
+			while (_i < _map->_capacity && _map->_ctrl[_i] < 0) {
+				++_i;
+			}
+		}
+
+		Map* _map;
+		size_t _i;
+	};
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	FlatHashMap() = default;
+	FlatHashMap(const FlatHashMap& other) {
+		reserve(other.size());
+		for (const auto& v : other) {
+			emplace(v.first, v.second);
+		}
+	}
+	FlatHashMap(FlatHashMap&& other) noexcept { swap(other); }
+	FlatHashMap& operator=(FlatHashMap other) noexcept {
+		swap(other);
+		return *this;
+	}
+	~FlatHashMap() { destroy(); }
+
+	void swap(FlatHashMap& other) noexcept {
+		std::swap(_ctrl, other._ctrl);
+		std::swap(_slots, other._slots);
+		std::swap(_capacity, other._capacity);
+		std::swap(_size, other._size);
+		std::swap(_growthLeft, other._growthLeft);
+	}
+
+	iterator begin() { return {this, 0}; }
+	iterator end() { return {this, _capacity}; }
+	const_iterator begin() const { return {this, 0}; }
+	const_iterator end() const { return {this, _capacity}; }
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	iterator find(const K& key) { return {this, findIndex(key)}; }
+	const_iterator find(const K& key) const { return {this, findIndex(key)}; }
+	size_t count(const K& key) const { return findIndex(key) != _capacity; }
+
+	template<class... Args>
+	std::pair<iterator, bool> emplace(const K& key, Args&&... args) {
+		auto [i, inserted] = findOrPrepare(key);
+		if (inserted) {
+			try {
+				new (slot(i)) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+				    std::forward_as_tuple(std::forward<Args>(args)...));
+			} catch (...) {
+				release(i);
+				throw;
+			}
+		}
+		return {{this, i}, inserted};
+	}
+
+	template<class M>
+	std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+		auto [it, inserted] = emplace(key, std::forward<M>(value));
+		if (!inserted) {
+			it->second = std::forward<M>(value);
+		}
+		return {it, inserted};
+	}
+
+	V& operator[](const K& key) { return emplace(key).first->second; }
+
+	size_t erase(const K& key) {
+		auto i = findIndex(key);
+		if (i == _capacity) {
+			return 0;
+		}
+		eraseIndex(i);
+		return 1;
+	}
+
+	// Returns the iterator following `it`.
+	iterator erase(const_iterator it) {
+		eraseIndex(it._i);
+		return {this, it._i + 1};
+	}
+
+	void clear() {
+		destroy();
+		_ctrl = nullptr;
+		_slots = nullptr;
+		_capacity = _size = _growthLeft = 0;
+	}
+
+	void reserve(size_t n) {
+		size_t capacity = GROUP;
+		while (capacity * 7 / 8 < n) {
+			capacity *= 2;
+		}
+		if (capacity > _capacity) {
+			rehash(capacity);
+		}
+	}
+
+  private:
+	static constexpr size_t GROUP = 16;
+	static constexpr std::int8_t EMPTY = -128;
+	static constexpr std::int8_t DELETED = -2;
+
+	static std::uint32_t matchByte(const std::int8_t* group, std::int8_t b) {
+#ifdef __SSE2__
+		auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b))));
+#else
+		std::uint32_t mask = 0;
+		for (size_t i = 0; i != GROUP; ++i) {
+			mask |= std::uint32_t(group[i] == b) << i;
+		}
+		return mask;
+#endif
+	}
+
+	// Slots which are EMPTY or DELETED.
+	static std::uint32_t matchFree(const std::int8_t* group) {
+#ifdef __SSE2__
+		auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl));
+#else
+		std::uint32_t mask = 0;
+		for (size_t i = 0; i != GROUP; ++i) {
+			mask |= std::uint32_t(group[i] < 0) << i;
+		}
+		return mask;
+#endif
+	}
+
+	value_type* slot(size_t i) const { return std::launder(reinterpret_cast<value_type*>(_slots) + i); }
+
+	// Groups are probed quadratically, starting from the one picked by the high bits of the hash. The
+	// probe of a key ends at the first group with an EMPTY slot.
+	template<class F>
+	size_t probe(size_t hash, F&& f) const {
+		const size_t groups = _capacity / GROUP;
+		size_t g = (hash >> 7) & (groups - 1);
+		for (size_t step = 1;; ++step) {
+			if (size_t found = f(g * GROUP); found != SIZE_MAX) {
+				return found;
+			}
+			g = (g + step) & (groups - 1);
+		}
+	}
+
+	size_t findIndex(const K& key) const {
+		if (!_size) {
+			return _capacity;
+		}
+		const size_t hash = Hash{}(key);
+		const auto h2 = static_cast<std::int8_t>(hash & 0x7f);
+		return probe(hash, [&](size_t base) -> size_t {
+			for (auto m = matchByte(_ctrl + base, h2); m; m &= m - 1) {
+				const size_t i = base + __builtin_ctz(m);
+				if (slot(i)->first == key) {
+					return i;
+				}
+			}
+			return matchByte(_ctrl + base, EMPTY) ? _capacity : SIZE_MAX;
+		});
+	}
+
+	// Index of the key's slot and false, or of a free slot marked as taken by the key and true.
+	std::pair<size_t, bool> findOrPrepare(const K& key) {
+		if (auto i = findIndex(key); i != _capacity) {
+			return {i, false};
+		}
+		if (_growthLeft == 0) {
+			rehash(_size + 1 > _capacity * 7 / 16 ? std::max(_capacity * 2, GROUP) : _capacity);
+		}
+		const size_t hash = Hash{}(key);
+		const size_t i = probe(hash, [&](size_t base) -> size_t {
+			auto m = matchFree(_ctrl + base);
+			return m ? base + __builtin_ctz(m) : SIZE_MAX;
+		});
+		if (_ctrl[i] == EMPTY) {
+			--_growthLeft;
+		}
+		_ctrl[i] = static_cast<std::int8_t>(hash & 0x7f);
+		++_size;
+		return {i, true};
+	}
+
+	void eraseIndex(size_t i) {
+		slot(i)->~value_type();
+		release(i);
+	}
+
+	// Frees a slot whose value is already destroyed (or was never constructed).
+	void release(size_t i) {
+		--_size;
+		// A probe could have passed this group only if it had no EMPTY slot, then the slot has to stay
+		// a tombstone.
+		const size_t base = i / GROUP * GROUP;
+		if (matchByte(_ctrl + base, EMPTY)) {
+			_ctrl[i] = EMPTY;
+			++_growthLeft;
+		} else {
+			_ctrl[i] = DELETED;
+		}
+	}
+
+	void rehash(size_t capacity) {
+		FlatHashMap next;
+		next._capacity = capacity;
+		next._ctrl = new std::int8_t[capacity];
+		std::memset(next._ctrl, EMPTY, capacity);
+		next._slots = std::allocator<Storage>().allocate(capacity);
+		next._growthLeft = capacity * 7 / 8;
+		for (size_t i = 0; i != _capacity; ++i) {
+			if (_ctrl[i] >= 0) {
+				auto* v = slot(i);
+				auto [j, inserted] = next.findOrPrepare(v->first);
+				new (next.slot(j)) value_type(std::move(*v));
+			}
+		}
+		swap(next);
+	}
+
+	void destroy() {
+		if (!_ctrl) {
+			return;
+		}
+		if constexpr (!std::is_trivially_destructible_v<value_type>) {
+			for (size_t i = 0; i != _capacity; ++i) {
+				if (_ctrl[i] >= 0) {
+					slot(i)->~value_type();
+				}
+			}
+		}
+		delete[] _ctrl;
+		std::allocator<Storage>().deallocate(_slots, _capacity);
+	}
+
+	using Storage = std::aligned_storage_t<sizeof(value_type), alignof(value_type)>;
+
+	std::int8_t* _ctrl = nullptr;
+	Storage* _slots = nullptr;
+	size_t _capacity = 0; // a power of two, at least GROUP
+	size_t _size = 0;
+	size_t _growthLeft = 0; // EMPTY slots that can be taken before the load factor passes 7/8
+};
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct HttpRequest {
+	std::string method;
+	std::string target;
+	std::unordered_map<std::string, std::string> headers; // lowercase names
+	std::string body;
+
+	std::string path() const { return target.substr(0, target.find('?')); }
+};
+
+struct HttpResponse {
+	int status = 200;
+	std::string contentType = "application/json";
+	std::string body;
+};
+
+// Minimal blocking HTTP/1.1 server with a thread per connection, good enough for local tooling
+// (fake Bot API, metrics). Not meant to face the internet.
+class HttpServer {
+  public:
+	using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+	// Port 0 picks a free port, see port().
+	HttpServer(const std::string& address, unsigned short port, Handler handler):
+	    _handler(std::move(handler)),
+	    _acceptor(_io, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(address), port)) {
+		_running = true;
+		_acceptThread = std::thread([this] { acceptLoop(); });
+	}
+
+	~HttpServer() { stop(); }
+
+	unsigned short port() const { return _acceptor.local_endpoint().port(); }
+
+	void stop() {
+		if (!_running.exchange(false)) {
+			return;
+		}
+		// Closing the acceptor doesn't wake a blocking accept(), a connection does.
+		boost::system::error_code ec;
+		boost::asio::ip::tcp::socket wake(_io);
+		wake.connect(_acceptor.local_endpoint(), ec);
+		if (_acceptThread.joinable()) {
+			_acceptThread.join();
+		}
+		_acceptor.close(ec);
+
+		std::list<Session> sessions;
+		{
+			std::scoped_lock l(_m);
+			for (auto& s : _sessions) {
+				s.socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+			}
+			sessions.swap(_sessions);
+		}
+		for (auto& s : sessions) {
+			s.thread.join();
+		}
+	}
+
+  private:
+	void acceptLoop() {
+		while (_running) {
+			boost::asio::ip::tcp::socket socket(_io);
+			boost::system::error_code ec;
+			_acceptor.accept(socket, ec);
+			if (ec && _running) {
+				// Out of descriptors (EMFILE) the error repeats until a connection closes.
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+			if (ec || !_running) {
+				continue;
+			}
+			socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+			std::scoped_lock l(_m);
+			reapSessions();
+			auto& session = _sessions.emplace_back(std::move(socket));
+			session.thread = std::thread([this, &session] {
+				serve(session.socket);
+				session.done = true;
+			});
+		}
+	}
+
+	// Joins the threads of closed connections, so a server scraped every few seconds doesn't keep one
+	// thread per scrape. Called under _m.
+	void reapSessions() {
+		for (auto it = _sessions.begin(); it != _sessions.end();) {
+			if (it->done) {
+				it->thread.join();
+				it = _sessions.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void serve(boost::asio::ip::tcp::socket& socket) {
+		boost::asio::streambuf buf;
+		boost::system::error_code ec;
+
+		while (_running) {
+			auto headerSize = boost::asio::read_until(socket, buf, "\r\n\r\n", ec);
+			if (ec) {
+				break;
+			}
+
+			HttpRequest req;
+			{
+				std::string head(boost::asio::buffers_begin(buf.data()),
+				    boost::asio::buffers_begin(buf.data()) + headerSize);
+				buf.consume(headerSize);
+
+				std::istringstream in(head);
+				std::string line;
+				std::getline(in, line);
+				std::istringstream first(line);
+				first >> req.method >> req.target;
+				while (std::getline(in, line) && line != "\r") {
+					auto colon = line.find(':');
+					if (colon == std::string::npos) {
+						continue;
+					}
+					auto name = boost::algorithm::to_lower_copy(line.substr(0, colon));
+					req.headers[name] = boost::algorithm::trim_copy(line.substr(colon + 1));
+				}
+			}
+
+			if (req.headers["expect"] == "100-continue") {
+				boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 100 Continue\r\n\r\n")), ec);
+			}
+
+			size_t contentLength = 0;
+			if (auto found = req.headers.find("content-length"); found != req.headers.end()) {
+				const auto& value = found->second;
+				const auto [end, err] = std::from_chars(value.data(), value.data() + value.size(), contentLength);
+				if (err != std::errc() || end != value.data() + value.size() || contentLength > MAX_BODY_SIZE) {
+					writeResponse(socket, {400, "text/plain", "Bad Content-Length"}, true, ec);
+					break;
+				}
+			}
+			if (buf.size() < contentLength) {
+				boost::asio::read(socket, buf, boost::asio::transfer_exactly(contentLength - buf.size()), ec);
+				if (ec) {
+					break;
+				}
+			}
+			req.body.assign(boost::asio::buffers_begin(buf.data()),
+			    boost::asio::buffers_begin(buf.data()) + contentLength);
+			buf.consume(contentLength);
+
+			HttpResponse resp;
+			try {
+				resp = _handler(req);
+			} catch (const std::exception& e) {
+				resp.status = 500;
+				resp.contentType = "text/plain";
+				resp.body = e.what();
+			}
+
+			const bool close = boost::algorithm::to_lower_copy(req.headers["connection"]) == "close";
+			writeResponse(socket, resp, close, ec);
+			if (ec || close) {
+				break;
+			}
+		}
+		socket.close(ec);
+	}
+
+	static void writeResponse(boost::asio::ip::tcp::socket& socket, const HttpResponse& resp, bool close,
+	    boost::system::error_code& ec) {
+		std::string out = "HTTP/1.1 " + std::to_string(resp.status) + (resp.status < 400 ? " OK" : " Error") +
+		                  "\r\nContent-Type: " + resp.contentType +
+		                  "\r\nContent-Length: " + std::to_string(resp.body.size()) +
+		                  (close ? "\r\nConnection: close" : "") + "\r\n\r\n" + resp.body;
+		boost::asio::write(socket, boost::asio::buffer(out), ec);
+	}
+
+  private:
+	struct Session {
+		explicit Session(boost::asio::ip::tcp::socket s): socket(std::move(s)) {}
+
+		boost::asio::ip::tcp::socket socket;
+		std::thread thread;
+		std::atomic_bool done = false;
+	};
+
+	static constexpr size_t MAX_BODY_SIZE = 64 << 20;
+
+	Handler _handler;
+	std::atomic_bool _running = false;
+
+	boost::asio::io_context _io;
+	boost::asio::ip::tcp::acceptor _acceptor;
+	std::thread _acceptThread;
+
+	std::mutex _m;
+	std::list<Session> _sessions;
+};
+
+inline std::string urlDecode(const std::string& s) {
+	std::string out;
+	out.reserve(s.size());
+	for (size_t i = 0; i < s.size(); ++i) {
+		if (s[i] == '+') {
+			out += ' ';
+		} else if (s[i] == '%' && i + 2 < s.size()) {
+			out += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+			i += 2;
+		} else {
+			out += s[i];
+		}
+	}
+
+	return out;
+}
+
+// Arguments of a request: query string plus an urlencoded or multipart/form-data body. File parts also
+// get their file name in `fileNames`.
+inline std::unordered_map<std::string, std::string> parseForm(const HttpRequest& req,
+    std::unordered_map<std::string, std::string>* fileNames = nullptr) {
+	std::unordered_map<std::string, std::string> args;
+
+	auto parseUrlEncoded = [&](const std::string& s) {
+		size_t pos = 0;
+		while (pos < s.size()) {
+			auto amp = s.find('&', pos);
+			auto pair = s.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+			auto eq = pair.find('=');
+			if (eq != std::string::npos) {
+				args[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+			}
+			if (amp == std::string::npos) {
+				break;
+			}
+			pos = amp + 1;
+		}
+	};
+
+	if (auto q = req.target.find('?'); q != std::string::npos) {
+		parseUrlEncoded(req.target.substr(q + 1));
+	}
+
+	auto ct = req.headers.find("content-type");
+	if (ct == req.headers.end()) {
+		return args;
+	}
+	if (ct->second.find("application/x-www-form-urlencoded") != std::string::npos) {
+		parseUrlEncoded(req.body);
+	} else if (auto b = ct->second.find("boundary="); b != std::string::npos) {
+		auto boundary = ct->second.substr(b + 9);
+		if (!boundary.empty() && boundary.front() == '"') {
+			boundary = boundary.substr(1, boundary.find('"', 1) - 1);
+		}
+		const auto delim = "--" + boundary;
+
+		size_t pos = req.body.find(delim);
+		while (pos != std::string::npos) {
+			pos += delim.size();
+			if (req.body.compare(pos, 2, "--") == 0) {
+				break;
+			}
+			auto headEnd = req.body.find("\r\n\r\n", pos);
+			auto next = req.body.find("\r\n" + delim, headEnd);
+			if (headEnd == std::string::npos || next == std::string::npos) {
+				break;
+			}
+			auto head = req.body.substr(pos, headEnd - pos);
+			auto n = head.find("name=\"");
+			if (n != std::string::npos) {
+				auto name = head.substr(n + 6, head.find('"', n + 6) - n - 6);
+				args[name] = req.body.substr(headEnd + 4, next - headEnd - 4);
+				if (auto f = head.find("filename=\""); fileNames && f != std::string::npos) {
+					(*fileNames)[name] = head.substr(f + 10, head.find('"', f + 10) - f - 10);
+				}
+			}
+			pos = next + 2;
+		}
+	}
+
+	return args;
+}
+
+// Handlers picked by the longest path prefix, for a server whose routes come and go while it runs (the
+// routes of each bot hosted in the process). remove() waits for the handlers already running.
+class HttpRoutes {
+  public:
+	explicit HttpRoutes(HttpServer::Handler fallback): _fallback(std::move(fallback)) {}
+
+	void add(const std::string& prefix, HttpServer::Handler handler) {
+		std::unique_lock l(_m);
+		_routes[prefix] = std::move(handler);
+	}
+
+	void remove(const std::string& prefix) {
+		std::unique_lock l(_m);
+		_routes.erase(prefix);
+	}
+
+	HttpResponse operator()(const HttpRequest& req) const {
+		const auto path = req.path();
+		std::shared_lock l(_m);
+		const HttpServer::Handler* handler = &_fallback;
+		size_t matched = 0;
+		for (const auto& [prefix, h] : _routes) {
+			if (prefix.size() >= matched && path.compare(0, prefix.size(), prefix) == 0) {
+				handler = &h;
+				matched = prefix.size();
+			}
+		}
+		return (*handler)(req);
+	}
+
+	// Routes added through it are removed when it goes out of scope, declared after what they use.
+	class Scoped {
+	  public:
+		explicit Scoped(HttpRoutes& routes): _routes(routes) {}
+		~Scoped() {
+			for (const auto& prefix : _prefixes) {
+				_routes.remove(prefix);
+			}
+		}
+
+		Scoped(const Scoped&) = delete;
+		Scoped& operator=(const Scoped&) = delete;
+
+		void add(const std::string& prefix, HttpServer::Handler handler) {
+			_routes.add(prefix, std::move(handler));
+			_prefixes.push_back(prefix);
+		}
+
+	  private:
+		HttpRoutes& _routes;
+		std::vector<std::string> _prefixes;
+	};
+
+  private:
+	HttpServer::Handler _fallback;
+	mutable std::shared_mutex _m;
+	std::map<std::string, HttpServer::Handler> _routes;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "flat_hash_map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Remembers keys seen within the last `window` and tells repeats apart from first sightings in O(1).
+// Two Bloom filters, each covering one window, answer most first sightings without touching the exact
+// set; a possible hit is confirmed against the exact set of 64-bit key hashes, so a Bloom false positive
+// never drops anything. Keys older than the window are forgotten. Not synchronized.
+class IdempotencyFilter {
+  public:
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	// `expected` is the number of keys one window usually holds, it sizes the Bloom filters for about
+	// 1% false positives.
+	IdempotencyFilter(std::chrono::milliseconds window, size_t expected):
+	    _window(window), _bits(std::max<size_t>(64, expected * 10 / 64 * 64)), _current(_bits / 64),
+	    _previous(_bits / 64) {}
+
+	// True if the key wasn't seen within the window, it is remembered either way.
+	bool accept(std::uint64_t key, TimePoint now = std::chrono::steady_clock::now()) {
+		expire(now);
+		const auto h = mix(key);
+		if (maybeSeen(h)) {
+			auto found = _exact.find(h);
+			if (found != _exact.end() && now - found->second < _window) {
+				return false;
+			}
+		}
+		set(_current, h);
+		_exact.insert_or_assign(h, now);
+		_order.emplace_back(now, h);
+		return true;
+	}
+
+	bool accept(std::string_view key, TimePoint now = std::chrono::steady_clock::now()) {
+		return accept(static_cast<std::uint64_t>(std::hash<std::string_view>{}(key)), now);
+	}
+
+	size_t size() const { return _exact.size(); }
+
+  private:
+	static constexpr int HASHES = 7;
+
+	static std::uint64_t mix(std::uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Probes h1 + i * h2 (Kirsch-Mitzenmacher) over both generations.
+	template<class F>
+	void probe(std::uint64_t h, F&& f) const {
+		const std::uint64_t h1 = h, h2 = (h >> 32) | 1;
+		for (int i = 0; i != HASHES; ++i) {
+			f((h1 + i * h2) % _bits);
+		}
+	}
+
+	bool maybeSeen(std::uint64_t h) const {
+		bool current = true, previous = true;
+		probe(h, [&](std::uint64_t bit) {
+			current = current && (_current[bit / 64] >> (bit % 64) & 1);
+			previous = previous && (_previous[bit / 64] >> (bit % 64) & 1);
+		});
+		return current || previous;
+	}
+
+	void set(std::vector<std::uint64_t>& filter, std::uint64_t h) {
+		probe(h, [&](std::uint64_t bit) { filter[bit / 64] |= std::uint64_t(1) << (bit % 64); });
+	}
+
+	// A key lives in the generation it was added to and the next one, so a rotation per window keeps
+	// everything younger than the window.
+	void expire(TimePoint now) {
+		if (now - _rotatedAt >= _window) {
+			_previous.swap(_current);
+			std::fill(_current.begin(), _current.end(), 0);
+			_rotatedAt = now;
+		}
+		while (!_order.empty() && now - _order.front().first >= _window) {
+			auto found = _exact.find(_order.front().second);
+			if (found != _exact.end() && found->second == _order.front().first) {
+				_exact.erase(found);
+			}
+			_order.pop_front();
+		}
+	}
+
+  private:
+	const std::chrono::milliseconds _window;
+	const size_t _bits;
+	std::vector<std::uint64_t> _current;
+	std::vector<std::uint64_t> _previous;
+	TimePoint _rotatedAt{};
+
+	FlatHashMap<std::uint64_t, TimePoint> _exact; // key hash -> last seen
+	std::deque<std::pair<TimePoint, std::uint64_t>> _order;
+};
@@ -0,0 +1,76 @@
+#include "chat_zones.hpp"
+#include "reminder_io.hpp"
+#include "reminder_storage.hpp"
+#include "scheduler_snapshot.hpp"
+#include "scheduler_wal.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Offline import/export for a stopped bot, run in the bot's working directory:
+//   TgReminderBotImport import <chatId> <file.csv|file.ics>
+//   TgReminderBotImport export <chatId> <file.csv|file.ics>
+// Chats live in db.bin, their reminders in reminders.kv.
+// Imported timers are appended to the scheduler journal, so the next start picks them up without a
+// full rescan.
+int main(int argc, char** argv) {
+	if (argc != 4) {
+		std::cerr << "usage: " << argv[0] << " import|export <chatId> <file.csv|file.ics>" << std::endl;
+		return 2;
+	}
+	const std::string command = argv[1];
+	const std::int64_t chatId = std::atoll(argv[2]);
+	const std::string path = argv[3];
+
+	auto format = reminderFormat(path);
+	if (!format || (command != "import" && command != "export")) {
+		std::cerr << "usage: " << argv[0] << " import|export <chatId> <file.csv|file.ics>" << std::endl;
+		return 2;
+	}
+
+	up::db db("db.bin");
+	if (!isChatRegistered(db, chatId)) {
+		std::cerr << fmt::format("chat {} is not registered", chatId) << std::endl;
+		return 1;
+	}
+	ReminderStore store("reminders.kv");
+	migrateReminders(db, store);
+
+	if (command == "export") {
+		std::ofstream out(path, std::ios::binary);
+		auto count = exportReminders(store, chatId, out, *format);
+		std::cout << fmt::format("exported {} reminders to {}", count, path) << std::endl;
+		return out ? 0 : 1;
+	}
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		std::cerr << "can't open " << path << std::endl;
+		return 1;
+	}
+	ChatZones zones(db);
+	auto result = importReminders(store, chatId, in, *format, zones.zone(chatId), nowUtc());
+	for (const auto& e : result.stats.errors) {
+		std::cerr << e << std::endl;
+	}
+
+	if (auto recovered = recoverScheduler("scheduler.snap", "scheduler.wal")) {
+		SchedulerWal wal("scheduler.wal", recovered->lsn);
+		for (const auto& t : result.timers) {
+			wal.add(t.chatId, t.tp, t.reminder);
+		}
+		wal.sync();
+	}
+
+	std::cout << fmt::format("imported {} reminders ({} failed) into chat {}", result.stats.imported,
+	                 result.stats.failed, chatId)
+	          << std::endl;
+	return result.stats.failed ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "metrics.hpp"
+#include "trace.hpp"
+
+#include <nlohmann/json.hpp>
+#include <tgbot/Bot.h>
+#include <tgbot/net/CurlHttpClient.h>
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Decorates the Bot API transport with per-method latency and outcome metrics. Series for the
+// known methods are registered up front so a call only touches atomics.
+class InstrumentedHttpClient: public TgBot::HttpClient {
+  public:
+	explicit InstrumentedHttpClient(const TgBot::HttpClient& client): _client(client) {
+		for (const auto* m : METHODS) {
+			_methods.emplace(m, MethodMetrics(m));
+		}
+	}
+
+	std::string makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>& args) const override {
+		auto found = _methods.find(url.path.substr(url.path.rfind('/') + 1));
+		const auto& m = found != _methods.end() ? found->second : _methods.at("other");
+
+		TRACE_SCOPE(m.name, "api");
+		const auto start = std::chrono::steady_clock::now();
+		std::string resp;
+		try {
+			resp = _client.makeRequest(url, args);
+		} catch (...) {
+			m.latency.observe(std::chrono::steady_clock::now() - start);
+			m.network.inc();
+			throw;
+		}
+		m.latency.observe(std::chrono::steady_clock::now() - start);
+
+		// Successful Bot API answers start with OK_PREFIX, only errors and odd replies are parsed for their
+		// code: the caller parses the body anyway, and getUpdates bodies are the largest the bot sees.
+		if (resp.compare(0, OK_PREFIX.size(), OK_PREFIX) == 0) {
+			m.ok.inc();
+			return resp;
+		}
+		auto json = nlohmann::json::parse(resp, nullptr, false);
+		if (!json.is_discarded() && json.value("ok", false)) {
+			m.ok.inc();
+		} else {
+			const auto code = json.is_discarded() ? 0 : json.value("error_code", 0);
+			m.error(code).inc();
+		}
+
+		return resp;
+	}
+
+  private:
+	// Method names double as trace span names, which must be literals.
+	static constexpr std::array<const char*, 10> METHODS = {"getUpdates", "sendMessage", "editMessageText",
+	    "deleteMessage", "answerCallbackQuery", "setMyCommands", "deleteWebhook", "getFile", "sendDocument", "other"};
+	static constexpr std::string_view OK_PREFIX = R"({"ok":true)";
+
+	struct MethodMetrics {
+		explicit MethodMetrics(const char* method):
+		    name(method), latency(metrics().histogram("tg_api_request_seconds", "Bot API call latency", latencyBuckets(),
+		        fmt::format("method=\"{}\"", method))),
+		    ok(result(method, "ok")), network(result(method, "network")), badRequest(result(method, "400")),
+		    forbidden(result(method, "403")), conflict(result(method, "409")), tooManyRequests(result(method, "429")),
+		    server(result(method, "5xx")), other(result(method, "other")) {}
+
+		static Counter& result(const char* method, const char* code) {
+			return metrics().counter("tg_api_requests_total", "Bot API calls by result",
+			    fmt::format("method=\"{}\",result=\"{}\"", method, code));
+		}
+
+		Counter& error(int code) const {
+			switch (code) {
+			case 400: return badRequest;
+			case 403: return forbidden;
+			case 409: return conflict;
+			case 429: return tooManyRequests;
+			default: return code >= 500 ? server : other;
+			}
+		}
+
+		const char* const name;
+		Histogram& latency;
+		Counter& ok;
+		Counter& network;
+		Counter& badRequest;
+		Counter& forbidden;
+		Counter& conflict;
+		Counter& tooManyRequests;
+		Counter& server;
+		Counter& other;
+	};
+
+	const TgBot::HttpClient& _client;
+	std::unordered_map<std::string, MethodMetrics> _methods;
+};
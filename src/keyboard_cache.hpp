@@ -0,0 +1,92 @@
+#pragma once
+
+#include "trace.hpp"
+
+#include <nlohmann/json.hpp>
+#include <tgbot/Bot.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+inline std::string serializeKeyboard(const TgBot::InlineKeyboardMarkup::Ptr& keyboard) {
+	TRACE_SCOPE("serializeKeyboard", "json");
+	auto rows = nlohmann::json::array();
+	for (const auto& row : keyboard->inlineKeyboard) {
+		auto jsonRow = nlohmann::json::array();
+		for (const auto& btn : row) {
+			nlohmann::json b = nlohmann::json::object();
+			b["text"] = btn->text;
+			if (!btn->url.empty()) {
+				b["url"] = btn->url;
+			} else {
+				b["callback_data"] = btn->callbackData;
+			}
+			jsonRow.push_back(std::move(b));
+		}
+		rows.push_back(std::move(jsonRow));
+	}
+	nlohmann::json markup = nlohmann::json::object();
+	markup["inline_keyboard"] = std::move(rows);
+
+	return markup.dump();
+}
+
+// Keeps reply_markup JSON of keyboards that depend only on the key (calendar month + selected day,
+// time of day, ...), so a click costs a map lookup instead of building and serializing a button tree.
+class KeyboardCache {
+  public:
+	using Markup = std::shared_ptr<const std::string>;
+
+	explicit KeyboardCache(size_t maxSize = 16 * 1024): _maxSize(maxSize) {}
+
+	template<class Make>
+	Markup get(const std::string& key, Make&& make) {
+		{
+			std::scoped_lock l(_m);
+			auto found = _cache.find(key);
+			if (found != _cache.end()) {
+				++_hits;
+				return found->second;
+			}
+		}
+
+		TgBot::InlineKeyboardMarkup::Ptr keyboard;
+		{
+			TRACE_SCOPE("makeKeyboard", "keyboard");
+			keyboard = make();
+		}
+		auto markup = std::make_shared<const std::string>(serializeKeyboard(keyboard));
+
+		std::scoped_lock l(_m);
+		++_misses;
+		if (_cache.size() >= _maxSize) {
+			_cache.clear();
+		}
+		_cache.emplace(key, markup);
+
+		return markup;
+	}
+
+	size_t size() const {
+		std::scoped_lock l(_m);
+		return _cache.size();
+	}
+	size_t hits() const {
+		std::scoped_lock l(_m);
+		return _hits;
+	}
+	size_t misses() const {
+		std::scoped_lock l(_m);
+		return _misses;
+	}
+
+  private:
+	mutable std::mutex _m;
+	const size_t _maxSize;
+	size_t _hits = 0;
+	size_t _misses = 0;
+
+	std::unordered_map<std::string, Markup> _cache;
+};
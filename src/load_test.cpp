@@ -0,0 +1,423 @@
+#include "fake_telegram.hpp"
+#include "tz_table.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <tgbot/net/CurlHttpClient.h>
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Drives the real bot binary against FakeTelegram: every simulated user registers, creates two
+// reminders through the /ar_* wizard, lists them, deletes one with /deli and waits for the other one
+// to fire.
+//
+// Usage: TgReminderBotLoad <path to TgReminderBot> [users] [minutes until fire] [fire spread minutes] [workers]
+//
+// With workers the bot runs sharded (--front) and a worker is added and another one removed while the
+// scripts run, so every chat that changes owner has to keep its reminders.
+//
+// Usage: TgReminderBotLoad <path to TgReminderBot> --rss [bots]
+//
+// Measures the resident memory and threads of 1, 2, 4, ... bots hosted in one process (a "bots" file)
+// against the same number of single-bot processes, all idle on long polls to FakeTelegram.
+
+using Clock = std::chrono::steady_clock;
+
+struct User {
+	std::int64_t id;
+	int step = 0;
+	std::int32_t wizardMsg = 0;
+	std::int32_t deliMsg = 0;
+	std::string delData;
+	std::string fireDate;
+	std::string fireTime;
+	std::int64_t fireUtc = 0;
+	bool fired = false;
+	std::optional<Clock::time_point> pendingSince;
+};
+
+class LoadGenerator {
+  public:
+	LoadGenerator(size_t users, int fireDelayMin, int fireSpreadMin):
+	    _fake(FakeTelegram::Listener{[this](const nlohmann::json& u) { onDelivered(u); },
+	        [this](const std::string& m, const FakeTelegram::Args& a, const nlohmann::json& r) { onCall(m, a, r); }}) {
+		const auto& zone = defaultTzTable();
+		const auto base = std::chrono::time_point_cast<std::chrono::minutes>(nowUtc()) + std::chrono::minutes(fireDelayMin);
+		for (size_t i = 0; i != users; ++i) {
+			User u;
+			u.id = 1000000 + static_cast<std::int64_t>(i);
+			auto fireUtc = time_point_s(base + std::chrono::minutes(i % std::max(1, fireSpreadMin)));
+			auto local = zone.toLocal(fireUtc);
+			u.fireDate = fmt::format("{}/{}/{}", static_cast<unsigned>(ymdFromLocal(local).day()),
+			    static_cast<unsigned>(ymdFromLocal(local).month()), static_cast<int>(ymdFromLocal(local).year()));
+			auto minutesOfDay = (local.time_since_epoch().count() / 60) % (24 * 60);
+			u.fireTime = fmt::format("{}:{}", minutesOfDay / 60, minutesOfDay % 60);
+			u.fireUtc = fireUtc.time_since_epoch().count();
+			_users.emplace(u.id, u);
+		}
+	}
+
+	std::string url() const { return _fake.url(); }
+
+	void start() {
+		_start = Clock::now();
+		for (auto& [id, u] : _users) {
+			next(u);
+		}
+	}
+
+	// Waits until all scripts are done and every remaining reminder fired, or until the deadline.
+	bool wait(Clock::time_point deadline) {
+		std::unique_lock lk(_m);
+		return _cond.wait_until(lk, deadline, [&] { return _done == _users.size() && _fired == _users.size(); });
+	}
+
+	void report() {
+		std::scoped_lock l(_m);
+
+		auto percentile = [](std::vector<double>& v, double p) {
+			if (v.empty()) {
+				return 0.0;
+			}
+			std::sort(v.begin(), v.end());
+			return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+		};
+
+		const auto scriptS = std::chrono::duration<double>(_scriptEnd - _start).count();
+		std::cout << fmt::format("users {}, scripts done {}, updates {}, errors {}\n", _users.size(), _done,
+		                 _latencies.size(), _errors)
+		          << fmt::format("throughput {:.1f} updates/s\n", _latencies.size() / std::max(scriptS, 1e-9))
+		          << fmt::format("handler latency p50 {:.2f} ms, p99 {:.2f} ms\n", percentile(_latencies, 0.5),
+		                 percentile(_latencies, 0.99))
+		          << fmt::format("callback ack p50 {:.2f} ms, p99 {:.2f} ms, unanswered {}\n",
+		                 percentile(_ackLatencies, 0.5), percentile(_ackLatencies, 0.99), _unanswered.size())
+		          << fmt::format("fires {}/{}, lateness p50 {:.0f} ms, p99 {:.0f} ms, max {:.0f} ms\n", _fired,
+		                 _users.size(), percentile(_lateness, 0.5), percentile(_lateness, 0.99),
+		                 _lateness.empty() ? 0.0 : _lateness.back());
+	}
+
+  private:
+	static date::year_month_day ymdFromLocal(time_point_s local) {
+		return date::year_month_day{date::sys_days{date::floor<date::days>(local.time_since_epoch())}};
+	}
+
+	static constexpr int WIZARD_STEPS = 7; // free text, five wizard clicks, /add
+	static constexpr int LIST_STEP = 1 + 2 * WIZARD_STEPS;
+	static constexpr int DELI_STEP = LIST_STEP + 1;
+	static constexpr int DEL_STEP = DELI_STEP + 1;
+	static constexpr int DONE_STEP = DEL_STEP + 1;
+
+	void next(User& u) {
+		const auto text = fmt::format("Нагрузка {}", u.id);
+
+		if (u.step == 0) {
+			_fake.pushMessage(u.id, u.id, "/start");
+		} else if (u.step < LIST_STEP) {
+			switch ((u.step - 1) % WIZARD_STEPS) {
+			case 0: _fake.pushMessage(u.id, u.id, text); break;
+			case 1: _fake.pushCallback(u.id, u.id, u.wizardMsg, text, "/ar_date"); break;
+			case 2: _fake.pushCallback(u.id, u.id, u.wizardMsg, text, "/ar_date " + u.fireDate); break;
+			case 3: _fake.pushCallback(u.id, u.id, u.wizardMsg, text, "/ar_time"); break;
+			case 4: _fake.pushCallback(u.id, u.id, u.wizardMsg, text, "/ar_time " + u.fireTime); break;
+			case 5: _fake.pushCallback(u.id, u.id, u.wizardMsg, text, "/ar_repeat"); break;
+			case 6:
+				_fake.pushCallback(u.id, u.id, u.wizardMsg, text, fmt::format("/add {} {} n ", u.fireDate, u.fireTime));
+				break;
+			}
+		} else if (u.step == LIST_STEP) {
+			_fake.pushMessage(u.id, u.id, "/list");
+		} else if (u.step == DELI_STEP) {
+			_fake.pushMessage(u.id, u.id, "/deli");
+		} else if (u.step == DEL_STEP) {
+			_fake.pushCallback(u.id, u.id, u.deliMsg, "deli", u.delData);
+		}
+	}
+
+	void onDelivered(const nlohmann::json& update) {
+		std::int64_t chatId = 0;
+		if (update.contains("message")) {
+			chatId = update["message"]["chat"]["id"].get<std::int64_t>();
+		} else if (update.contains("callback_query")) {
+			chatId = update["callback_query"]["message"]["chat"]["id"].get<std::int64_t>();
+		}
+
+		std::scoped_lock l(_m);
+		auto found = _users.find(chatId);
+		if (found != _users.end()) {
+			found->second.pendingSince = Clock::now();
+		}
+		if (update.contains("callback_query")) {
+			_unanswered[update["callback_query"]["id"].get<std::string>()] = Clock::now();
+		}
+	}
+
+	void onCall(const std::string& method, const FakeTelegram::Args& args, const nlohmann::json& result) {
+		if (method == "answerCallbackQuery") {
+			std::scoped_lock l(_m);
+			if (auto found = _unanswered.find(args.at("callback_query_id")); found != _unanswered.end()) {
+				_ackLatencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - found->second).count());
+				_unanswered.erase(found);
+			}
+			return;
+		}
+		if (method != "sendMessage" && method != "editMessageText") {
+			return;
+		}
+		const auto now = Clock::now();
+		const auto chatId = std::stoll(args.at("chat_id"));
+		const auto& text = args.at("text");
+
+		std::scoped_lock l(_m);
+		auto found = _users.find(chatId);
+		if (found == _users.end()) {
+			return;
+		}
+		auto& u = found->second;
+
+		if (text.rfind("⏰", 0) == 0) {
+			if (!u.fired) {
+				u.fired = true;
+				++_fired;
+				_lateness.push_back(
+				    std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch())
+				        .count() -
+				    u.fireUtc * 1000.0);
+				_cond.notify_all();
+			}
+			return;
+		}
+		if (!u.pendingSince) {
+			return;
+		}
+		_latencies.push_back(std::chrono::duration<double, std::milli>(now - *u.pendingSince).count());
+		u.pendingSince.reset();
+		if (text.rfind("⚠️", 0) == 0 || text.rfind("❌", 0) == 0) {
+			++_errors;
+		}
+
+		if (u.step > 0 && u.step < LIST_STEP && (u.step - 1) % WIZARD_STEPS == 0) {
+			u.wizardMsg = result["message_id"].get<std::int32_t>();
+		} else if (u.step == DELI_STEP) {
+			u.deliMsg = result["message_id"].get<std::int32_t>();
+			auto markup = nlohmann::json::parse(args.count("reply_markup") ? args.at("reply_markup") : "{}", nullptr, false);
+			if (!markup.is_discarded() && markup.contains("inline_keyboard")) {
+				for (const auto& row : markup["inline_keyboard"]) {
+					for (const auto& btn : row) {
+						auto data = btn.value("callback_data", "");
+						if (u.delData.empty() && data.rfind("/del ", 0) == 0) {
+							u.delData = data;
+						}
+					}
+				}
+			}
+			if (u.delData.empty()) {
+				++_errors;
+				u.step = DEL_STEP;
+			}
+		}
+
+		++u.step;
+		if (u.step == DONE_STEP) {
+			++_done;
+			_scriptEnd = now;
+			_cond.notify_all();
+		} else {
+			next(u);
+		}
+	}
+
+  private:
+	std::mutex _m;
+	std::condition_variable _cond;
+	std::unordered_map<std::int64_t, User> _users;
+	size_t _done = 0;
+	size_t _fired = 0;
+	size_t _errors = 0;
+	std::vector<double> _latencies;
+	std::vector<double> _ackLatencies;
+	std::unordered_map<std::string, Clock::time_point> _unanswered; // callback query id -> delivery
+	std::vector<double> _lateness;
+	Clock::time_point _start;
+	Clock::time_point _scriptEnd;
+
+	FakeTelegram _fake;
+};
+
+// Starts the bot in `dir`, with `arg` if not empty.
+pid_t launch(const std::string& botPath, const std::string& dir, const std::string& arg = "",
+    const std::string& value = "") {
+	const auto pid = fork();
+	if (pid == 0) {
+		if (chdir(dir.c_str()) != 0) {
+			_exit(1);
+		}
+		if (arg.empty()) {
+			execl(botPath.c_str(), botPath.c_str(), nullptr);
+		} else {
+			execl(botPath.c_str(), botPath.c_str(), arg.c_str(), value.c_str(), nullptr);
+		}
+		_exit(1);
+	}
+	return pid;
+}
+
+struct ProcessStatus {
+	size_t rssKb = 0;
+	size_t threads = 0;
+};
+
+ProcessStatus readStatus(pid_t pid) {
+	ProcessStatus status;
+	std::ifstream in(fmt::format("/proc/{}/status", pid));
+	for (std::string line; std::getline(in, line);) {
+		if (line.rfind("VmRSS:", 0) == 0) {
+			status.rssKb = std::stoul(line.substr(6));
+		} else if (line.rfind("Threads:", 0) == 0) {
+			status.threads = std::stoul(line.substr(8));
+		}
+	}
+	return status;
+}
+
+int measureRss(const std::string& botPath, size_t maxBots) {
+	FakeTelegram fake(FakeTelegram::Listener{});
+	char dirTemplate[] = "/tmp/tg_reminder_rss_XXXXXX";
+	const std::string root = mkdtemp(dirTemplate);
+	auto botDir = [&](const std::string& dir) {
+		mkdir(dir.c_str(), 0755);
+		std::ofstream(dir + "/api_url") << fake.url();
+		std::ofstream(dir + "/metrics_port") << 0;
+	};
+	// Startup, recovery and the first long polls are done by then.
+	auto settle = [] { std::this_thread::sleep_for(std::chrono::seconds(3)); };
+	auto stop = [](const std::vector<pid_t>& pids) {
+		for (auto pid : pids) {
+			kill(pid, SIGINT);
+		}
+		for (auto pid : pids) {
+			waitpid(pid, nullptr, 0);
+		}
+	};
+
+	std::cout << "bots  hosted MiB  threads  separate MiB  threads  hosted KiB/added bot\n";
+	std::optional<ProcessStatus> first;
+	for (size_t bots = 1; bots <= maxBots; bots *= 2) {
+		const auto hostedDir = fmt::format("{}/hosted{}", root, bots);
+		botDir(hostedDir);
+		{
+			std::ofstream list(hostedDir + "/bots");
+			for (size_t i = 0; i != bots; ++i) {
+				list << fmt::format("bot{} {}:RSS\n", i, i + 1);
+			}
+		}
+		const auto hostedPid = launch(botPath, hostedDir);
+		settle();
+		const auto hosted = readStatus(hostedPid);
+		stop({hostedPid});
+
+		std::vector<pid_t> pids;
+		for (size_t i = 0; i != bots; ++i) {
+			const auto dir = fmt::format("{}/separate{}_{}", root, bots, i);
+			botDir(dir);
+			std::ofstream(dir + "/token") << fmt::format("{}:RSS", i + 1);
+			pids.push_back(launch(botPath, dir));
+		}
+		settle();
+		ProcessStatus separate;
+		for (auto pid : pids) {
+			const auto status = readStatus(pid);
+			separate.rssKb += status.rssKb;
+			separate.threads += status.threads;
+		}
+		stop(pids);
+
+		if (!first) {
+			first = hosted;
+		}
+		const auto perBot = bots > 1 ? (static_cast<double>(hosted.rssKb) - first->rssKb) / (bots - 1) : 0.0;
+		std::cout << fmt::format("{:>4}  {:>10.1f}  {:>7}  {:>12.1f}  {:>7}  {:>20.0f}\n", bots, hosted.rssKb / 1024.0,
+		    hosted.threads, separate.rssKb / 1024.0, separate.threads, perBot);
+	}
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0]
+		          << " <path to TgReminderBot> [users] [minutes until fire] [spread minutes] [workers]\n"
+		          << "       " << argv[0] << " <path to TgReminderBot> --rss [bots]\n";
+		return 1;
+	}
+	if (argc > 2 && std::string(argv[2]) == "--rss") {
+		return measureRss(argv[1], argc > 3 ? std::stoul(argv[3]) : 16);
+	}
+	const std::string botPath = argv[1];
+	const size_t users = argc > 2 ? std::stoul(argv[2]) : 1000;
+	const int fireDelay = argc > 3 ? std::stoi(argv[3]) : 3;
+	const int fireSpread = argc > 4 ? std::stoi(argv[4]) : 2;
+	const std::string workers = argc > 5 ? argv[5] : "";
+
+	LoadGenerator gen(users, fireDelay, fireSpread);
+
+	char dirTemplate[] = "/tmp/tg_reminder_load_XXXXXX";
+	const std::string dir = mkdtemp(dirTemplate);
+	std::ofstream(dir + "/token") << "1:LOADTEST";
+	std::ofstream(dir + "/api_url") << gen.url();
+
+	const auto pid = workers.empty() ? launch(botPath, dir) : launch(botPath, dir, "--front", workers);
+	std::cout << fmt::format("bot pid {} in {}, fake api {}", pid, dir, gen.url()) << std::endl;
+
+	gen.start();
+
+	std::thread rebalancer;
+	if (!workers.empty()) {
+		rebalancer = std::thread([&] {
+			std::string frontUrl;
+			while (frontUrl.empty()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				std::ifstream(dir + "/front_url") >> frontUrl;
+			}
+			TgBot::CurlHttpClient client;
+			for (const auto* path : {"/admin/add", "/admin/remove?worker=w0"}) {
+				std::this_thread::sleep_for(std::chrono::seconds(3));
+				const auto start = Clock::now();
+				try {
+					auto resp = client.makeRequest(TgBot::Url(frontUrl + path), {});
+					std::cout << fmt::format("{}: {} in {:.0f} ms", path, resp,
+					                 std::chrono::duration<double, std::milli>(Clock::now() - start).count())
+					          << std::endl;
+				} catch (const std::exception& e) { std::cerr << path << ": " << e.what() << std::endl; }
+			}
+		});
+	}
+	const bool ok = gen.wait(Clock::now() + std::chrono::minutes(fireDelay + fireSpread + 2));
+	if (rebalancer.joinable()) {
+		rebalancer.join();
+	}
+
+	kill(pid, SIGINT);
+	waitpid(pid, nullptr, 0);
+
+	gen.report();
+
+	return ok ? 0 : 2;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <spdlog/async.h>
+#include <spdlog/cfg/env.h>
+#include <spdlog/sinks/stdout_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Leveled logging. A call only formats its message into spdlog's ring buffer, one background thread writes
+// the buffer to stderr; a full buffer overwrites its oldest message rather than making the caller wait, so a
+// stalled stderr never holds up a handler, a sender or the scheduler.
+//
+// Messages are an event name followed by key=value fields, chat ids as chat= and reminder ids as reminder=:
+//     logger().warn("send_failed chat={} reminders={} error={}", chatId, ids, e.what());
+// SPDLOG_LEVEL picks the level, e.g. SPDLOG_LEVEL=debug; info by default.
+inline constexpr size_t LOG_QUEUE_SIZE = 1 << 13;
+
+inline std::shared_ptr<spdlog::async_logger> makeAsyncLogger(std::string name, spdlog::sink_ptr sink,
+    std::shared_ptr<spdlog::details::thread_pool> pool) {
+	auto logger = std::make_shared<spdlog::async_logger>(
+	    std::move(name), std::move(sink), std::move(pool), spdlog::async_overflow_policy::overrun_oldest);
+	logger->set_pattern("%Y-%m-%dT%H:%M:%S.%e %l %v");
+	return logger;
+}
+
+inline spdlog::logger& logger() {
+	static const auto instance = [] {
+		spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+		auto logger = makeAsyncLogger("bot", std::make_shared<spdlog::sinks::stderr_sink_mt>(), spdlog::thread_pool());
+		spdlog::register_logger(logger);
+		spdlog::cfg::load_env_levels();
+		return logger;
+	}();
+	return *instance;
+}
+
+// Messages overwritten in the ring buffer before they were written.
+inline std::uint64_t logOverruns() {
+	logger();
+	return spdlog::thread_pool()->overrun_counter();
+}
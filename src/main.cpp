@@ -1,5 +1,29 @@
 #include "auto_reminder.hpp"
+#include "catch_up.hpp"
+#include "chat_transfer.hpp"
+#include "chat_zones.hpp"
+#include "db_maintenance.hpp"
+#include "keyboard_cache.hpp"
+#include "clock.hpp"
+#include "edit_queue.hpp"
+#include "http_server.hpp"
+#include "idempotency_filter.hpp"
+#include "instrumented_http_client.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "page_cache.hpp"
+#include "phrase_parser.hpp"
+#include "raw_api.hpp"
 #include "reminder_info.hpp"
+#include "reminder_io.hpp"
+#include "reminder_query.hpp"
+#include "reminder_storage.hpp"
+#include "replication.hpp"
+#include "scheduler_group.hpp"
+#include "scheduler_snapshot.hpp"
+#include "scheduler_wal.hpp"
+#include "shard_front.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 #include <boost/algorithm/string/split.hpp>
@@ -9,38 +33,31 @@
 #include <nlohmann/json.hpp>
 #include <tgbot/Bot.h>
 #include <tgbot/net/CurlHttpClient.h>
-#include <tgbot/net/TgLongPoll.h>
 #include <unqlite_cpp/unqlite_cpp.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <set>
 #include <shared_mutex>
+#include <sstream>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
+#include <unistd.h>
+
 using namespace std::chrono;
 using namespace TgBot;
 
-bool eraseReminder(up::db& db, std::int64_t chatId, std::int64_t recId) {
-	auto vm = db.compile_or_throw("$result = db_drop_record($c, $recId);");
-	std::string collection = fmt::format("reminders_{}", chatId);
-	vm.bind_or_throw("c", collection);
-	vm.bind_or_throw("recId", recId);
-	vm.exec_or_throw();
-	db.commit_or_throw();
-
-	return vm.extract_or_throw("result").get_bool_or_throw();
-}
-
-std::pair<time_point_s, time_point_s> parseInfoArgs(std::vector<std::string>& args) {
-	auto n = now();
+std::pair<time_point_s, time_point_s> parseInfoArgs(std::vector<std::string>& args, time_point_s n) {
 	date::year_month_day ymd{date::sys_days{date::floor<date::days>(n.time_since_epoch())}};
 	if (args.empty() || args[0] == "w") {
 		auto d = (n - date::sys_days{ymd}.time_since_epoch()) + date::days(7);
@@ -64,15 +81,6 @@ std::pair<time_point_s, time_point_s> parseInfoArgs(std::vector<std::string>& ar
 	}
 }
 
-std::string prettyDateTime(time_point_s localTp) {
-	date::year_month_day ymd{date::sys_days{date::floor<date::days>(localTp.time_since_epoch())}};
-	date::time_of_day<minutes> tod{
-	    date::floor<minutes>(localTp.time_since_epoch() - date::sys_days{ymd}.time_since_epoch())};
-
-	return fmt::format("{:0>2}:{:0>2} {:0>2}/{:0>2}/{}", tod.hours().count(), tod.minutes().count(),
-	    static_cast<unsigned>(ymd.day()), static_cast<unsigned>(ymd.month()), static_cast<int>(ymd.year()));
-}
-
 std::string renderRemindersForInfo(const std::vector<std::pair<time_point_s, ReminderInfo>>& rems) {
 	std::string out;
 
@@ -87,173 +95,130 @@ std::string renderRemindersForInfo(const std::vector<std::pair<time_point_s, Rem
 	return out;
 }
 
-class ReminderQuery {
-  public:
-	ReminderQuery(Bot& bot): _bot(bot) {}
-	void addTimer(std::int64_t chatId, time_point_s tp, const ReminderInfo& reminder) {
-		std::scoped_lock l(_m);
-		_order[chatId].emplace(tp, reminder);
-		_cond.notify_all();
-	}
+// Set by SIGINT, the bot finishes the current poll, writes a checkpoint and exits. A second SIGINT
+// exits right away.
+std::atomic_bool stopRequested = false;
+
+// What the bots hosted in the process share: the HTTP client and its connections, the edit workers, the
+// scheduler thread and the metrics endpoint.
+struct SharedServices {
+	HttpClient& http;
+	EditWorkers& edits;
+	SchedulerGroup& scheduler;
+	HttpRoutes& routes;
+};
 
-	void removeTimer(std::int64_t chatId, std::int64_t reminderId) {
-		std::scoped_lock l(_m);
-		auto& rms = _order[chatId];
-		for (auto it = rms.begin(); it != rms.end();) {
-			if (it->second._id != reminderId) {
-				it++;
-			} else {
-				it = rms.erase(it);
-			}
-		}
-		_cond.notify_all();
-	}
+// Runs one bot until stopRequested, its files are in cfg.dir. A follower (see --follow) first replicates the
+// primary listening on `followSocket`.
+int runBot(const BotConfig& cfg, SharedServices& shared, const std::string& followSocket) {
+	Bot bot(cfg.token, shared.http, cfg.apiUrl);
+	bot.getApi().deleteWebhook();
+	RawApi rawApi(shared.http, cfg.token, cfg.apiUrl);
+	EditQueue edits(rawApi, shared.edits);
 
-	void stop() {
-		std::scoped_lock l(_m);
-		_running = false;
-		_cond.notify_all();
-	}
+	KeyboardCache kc;
+	PageCache pages;
 
-	std::vector<std::pair<time_point_s, ReminderInfo>> getInterval(std::int64_t chatId, time_point_s from,
-	    time_point_s to) {
-		std::unique_lock lk(_m);
+	Clock& clock = systemClock();
 
-		const auto& rems = _order[chatId];
+	up::db db(cfg.dir + "db.bin");
+	DynamicStorage ds(db, "dynamic_storage", clock);
+	ChatZones zones(db, clock);
+	ReminderStore store(cfg.dir + "reminders.kv");
+	if (auto migrated = migrateReminders(db, store)) {
+		logger().info("reminders_migrated count={} to={}reminders.kv", migrated, cfg.dir);
+	}
 
-		std::vector<std::pair<time_point_s, ReminderInfo>> out;
-		for (auto& r : rems) {
-			if (r.first <= from) {
-				continue;
-			}
-			if (r.first > to) {
-				break;
+	ReminderQuery q([&](std::int64_t chatId, const std::string& text) { bot.getApi().sendMessage(chatId, text); },
+	    zones, clock);
+	q.setCoalesceWindow(findCoalesceWindow(cfg.dir));
+
+	// Handlers run on the long poll thread, dbMutex serializes them with background database users.
+	std::mutex dbMutex;
+	auto locked = [&](auto f) {
+		return [&dbMutex, f](auto... args) {
+			std::scoped_lock l(dbMutex);
+			f(args...);
+		};
+	};
+	// Compacts db.bin and reminders.kv from the checkpointer and writes backups of both on /db/snapshot, both
+	// take dbMutex themselves.
+	DbMaintenance maintenance(db, cfg.dir + "db.bin", store, dbMutex, ds, zones);
+
+	// Rebuilds the chat's timers from the database. Callers must hold dbMutex, so only the scheduler firing
+	// the chat's timers can get in between and the rebuild is retried until it lands.
+	auto schedule = [&](std::int64_t chatId) {
+		while (true) {
+			auto version = q.chatVersion(chatId);
+			if (q.replaceChat(chatId, nextTimers(loadReminders(store, chatId), zones.zone(chatId), clock.now()),
+			        version)) {
+				return;
 			}
-			out.emplace_back(r.first, r.second);
 		}
+	};
 
-		return out;
-	}
+	// With replication on, every change of a chat's stored state is journaled as a StoreChat record for
+	// the followers. Callers must hold dbMutex.
+	std::atomic<SchedulerWal*> replicationJournal = nullptr;
+	auto replicate = [&](std::int64_t chatId, bool withUsers) {
+		if (auto* journal = replicationJournal.load()) {
+			journal->storeChat(chatId, encodeChatTransfer(exportChat(db, store, zones, chatId, withUsers)));
+		}
+	};
 
-	void run() {
-		struct RingInfo {
-			std::int64_t chatId;
-			ReminderInfo reminder;
-			time_point_s nextTp;
-		};
-		std::vector<RingInfo> ringNow;
-
-		std::unique_lock lk(_m);
-		_running = true;
-
-		while (_running) {
-			auto localTp = now();
-			auto nextTpWakeUp = localTp + date::years(1);
-			for (auto& [chatId, reminders] : _order) {
-				for (auto it = reminders.begin(); it != reminders.end();) {
-					if (it->first < localTp) {
-						ringNow.push_back({chatId, it->second});
-						auto& r = ringNow.back();
-						it = reminders.erase(it);
-						if (r.reminder.isRepeatable()) {
-							r.nextTp = r.reminder.getNearTs(localTp);
-							reminders.emplace(r.nextTp, r.reminder);
-						}
-					} else {
-						if (it->first < nextTpWakeUp) {
-							nextTpWakeUp = it->first;
-						}
-						break;
-					}
-				}
+	// A worker of a sharded bot (see runShardFront) also serves the routes the front moves chats with.
+	// Routes of a bot hosted with others are under /bots/<name>.
+	const std::string routePrefix = cfg.name.empty() ? "" : "/bots/" + cfg.name;
+	const bool shardWorker = std::ifstream(cfg.dir + "shard_worker").is_open();
+	auto shardRoute = [&](const HttpRequest& req) {
+		const auto path = req.path().substr(routePrefix.size());
+		auto args = parseForm(req);
+		std::scoped_lock l(dbMutex);
+		if (path == "/shard/chats") {
+			auto chats = nlohmann::json::array();
+			for (const auto& uc : loadUserChats(db)) {
+				chats.push_back(uc.chatId);
 			}
-
-			for (auto& r : ringNow) {
-				std::string nextRing;
-				if (r.reminder.isRepeatable()) {
-					nextRing = fmt::format("\n\nСледующее напоминание:\n{}", prettyDateTime(r.nextTp));
-				}
-				_bot.getApi().sendMessage(r.chatId,
-				    fmt::format("⏰{}⏰\n\n{}{}", r.reminder.descr, r.reminder.pretty(), nextRing));
+			return HttpResponse{200, "application/json", chats.dump()};
+		}
+		const auto chatId = std::stoll(args.at("chat"));
+		if (path == "/shard/export") {
+			return HttpResponse{200, "application/octet-stream",
+			    encodeChatTransfer(exportChat(db, store, zones, chatId))};
+		}
+		if (path == "/shard/import") {
+			auto transfer = decodeChatTransfer(args.at("data"));
+			if (!transfer || transfer->chatId != chatId) {
+				return HttpResponse{400, "text/plain", "bad transfer"};
 			}
-			ringNow.clear();
-
-			_cond.wait_for(lk, nextTpWakeUp - now());
+			importChat(db, store, zones, *transfer);
+			schedule(chatId);
+			replicate(chatId, true);
+		} else if (path == "/shard/drop") {
+			dropChat(db, store, zones, chatId);
+			q.clearChat(chatId);
+			replicate(chatId, true);
+		} else {
+			return HttpResponse{404, "text/plain", "not found"};
 		}
-	}
-
-  private:
-	mutable std::mutex _m;
-	mutable std::condition_variable _cond;
-	std::atomic_bool _running;
-
-	Bot& _bot;
-	std::unordered_map<std::int64_t /*chatId*/, std::multimap<time_point_s, ReminderInfo>> _order;
-};
-
-std::vector<ReminderInfo> loadReminders(up::db& db, std::int64_t chatId) {
-	auto collection = fmt::format("reminders_{}", chatId);
-	up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw(collection);
-
-	if (!value.is_array() || value.size() == 0) {
-		return {};
-	}
-
-	std::vector<ReminderInfo> res;
-	value.foreach_array([&](int64_t i, const up::value& v) {
-		auto id = v.at("__id").get_int_or_throw();
-		ReminderInfo ri;
-		ri.fromValue(v);
-		res.push_back(ri);
-
-		return true;
-	});
-
-	return res;
-}
-
-struct UserChat {
-	std::int64_t userId;
-	std::int64_t chatId;
-};
-std::vector<UserChat> loadUserChats(up::db& db) {
-	up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw("users");
+		return HttpResponse{200, "text/plain", "ok"};
+	};
 
-	if (!value.is_array() || value.size() == 0) {
-		return {};
+	HttpRoutes::Scoped routes(shared.routes);
+	if (shardWorker) {
+		routes.add(routePrefix + "/shard/", shardRoute);
 	}
-
-	std::vector<UserChat> res;
-	value.foreach_array([&](int64_t i, const up::value& v) {
-		res.push_back({v.at("id").get_int_or_throw(), v.at("chat_id").get_int_or_throw()});
-
-		return true;
+	routes.add(routePrefix + "/db/snapshot", [&](const HttpRequest&) {
+		::mkdir((cfg.dir + "backups").c_str(), 0755);
+		const auto path = fmt::format("{}backups/{}", cfg.dir, clock.now().time_since_epoch().count());
+		const auto result = maintenance.snapshot(path);
+		return HttpResponse{200, "text/plain",
+		    fmt::format("{} {} bytes, longest pause {} us\n", path, result.bytesAfter,
+		        std::chrono::duration_cast<std::chrono::microseconds>(result.maxPause).count())};
 	});
 
-	return res;
-}
-
-bool isChatRegistered(up::db& db, std::int64_t chatId) {
-	auto collection = fmt::format("reminders_{}", chatId);
-	return up::vm_collection_exist(db).exist(collection);
-}
-
-int main(int, char**) {
-	signal(SIGINT, [](int s) {
-		printf("SIGINT got\n");
-		exit(0);
-	});
-
-	CurlHttpClient curlHttpClient;
-	Bot bot(findToken(), curlHttpClient);
-	bot.getApi().deleteWebhook();
-
-	up::db db("db.bin");
-	DynamicStorage ds(db, "dynamic_storage");
-
-	ReminderQuery q(bot);
-
 	auto start = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("start", "handler");
 		try {
 			auto [userId, chatId] = getUserChatOrThrow(msg);
 
@@ -262,17 +227,14 @@ int main(int, char**) {
 				return;
 			}
 
-			auto collection = fmt::format("reminders_{}", chatId);
-			db.compile_or_throw("db_create($col);").bind_or_throw("col", collection).exec_or_throw();
-			db.commit_or_throw();
-
-			up::vm_store_record(db).store_or_throw("users",
-			    up::value::object{{"id", userId}, {"chat_id", msg->chat->id}});
+			registerChat(db, userId, chatId);
+			replicate(chatId, true);
 
 			bot.getApi().sendMessage(msg->chat->id, "Здравствуйте, вы зарегестрированны.");
-		} catch (const std::exception& e) { std::cerr << e.what(); }
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "start", chatOf(msg), e.what()); }
 	};
 	auto add = [&](TgBot::Message::Ptr msg, CallbackQuery::Ptr query) {
+		TRACE_SCOPE("add", "handler");
 		try {
 			auto [userId, chatId] = getUserChatOrThrow(msg);
 
@@ -302,33 +264,43 @@ int main(int, char**) {
 				return;
 			}
 
-			up::value v;
-			ri.toValue(v);
-
-			auto localTp = now();
+			const auto& zone = zones.zone(chatId);
+			auto localTp = zone.toLocal(clock.now());
 			auto nextTp = ri.getNearTs(localTp);
 			if (nextTp < localTp) {
 				bot.getApi().sendMessage(chatId, "⚠️ Напоминание уже прошло, так же оно не повоторяется!");
 				return;
 			}
 
-			auto collection = fmt::format("reminders_{}", chatId);
-			ri._id = up::vm_store_record(db).store_or_throw(collection, v);
+			ri._id = storeReminder(store, chatId, ri);
+			store.commit();
 
-			q.addTimer(chatId, nextTp, ri);
+			q.addTimer(chatId, zone.toUtc(nextTp), ri);
+			replicate(chatId, false);
 
 			if (query) {
-				bot.getApi().editMessageText(fmt::format("✅🗓️ Напоминание добавленно.\n{}\nСледующее срабатывание:\n {}",
-				                                 ri.pretty(), prettyDateTime(nextTp)),
-				    chatId, msg->messageId);
+				edits.editMessageText(chatId, msg->messageId,
+				    fmt::format("✅🗓️ Напоминание добавленно.\n{}\nСледующее срабатывание:\n {}", ri.pretty(),
+				        prettyDateTime(nextTp)));
 			} else {
 				bot.getApi().sendMessage(chatId,
 				    fmt::format("✅🗓️ Напоминание добавленно.\n{}\nСледующее срабатывание:\n {}", ri.pretty(),
 				        prettyDateTime(nextTp)));
 			}
-		} catch (const std::exception& e) { std::cerr << e.what(); }
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "add", chatOf(msg), e.what()); }
+	};
+	// Reminders of a chat as /list and /deli show them, read on a page cache miss.
+	auto loadItems = [&](std::int64_t chatId) {
+		return [&store, chatId] {
+			PageCache::Items items;
+			for (const auto& ri : loadReminders(store, chatId)) {
+				items.emplace_back(ri._id, ri.toString());
+			}
+			return items;
+		};
 	};
 	auto list = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("list", "handler");
 		try {
 			auto [userId, chatId] = getUserChatOrThrow(msg);
 
@@ -354,29 +326,28 @@ int main(int, char**) {
 					return;
 				}
 
-			auto collection = fmt::format("reminders_{}", chatId);
-			up::value value;
-			value = up::vm_fetch_all_records(db).fetch_value_or_throw(collection);
-
-			std::string outMsg;
-			if (!value.is_array() || value.size() == 0) {
-				bot.getApi().sendMessage(msg->chat->id, "⚠️ Еще нет напоминаний.");
-				return;
-			}
-			auto start = std::max<int>(0, (page - 1) * 10);
-			auto end = std::min<int>(value.size(), page * 10);
-
-			for (int i = start; i != end; ++i) {
-				ReminderInfo ri;
-				ri.fromValue(value.at(i));
-				outMsg += fmt::format("{}: {}\n", ri._id, ri.toString());
-			}
-
-			bot.getApi().sendMessage(msg->chat->id,
-			    fmt::format("🗓️ Список напоминаний({}-{})/{}:\n{}", start, end, value.size(), outMsg));
-		} catch (const std::exception& e) { std::cerr << e.what(); }
+			auto rendered = pages.get(chatId, q.chatVersion(chatId), "list", std::to_string(page), loadItems(chatId),
+			    [&](const PageCache::Items& items) {
+				    if (items.empty()) {
+					    return RenderedPage{"⚠️ Еще нет напоминаний.", ""};
+				    }
+				    auto start = std::max<int>(0, (page - 1) * 10);
+				    auto end = std::min<int>(items.size(), page * 10);
+
+				    std::string outMsg;
+				    for (int i = start; i < end; ++i) {
+					    outMsg += fmt::format("{}: {}\n", items[i].first, items[i].second);
+				    }
+
+				    return RenderedPage{
+				        fmt::format("🗓️ Список напоминаний({}-{})/{}:\n{}", start, end, items.size(), outMsg), ""};
+			    });
+
+			bot.getApi().sendMessage(msg->chat->id, rendered->text);
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "list", chatOf(msg), e.what()); }
 	};
 	auto del = [&](TgBot::Message::Ptr msg, CallbackQuery::Ptr query) {
+		TRACE_SCOPE("del", "handler");
 		try {
 			auto [userId, chatId] = getUserChatOrThrow(msg);
 
@@ -407,8 +378,9 @@ int main(int, char**) {
 				}
 				return;
 			}
-			if (eraseReminder(db, chatId, recId)) {
+			if (eraseReminder(store, chatId, recId)) {
 				q.removeTimer(chatId, recId);
+				replicate(chatId, false);
 				if (!query) {
 					bot.getApi().sendMessage(msg->chat->id, "✅ Напоминание удаленно.");
 				}
@@ -417,9 +389,165 @@ int main(int, char**) {
 					bot.getApi().sendMessage(msg->chat->id, "❌ Напоминания не существует.");
 				}
 			}
-		} catch (const std::exception& e) { std::cerr << e.what(); }
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "del", chatOf(msg), e.what()); }
+	};
+	auto tz = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("tz", "handler");
+		try {
+			auto [userId, chatId] = getUserChatOrThrow(msg);
+
+			if (!isChatRegistered(db, chatId)) {
+				bot.getApi().sendMessage(chatId, "⚠️ Бот еще не зарегестрирован в этом чате!(/start)");
+				return;
+			}
+
+			auto args = split(msg->text);
+			if (args.size() > 2) {
+				bot.getApi().sendMessage(chatId, "⚠️ Неверное колличество аргументов!");
+				return;
+			}
+
+			const TzTable* zone;
+			if (args.size() == 1) {
+				zone = &zones.zone(chatId);
+			} else {
+				try {
+					zone = &zones.set(chatId, args[1]);
+				} catch (const std::exception& e) {
+					bot.getApi().sendMessage(chatId, "⚠️ Неизвестный часовой пояс! (Пр. /tz Europe/Moscow)");
+					return;
+				}
+				schedule(chatId);
+				replicate(chatId, false);
+			}
+
+			bot.getApi().sendMessage(chatId, fmt::format("🌍 Часовой пояс: {}\nМестное время: {}", zone->name(),
+			                                     prettyDateTime(zone->toLocal(clock.now()))));
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "tz", chatOf(msg), e.what()); }
+	};
+	// /pre <id> [минуты,...] sets the pre-reminder offsets of a reminder, without offsets clears them.
+	auto pre = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("pre", "handler");
+		try {
+			auto [userId, chatId] = getUserChatOrThrow(msg);
+
+			if (!isChatRegistered(db, chatId)) {
+				bot.getApi().sendMessage(chatId, "⚠️ Бот еще не зарегестрирован в этом чате!(/start)");
+				return;
+			}
+
+			auto args = split(msg->text);
+			if (args.size() < 2 || args.size() > 3) {
+				bot.getApi().sendMessage(chatId, "⚠️ Неверное колличество аргументов! (Пр. /pre 12 15,60)");
+				return;
+			}
+
+			std::int64_t recId;
+			std::vector<std::int64_t> offsets;
+			try {
+				recId = std::stoll(args[1]);
+				if (args.size() == 3) {
+					std::vector<std::string> parts;
+					boost::split(parts, args[2], [](char c) { return c == ','; });
+					for (const auto& part : parts) {
+						auto offset = std::stoll(part);
+						if (offset <= 0 || offset > 0xffff) {
+							throw std::out_of_range(part);
+						}
+						offsets.push_back(offset);
+					}
+				}
+			} catch (const std::exception& e) {
+				bot.getApi().sendMessage(chatId, "⚠️ Неверный формат! Минуты от 1 до 65535 через запятую.");
+				return;
+			}
+			ReminderInfo::normalizePreReminders(offsets);
+			if (offsets.size() > ReminderInfo::MAX_PRE_REMINDERS) {
+				bot.getApi().sendMessage(chatId, fmt::format("⚠️ Не больше {} предварительных напоминаний!",
+				                                     ReminderInfo::MAX_PRE_REMINDERS));
+				return;
+			}
+
+			auto reminders = loadReminders(store, chatId);
+			auto found =
+			    std::find_if(reminders.begin(), reminders.end(), [&](const auto& r) { return r._id == recId; });
+			if (found == reminders.end()) {
+				bot.getApi().sendMessage(chatId, "⚠️ Напоминание не найдено!");
+				return;
+			}
+			found->setPreReminders(offsets);
+			updateReminder(store, chatId, *found);
+			schedule(chatId);
+			replicate(chatId, false);
+
+			bot.getApi().sendMessage(chatId, fmt::format("✅🔔 Напоминание обновлено.\n{}", found->pretty()));
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "pre", chatOf(msg), e.what()); }
+	};
+	// /export [csv|ics] sends the chat's reminders as a file.
+	auto exportFile = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("export", "handler");
+		try {
+			auto [userId, chatId] = getUserChatOrThrow(msg);
+
+			if (!isChatRegistered(db, chatId)) {
+				bot.getApi().sendMessage(chatId, "⚠️ Бот еще не зарегестрирован в этом чате!(/start)");
+				return;
+			}
+
+			auto args = split(msg->text);
+			auto format = args.size() > 1 ? reminderFormat(args[1]) : ReminderFormat::Csv;
+			if (args.size() > 2 || !format) {
+				bot.getApi().sendMessage(chatId, "⚠️ Неверный формат! (Пр. /export csv или /export ics)");
+				return;
+			}
+
+			std::ostringstream out;
+			auto count = exportReminders(store, chatId, out, *format);
+			auto file = std::make_shared<InputFile>();
+			file->data = out.str();
+			file->mimeType = *format == ReminderFormat::Csv ? "text/csv" : "text/calendar";
+			file->fileName = *format == ReminderFormat::Csv ? "reminders.csv" : "reminders.ics";
+			bot.getApi().sendDocument(chatId, file, "", fmt::format("📤 Напоминаний: {}", count));
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "export", chatOf(msg), e.what()); }
+	};
+	// A .csv or .ics document captioned /import is added to the chat's reminders.
+	auto importFile = [&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("import", "handler");
+		try {
+			auto [userId, chatId] = getUserChatOrThrow(msg);
+
+			if (!isChatRegistered(db, chatId)) {
+				bot.getApi().sendMessage(chatId, "⚠️ Бот еще не зарегестрирован в этом чате!(/start)");
+				return;
+			}
+
+			auto format = msg->document ? reminderFormat(msg->document->fileName) : std::nullopt;
+			if (!format) {
+				bot.getApi().sendMessage(chatId,
+				    "📥 Отправьте файл .csv или .ics с подписью /import.\n"
+				    "CSV: date,time,repeat,descr,pre (Пр. 23.12.2023,14:30,w12345,Обед,15)");
+				return;
+			}
+
+			auto file = bot.getApi().getFile(msg->document->fileId);
+			std::istringstream in(bot.getApi().downloadFile(file->filePath));
+			auto result = importReminders(store, chatId, in, *format, zones.zone(chatId), clock.now());
+			q.addTimers(result.timers);
+			if (result.stats.imported) {
+				q.touchChat(chatId);
+			}
+			replicate(chatId, false);
+
+			std::string errors;
+			for (const auto& e : result.stats.errors) {
+				errors += fmt::format("\n{}", e);
+			}
+			bot.getApi().sendMessage(chatId, fmt::format("📥 Импортировано напоминаний: {}, с ошибками: {}{}",
+			                                     result.stats.imported, result.stats.failed, errors));
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "import", chatOf(msg), e.what()); }
 	};
 	auto deli = [&](TgBot::Message::Ptr msg, CallbackQuery::Ptr query) {
+		TRACE_SCOPE("deli", "handler");
 		try {
 			auto [userId, chatId] = getUserChatOrThrow(msg);
 
@@ -449,63 +577,62 @@ int main(int, char**) {
 					return;
 				}
 
-			auto collection = fmt::format("reminders_{}", chatId);
-			up::value value;
-			value = up::vm_fetch_all_records(db).fetch_value_or_throw(collection);
-
-			auto keyboard = std::make_shared<TgBot::InlineKeyboardMarkup>();
-			if (!value.is_array() || value.size() == 0) {
-				if (!query) {
-					bot.getApi().sendMessage(msg->chat->id, "⚠️ Нет напоминаний.");
-				} else {
-					setButton(keyboard, 0, keyboard->inlineKeyboard.size(),
-					    makeButon("Закрыть", fmt::format("/delete_me")));
-					bot.getApi().editMessageText("⚠️ Нет напоминаний.", chatId, msg->messageId, "", "", false, keyboard);
-				}
-
-				return;
-			}
-
 			constexpr int PAGE_SIZE = 10;
-			page = std::min<int>(page, (value.size() / PAGE_SIZE) + 1);
-
-			auto start = std::max<int>(0, (page - 1) * PAGE_SIZE);
-			auto end = std::min<int>(value.size(), page * PAGE_SIZE);
-
-			for (int i = start; i != end; ++i) {
-				ReminderInfo ri;
-				ri.fromValue(value.at(i));
-				setButton(keyboard, 0, i - start,
-				    makeButon(fmt::format("{}", ri.toString()), fmt::format("/del {}", ri._id)));
-			}
-			if (end - start < value.size()) {
-				if (start > 0 && end < value.size()) {
-					setButton(keyboard, 0, end - start, makeButon("<", fmt::format("/deli {}", page - 1)));
-					setButton(keyboard, 1, end - start, makeButon(">", fmt::format("/deli {}", page + 1)));
-				} else if (start > 0) {
-					setButton(keyboard, 0, end - start, makeButon("<", fmt::format("/deli {}", page - 1)));
-				} else if (end < value.size()) {
-					setButton(keyboard, 0, end - start, makeButon(">", fmt::format("/deli {}", page + 1)));
-				}
-			}
-			setButton(keyboard, 0, keyboard->inlineKeyboard.size(), makeButon("Отмена", fmt::format("/delete_me")));
+			auto rendered = pages.get(chatId, q.chatVersion(chatId), "deli", std::to_string(page), loadItems(chatId),
+			    [&](const PageCache::Items& items) {
+				    auto keyboard = std::make_shared<TgBot::InlineKeyboardMarkup>();
+				    if (items.empty()) {
+					    setButton(keyboard, 0, keyboard->inlineKeyboard.size(),
+					        makeButon("Закрыть", fmt::format("/delete_me")));
+					    return RenderedPage{"⚠️ Нет напоминаний.", serializeKeyboard(keyboard)};
+				    }
+
+				    const int size = items.size();
+				    const int clamped = std::min<int>(page, (size / PAGE_SIZE) + 1);
+				    auto start = std::max<int>(0, (clamped - 1) * PAGE_SIZE);
+				    auto end = std::min<int>(size, clamped * PAGE_SIZE);
+
+				    for (int i = start; i != end; ++i) {
+					    setButton(keyboard, 0, i - start,
+					        makeButon(fmt::format("{}", items[i].second), fmt::format("/del {}", items[i].first)));
+				    }
+				    if (end - start < size) {
+					    if (start > 0 && end < size) {
+						    setButton(keyboard, 0, end - start, makeButon("<", fmt::format("/deli {}", clamped - 1)));
+						    setButton(keyboard, 1, end - start, makeButon(">", fmt::format("/deli {}", clamped + 1)));
+					    } else if (start > 0) {
+						    setButton(keyboard, 0, end - start, makeButon("<", fmt::format("/deli {}", clamped - 1)));
+					    } else if (end < size) {
+						    setButton(keyboard, 0, end - start, makeButon(">", fmt::format("/deli {}", clamped + 1)));
+					    }
+				    }
+				    setButton(keyboard, 0, keyboard->inlineKeyboard.size(),
+				        makeButon("Отмена", fmt::format("/delete_me")));
+
+				    return RenderedPage{"🗑️ Какое напоминание удалить❓", serializeKeyboard(keyboard)};
+			    });
 
 			if (!query) {
-				bot.getApi().sendMessage(chatId, fmt::format("🗑️ Какое напоминание удалить❓"), false, 0, keyboard);
+				rawApi.sendMessage(chatId, rendered->text, rendered->markup);
 			} else {
-				bot.getApi().editMessageText(fmt::format("🗑️ Какое напоминание удалить❓"), chatId, msg->messageId, "",
-				    "", false, keyboard);
+				edits.editMessageText(chatId, msg->messageId, rendered->text, rendered->markup);
 			}
-		} catch (const std::exception& e) { std::cerr << e.what(); }
+		} catch (const std::exception& e) { logger().error("handler_failed handler={} chat={} error={}", "deli", chatOf(msg), e.what()); }
 	};
 
-	bot.getEvents().onCommand("start", start);
-	bot.getEvents().onCommand("list", list);
+	bot.getEvents().onCommand("start", locked(start));
+	bot.getEvents().onCommand("list", locked(list));
+	bot.getEvents().onCommand("tz", locked(tz));
+	bot.getEvents().onCommand("pre", locked(pre));
+	bot.getEvents().onCommand("export", locked(exportFile));
+	bot.getEvents().onCommand("import", locked(importFile));
 	// bot.getEvents().onCommand("add", [&](auto q) { add(q, nullptr); });
-	bot.getEvents().onCommand("del", [&](auto q) { del(q, nullptr); });
-	bot.getEvents().onCommand("deli", [&](auto q) { deli(q, 0); });
+	bot.getEvents().onCommand("del", locked([&](auto q) { del(q, nullptr); }));
+	bot.getEvents().onCommand("deli", locked([&](auto q) { deli(q, 0); }));
 
-	bot.getEvents().onCallbackQuery([&](CallbackQuery::Ptr query) {
+	// Callbacks are acknowledged before taking dbMutex, their edits go out on the edit queue.
+	auto onCallback = [&](CallbackQuery::Ptr query) {
+		TRACE_SCOPE("onCallbackQuery", "dispatch");
 		std::vector<std::string> args;
 		boost::split(args, query->data, [](char c) { return c == ' ' || c == '\n' || c == '\t'; });
 		if (args.empty() || !query->message || !query->message->chat) {
@@ -517,21 +644,30 @@ int main(int, char**) {
 		} else if (args.front() == "/deli") {
 			deli(query->message, query);
 		} else if (args.front() == "/delete_me") {
-			bot.getApi().deleteMessage(query->message->chat->id, query->message->messageId);
+			edits.deleteMessage(query->message->chat->id, query->message->messageId);
 		} else if (args.front() == "/ar_date") {
-			ar_date(bot, ds)(query);
+			ar_date(rawApi, edits, ds, kc, zones)(query);
 		} else if (args.front() == "/ar_time") {
-			ar_time(bot, ds)(query);
+			ar_time(rawApi, edits, ds, kc)(query);
 		} else if (args.front() == "/ar_repeat") {
-			ar_repeat(bot, ds)(query);
+			ar_repeat(rawApi, edits, ds, kc)(query);
 		} else if (args.front() == "/add") {
 			add(query->message, query);
 		}
+	};
+	bot.getEvents().onCallbackQuery([&](CallbackQuery::Ptr query) {
+		edits.acknowledge(query);
+		locked(onCallback)(query);
 	});
 
 	bot.getEvents().onAnyMessage([&](TgBot::Message::Ptr msg) {
+		TRACE_SCOPE("onAnyMessage", "dispatch");
 		auto [userId, chatId] = getUserChatOrThrow(msg);
 
+		if (msg->document && msg->caption.rfind("/import", 0) == 0) {
+			locked(importFile)(msg);
+			return;
+		}
 		if (msg->chat->type != Chat::Type::Private) {
 			return;
 		}
@@ -539,21 +675,231 @@ int main(int, char**) {
 			return;
 		}
 
-		sendAutoReminderMsg(bot, msg->chat->id, msg->text);
+		if (auto ri = parsePhrase(msg->text, zones.localNow(chatId))) {
+			sendParsedReminderMsg(rawApi, ds, dbMutex, chatId, *ri);
+		} else {
+			sendAutoReminderMsg(rawApi, kc, msg->chat->id, msg->text);
+		}
 	});
 
-	auto localTp = now();
+	const std::string snapshotPath = cfg.dir + "scheduler.snap";
+	const std::string walPath = cfg.dir + "scheduler.wal";
+	const std::string heartbeatPath = cfg.dir + "heartbeat";
+
+	// A follower keeps the primary's storage in its own files and the queue as the image recovery
+	// would read from disk, on takeover that image is the recovered queue. If the primary died in the
+	// middle of a resync the image is partial and the queue is rebuilt from the replicated storage.
+	std::optional<SchedulerSnapshot> replica;
+	std::optional<std::chrono::steady_clock::time_point> takeoverAt;
+	std::optional<PrimaryLock> followedLock; // kept so the dead primary can't come back as a second one
+	if (!followSocket.empty()) {
+		std::map<std::int64_t, std::multimap<time_point_s, ReminderInfo>> image;
+		std::set<std::int64_t> stale;
+		ReplicationFollower follower(followSocket, {
+		    [&] {
+			    std::scoped_lock l(dbMutex);
+			    image.clear();
+			    stale.clear();
+			    for (const auto& uc : loadUserChats(db)) {
+				    stale.insert(uc.chatId);
+			    }
+		    },
+		    [&](const WalRecord& r) {
+			    if (r.op != WalOp::StoreChat) {
+				    applyWalRecord(image, r);
+				    return;
+			    }
+			    auto transfer = decodeChatTransfer(r.data);
+			    if (!transfer) {
+				    logger().error("replication_bad_record chat={} lsn={}", r.chatId, r.lsn);
+				    return;
+			    }
+			    std::scoped_lock l(dbMutex);
+			    if (transfer->withUsers && transfer->users.empty()) {
+				    dropChat(db, store, zones, transfer->chatId);
+			    } else {
+				    importChat(db, store, zones, *transfer);
+			    }
+			    stale.erase(transfer->chatId);
+		    },
+		    [&](std::uint64_t) {
+			    std::scoped_lock l(dbMutex);
+			    for (auto chatId : stale) {
+				    dropChat(db, store, zones, chatId);
+			    }
+			    stale.clear();
+		    },
+		});
+		logger().info("replication_following socket={}", followSocket);
+		const bool complete = follower.run(stopRequested);
+		if (stopRequested) {
+			return 0;
+		}
+		takeoverAt = std::chrono::steady_clock::now();
+		followedLock.emplace(follower.takeLock());
+		std::remove(snapshotPath.c_str());
+		std::remove(walPath.c_str());
+		if (complete) {
+			replica.emplace();
+			for (auto& [chatId, reminders] : image) {
+				for (auto& [tp, r] : reminders) {
+					replica->timers.push_back({chatId, tp, std::move(r)});
+				}
+			}
+		}
+		logger().warn("replication_takeover lsn={} timers={} queue={}", follower.appliedLsn(),
+		    replica ? replica->timers.size() : size_t(0), complete ? "warm" : "rebuild");
+	}
 
-	auto usersChats = loadUserChats(db);
-	for (const auto& uc : usersChats) {
-		auto rms = loadReminders(db, uc.chatId);
-		for (const auto& r : rms) {
-			auto nextTp = r.getNearTs(localTp);
-			if (nextTp > localTp) {
-				q.addTimer(uc.chatId, nextTp, r);
+	// The queue is recovered from the last checkpoint and the journal of changes made after it, the
+	// database is only rescanned if neither exists or the journal tail was torn by a crash.
+	const auto startedAt = std::chrono::steady_clock::now();
+	auto recovered = replica ? std::move(replica) : recoverScheduler(snapshotPath, walPath);
+	SchedulerWal wal(walPath, recovered ? recovered->lsn : 0);
+
+	// Occurrences that passed while the bot was down are sent as one summary per chat: from the
+	// recovered queue they are the timers already due, after a full scan those since the last heartbeat.
+	MissedByChat missed;
+	const auto startTp = clock.now();
+	if (recovered) {
+		missed = missedFromTimers(recovered->timers, zones, startTp);
+		q.addTimers(resumeTimers(std::move(recovered->timers), zones, startTp));
+	} else {
+		const auto lastAlive = readHeartbeat(heartbeatPath);
+		for (const auto& uc : loadUserChats(db)) {
+			if (lastAlive) {
+				addMissed(missed, uc.chatId, loadReminders(store, uc.chatId), zones.zone(uc.chatId), *lastAlive, startTp);
 			}
+			schedule(uc.chatId);
 		}
 	}
+	q.setJournal(&wal);
+
+	// Followers start from every chat's stored state and the queue as of the same journal record. The
+	// primary holds the socket's PrimaryLock while it runs, a follower that already took it over serving on
+	// the socket of the primary it followed has it already.
+	std::optional<PrimaryLock> primaryLock;
+	std::unique_ptr<ReplicationServer> replication;
+	if (const auto socketPath = findReplicationSocket(cfg.dir); !socketPath.empty()) {
+		if (socketPath != followSocket) {
+			primaryLock.emplace(socketPath);
+			if (!primaryLock->tryLock()) {
+				logger().error("replication_lock_held path={}.lock", socketPath);
+				return 1;
+			}
+		}
+		replication = std::make_unique<ReplicationServer>(socketPath, wal, [&] {
+			std::scoped_lock l(dbMutex);
+			ReplicationSnapshot snapshot;
+			auto [timers, lsn] = q.checkpoint();
+			snapshot.lsn = lsn;
+			std::map<std::int64_t, std::vector<std::int64_t>> users;
+			for (const auto& uc : loadUserChats(db)) {
+				users[uc.chatId].push_back(uc.userId);
+			}
+			for (auto& [chatId, userIds] : users) {
+				auto transfer = exportChat(db, store, zones, chatId, false);
+				transfer.users = std::move(userIds);
+				transfer.withUsers = true;
+				WalRecord r;
+				r.op = WalOp::StoreChat;
+				r.chatId = chatId;
+				r.data = encodeChatTransfer(transfer);
+				snapshot.records.push_back(std::move(r));
+			}
+			for (auto& t : timers) {
+				WalRecord r;
+				r.op = WalOp::Add;
+				r.chatId = t.chatId;
+				r.tp = t.tp;
+				r.reminder = std::move(t.reminder);
+				snapshot.records.push_back(std::move(r));
+			}
+			return snapshot;
+		});
+		replicationJournal = &wal;
+	}
+
+	BatchSender catchUp([&](std::int64_t chatId, const std::string& text) { bot.getApi().sendMessage(chatId, text); },
+	    25, clock);
+	std::thread catchUpThread;
+	if (!missed.empty()) {
+		const auto occurrences = enqueueMissed(catchUp, missed);
+		logger().info("catch_up_started reminders={} chats={}", occurrences, missed.size());
+		catchUpThread = std::thread([&] { catchUp.drain(); });
+	}
+
+	// Chats registered while the rebuild runs are scheduled by their own handlers, so a chat is only
+	// cleared if it is still unregistered when its turn comes.
+	std::thread rebuildThread;
+	if (recovered && wal.hadTornTail()) {
+		rebuildThread = std::thread([&] {
+			std::vector<UserChat> usersChats;
+			{
+				std::scoped_lock l(dbMutex);
+				usersChats = loadUserChats(db);
+			}
+			std::unordered_set<std::int64_t> registered;
+			for (const auto& uc : usersChats) {
+				if (stopRequested) {
+					return;
+				}
+				registered.insert(uc.chatId);
+				std::scoped_lock l(dbMutex);
+				schedule(uc.chatId);
+			}
+			for (auto chatId : q.chats()) {
+				if (stopRequested) {
+					return;
+				}
+				std::scoped_lock l(dbMutex);
+				if (!registered.count(chatId) && !isChatRegistered(db, chatId)) {
+					q.clearChat(chatId);
+				}
+			}
+		});
+	}
+
+	// Timers moved by resumeTimers() aren't journaled, so the first checkpoint is written right away.
+	auto checkpoint = [&] {
+		auto [timers, lsn] = q.checkpoint();
+		if (!writeSchedulerSnapshot(snapshotPath, timers, clock.now(), lsn)) {
+			logger().error("snapshot_failed path={}", snapshotPath);
+			return;
+		}
+		wal.truncate(lsn);
+	};
+	std::mutex checkpointMutex;
+	std::condition_variable checkpointCond;
+	auto& logOverrunsGauge = metrics().gauge("log_overruns", "Log messages overwritten before they were written");
+	std::thread checkpointer([&] {
+		std::uint64_t written = 0;
+		std::unique_lock lk(checkpointMutex);
+		for (int tick = 0; !stopRequested; ++tick) {
+			if (tick % 60 == 0) {
+				if (auto version = q.version(); version != written) {
+					try {
+						checkpoint();
+					} catch (const std::exception& e) { logger().error("checkpoint_failed error={}", e.what()); }
+					written = version;
+				}
+				writeHeartbeat(heartbeatPath, clock.now());
+			} else {
+				wal.sync();
+			}
+			if (tick % 600 == 1) {
+				try {
+					maintenance.compactIfGrown();
+				} catch (const std::exception& e) { logger().error("db_compaction_failed error={}", e.what()); }
+			}
+			try {
+				std::scoped_lock l(dbMutex);
+				ds.flush();
+			} catch (const std::exception& e) { logger().error("dynamic_storage_flush_failed error={}", e.what()); }
+			logOverrunsGauge.set(static_cast<std::int64_t>(logOverruns()));
+			checkpointCond.wait_for(lk, std::chrono::seconds(1), [] { return stopRequested.load(); });
+		}
+	});
 
 	std::vector<BotCommand::Ptr> commands;
 	BotCommand::Ptr cmdArray(new BotCommand);
@@ -576,6 +922,26 @@ int main(int, char**) {
 	// cmdArray->description = "Удаление напоминания по id. /del [id]";
 	// commands.push_back(cmdArray);
 
+	cmdArray = BotCommand::Ptr(new BotCommand);
+	cmdArray->command = "tz";
+	cmdArray->description = "Часовой пояс чата. /tz [опц. зона, пр. Europe/Moscow]";
+	commands.push_back(cmdArray);
+
+	cmdArray = BotCommand::Ptr(new BotCommand);
+	cmdArray->command = "pre";
+	cmdArray->description = "Предварительные напоминания. /pre [id] [опц. минуты через запятую, пр. 15,60]";
+	commands.push_back(cmdArray);
+
+	cmdArray = BotCommand::Ptr(new BotCommand);
+	cmdArray->command = "export";
+	cmdArray->description = "Выгрузка напоминаний в файл. /export [опц. csv или ics]";
+	commands.push_back(cmdArray);
+
+	cmdArray = BotCommand::Ptr(new BotCommand);
+	cmdArray->command = "import";
+	cmdArray->description = "Загрузка напоминаний из файла .csv или .ics с подписью /import";
+	commands.push_back(cmdArray);
+
 	cmdArray = BotCommand::Ptr(new BotCommand);
 	cmdArray->command = "deli";
 	cmdArray->description = "Интерактивное удаление напоминания. /deli";
@@ -586,15 +952,139 @@ int main(int, char**) {
 	// cmdArray->description = "Информация о формате команды /add.";
 	// commands.push_back(cmdArray);
 
-	bot.getApi().setMyCommands(commands);
+	try {
+		bot.getApi().setMyCommands(commands);
+	} catch (const std::exception& e) { logger().error("set_commands_failed bot={} error={}", cfg.name, e.what()); }
+
+	// Updates are polled here rather than by TgLongPoll so that redelivered updates and double taps on a
+	// button (same chat, message and data) are dropped before any handler runs. A dropped tap is still
+	// acknowledged, or the client keeps its spinner.
+	IdempotencyFilter seenUpdates(std::chrono::minutes(10), 100000);
+	IdempotencyFilter seenTaps(std::chrono::seconds(3), 1000);
+	auto& duplicateUpdates = metrics().counter("duplicates_dropped_total", "Updates dropped as repeats", "kind=\"update\"");
+	auto& duplicateTaps = metrics().counter("duplicates_dropped_total", "Updates dropped as repeats", "kind=\"tap\"");
+	auto fresh = [&](const Update::Ptr& update) {
+		if (!seenUpdates.accept(static_cast<std::uint64_t>(static_cast<std::uint32_t>(update->updateId)))) {
+			duplicateUpdates.inc();
+			return false;
+		}
+		const auto& query = update->callbackQuery;
+		if (query && query->message && query->message->chat &&
+		    !seenTaps.accept(fmt::format("{}:{}:{}", query->message->chat->id, query->message->messageId, query->data))) {
+			duplicateTaps.inc();
+			edits.acknowledge(query);
+			return false;
+		}
+		return true;
+	};
+
+	shared.scheduler.add(q);
+	logger().info("started bot={} ms_to_first_poll={} recovery={}", cfg.name,
+	    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startedAt).count(),
+	    takeoverAt ? "takeover" : recovered ? "checkpoint" : "full_scan");
+	if (takeoverAt) {
+		metrics()
+		    .histogram("replication_takeover_seconds", "Follower takeover to the first poll", {0.01, 0.1, 1, 10})
+		    .observe(std::chrono::steady_clock::now() - *takeoverAt);
+	}
+	std::int32_t offset = 0;
+	while (!stopRequested) {
+		try {
+			for (const auto& update : bot.getApi().getUpdates(offset, 100, 10)) {
+				offset = std::max(offset, update->updateId + 1);
+				if (fresh(update)) {
+					bot.getEventHandler().handleUpdate(update);
+				}
+			}
+		} catch (const std::exception& e) { logger().error("poll_failed offset={} error={}", offset, e.what()); }
+	}
+
+	logger().info("stopping bot={}", cfg.name);
+	edits.stop();
+	if (replication) {
+		replicationJournal = nullptr;
+		replication->stop();
+	}
+	if (rebuildThread.joinable()) {
+		rebuildThread.join();
+	}
+	q.stop();
+	shared.scheduler.remove(q);
+	checkpointCond.notify_all();
+	checkpointer.join();
+	checkpoint();
+	writeHeartbeat(heartbeatPath, clock.now());
+	catchUp.stop();
+	if (catchUpThread.joinable()) {
+		catchUpThread.join();
+	}
+	logger().info("stopped bot={}", cfg.name);
+	return 0;
+}
 
-	std::thread t([&q] { q.run(); });
-	TgLongPoll longPoll(bot);
-	printf("Start bot.\n");
-	while (true) {
+int main(int argc, char** argv) {
+	signal(SIGINT, [](int) {
+		if (stopRequested.exchange(true)) {
+			_exit(1);
+		}
+	});
+	TRACE_DUMP_ON_SIGNAL(SIGUSR1, "trace.json");
+
+	if (argc == 3 && std::string(argv[1]) == "--front") {
+		return runShardFront(argv[0], std::stoul(argv[2]), stopRequested);
+	}
+	// A hot standby follows the primary listening on the socket until it is gone, then takes over.
+	const std::string followSocket = argc == 3 && std::string(argv[1]) == "--follow" ? argv[2] : "";
+	// A standby follows one bot, with a "bots" file it is refused rather than started as a primary.
+	const auto bots = findBots();
+	if (!followSocket.empty() && !bots.empty()) {
+		logger().error("follow_with_bots_file socket={}", followSocket);
+		return 1;
+	}
+
+	CurlHttpClient curlHttpClient;
+	InstrumentedHttpClient httpClient(curlHttpClient);
+	EditWorkers editWorkers;
+	SchedulerGroup scheduler;
+	HttpRoutes routes(
+	    [](const HttpRequest&) { return HttpResponse{200, "text/plain; version=0.0.4", metrics().render()}; });
+	std::unique_ptr<HttpServer> metricsServer;
+	if (auto port = findMetricsPort()) {
 		try {
-			longPoll.start();
-		} catch (const std::exception& e) { printf("error: %s\n", e.what()); }
+			metricsServer = std::make_unique<HttpServer>(
+			    "127.0.0.1", *port, [&routes](const HttpRequest& req) { return routes(req); });
+			if (*port == 0) {
+				std::ofstream("metrics_port.tmp") << metricsServer->port();
+				std::rename("metrics_port.tmp", "metrics_port.bound");
+			}
+		} catch (const std::exception& e) { logger().error("metrics_failed error={}", e.what()); }
 	}
-	t.detach();
+	SharedServices shared{httpClient, editWorkers, scheduler, routes};
+
+	// With a "bots" file every bot listed there polls on a thread of its own in bots/<name>/, a bot that
+	// fails to start is logged and the others keep running.
+	int status = 0;
+	if (bots.empty()) {
+		status = runBot({"", findToken(), findApiUrl(), ""}, shared, followSocket);
+	} else {
+		::mkdir("bots", 0755);
+		std::vector<std::thread> threads;
+		for (const auto& cfg : bots) {
+			::mkdir(cfg.dir.c_str(), 0755);
+			threads.emplace_back([&shared, &cfg] {
+				try {
+					runBot(cfg, shared, "");
+				} catch (const std::exception& e) { logger().error("bot_failed bot={} error={}", cfg.name, e.what()); }
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+
+	metricsServer.reset();
+	scheduler.stop();
+	editWorkers.stop();
+	spdlog::shutdown();
+	return status;
 }
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Metrics are registered once (under a mutex) and then updated through the returned references with
+// relaxed atomics only, so the hot paths never lock.
+
+class Counter {
+  public:
+	void inc(std::uint64_t v = 1) { _v.fetch_add(v, std::memory_order_relaxed); }
+	std::uint64_t value() const { return _v.load(std::memory_order_relaxed); }
+
+  private:
+	std::atomic<std::uint64_t> _v = 0;
+};
+
+class Gauge {
+  public:
+	void set(std::int64_t v) { _v.store(v, std::memory_order_relaxed); }
+	void add(std::int64_t v) { _v.fetch_add(v, std::memory_order_relaxed); }
+	std::int64_t value() const { return _v.load(std::memory_order_relaxed); }
+
+  private:
+	std::atomic<std::int64_t> _v = 0;
+};
+
+class Histogram {
+  public:
+	explicit Histogram(std::vector<double> bounds): _bounds(std::move(bounds)), _buckets(_bounds.size() + 1) {}
+
+	void observe(double v) {
+		auto i = std::lower_bound(_bounds.begin(), _bounds.end(), v) - _bounds.begin();
+		_buckets[i].fetch_add(1, std::memory_order_relaxed);
+		auto sum = _sum.load(std::memory_order_relaxed);
+		while (!_sum.compare_exchange_weak(sum, sum + v, std::memory_order_relaxed)) {}
+	}
+
+	template<class Rep, class Period>
+	void observe(std::chrono::duration<Rep, Period> d) {
+		observe(std::chrono::duration<double>(d).count());
+	}
+
+	const std::vector<double>& bounds() const { return _bounds; }
+	std::uint64_t bucket(size_t i) const { return _buckets[i].load(std::memory_order_relaxed); }
+	double sum() const { return _sum.load(std::memory_order_relaxed); }
+
+  private:
+	const std::vector<double> _bounds;
+	std::vector<std::atomic<std::uint64_t>> _buckets;
+	std::atomic<double> _sum = 0;
+};
+
+// Default buckets for latencies in seconds.
+inline std::vector<double> latencyBuckets() {
+	return {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+}
+
+class Metrics {
+  public:
+	// `labels` is the rendered label set without braces, e.g. `method="sendMessage"`.
+	Counter& counter(const std::string& name, const std::string& help, const std::string& labels = {}) {
+		return add<Counter>(name, help, "counter", labels, [] { return std::make_unique<Counter>(); });
+	}
+
+	Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = {}) {
+		return add<Gauge>(name, help, "gauge", labels, [] { return std::make_unique<Gauge>(); });
+	}
+
+	Histogram& histogram(const std::string& name, const std::string& help, std::vector<double> bounds,
+	    const std::string& labels = {}) {
+		return add<Histogram>(name, help, "histogram", labels,
+		    [&] { return std::make_unique<Histogram>(std::move(bounds)); });
+	}
+
+	// Prometheus text exposition format.
+	std::string render() const {
+		std::scoped_lock l(_m);
+
+		std::string out;
+		for (const auto& [name, family] : _families) {
+			out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", name, family.help, name, family.type);
+			for (const auto& s : family.series) {
+				const auto braces = s.labels.empty() ? std::string() : "{" + s.labels + "}";
+				if (auto c = std::get_if<std::unique_ptr<Counter>>(&s.metric)) {
+					out += fmt::format("{}{} {}\n", name, braces, (*c)->value());
+				} else if (auto g = std::get_if<std::unique_ptr<Gauge>>(&s.metric)) {
+					out += fmt::format("{}{} {}\n", name, braces, (*g)->value());
+				} else if (auto h = std::get_if<std::unique_ptr<Histogram>>(&s.metric)) {
+					const auto sep = s.labels.empty() ? "" : ",";
+					std::uint64_t cumulative = 0;
+					for (size_t i = 0; i != (*h)->bounds().size(); ++i) {
+						cumulative += (*h)->bucket(i);
+						out += fmt::format("{}_bucket{{{}{}le=\"{}\"}} {}\n", name, s.labels, sep, (*h)->bounds()[i],
+						    cumulative);
+					}
+					cumulative += (*h)->bucket((*h)->bounds().size());
+					out += fmt::format("{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, s.labels, sep, cumulative);
+					out += fmt::format("{}_sum{} {}\n{}_count{} {}\n", name, braces, (*h)->sum(), name, braces,
+					    cumulative);
+				}
+			}
+		}
+
+		return out;
+	}
+
+  private:
+	template<class M, class Make>
+	M& add(const std::string& name, const std::string& help, const char* type, const std::string& labels,
+	    Make&& make) {
+		std::scoped_lock l(_m);
+
+		auto& family = _families[name];
+		if (family.type.empty()) {
+			family.help = help;
+			family.type = type;
+		}
+		for (auto& s : family.series) {
+			if (s.labels == labels) {
+				if (auto m = std::get_if<std::unique_ptr<M>>(&s.metric)) {
+					return **m;
+				}
+			}
+		}
+		auto m = make();
+		auto& ref = *m;
+		family.series.push_back(Series{labels, std::move(m)});
+
+		return ref;
+	}
+
+  private:
+	struct Series {
+		std::string labels;
+		std::variant<std::unique_ptr<Counter>, std::unique_ptr<Gauge>, std::unique_ptr<Histogram>> metric;
+	};
+	struct Family {
+		std::string help;
+		std::string type;
+		std::deque<Series> series;
+	};
+
+	mutable std::mutex _m;
+	std::map<std::string, Family> _families;
+};
+
+inline Metrics& metrics() {
+	static Metrics m;
+
+	return m;
+}
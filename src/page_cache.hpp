@@ -0,0 +1,105 @@
+#pragma once
+
+#include "metrics.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct RenderedPage {
+	std::string text;
+	std::string markup; // reply_markup JSON, empty for none
+};
+
+// Rendered /list and /deli pages per chat. Every entry is tagged with the chat's version (the
+// scheduler bumps it on add, delete and fire), a lookup with a newer version drops the chat's pages
+// and renders again, so paging through an unchanged chat is a map lookup.
+class PageCache {
+  public:
+	using Page = std::shared_ptr<const RenderedPage>;
+	using Items = std::vector<std::pair<std::int64_t /*id*/, std::string /*toString()*/>>;
+
+	explicit PageCache(size_t maxChats = 4096): _maxChats(maxChats) {}
+
+	// `load` reads the chat's reminders once per version, `render` builds page `key` of `view` from them.
+	template<class Load, class Render>
+	Page get(std::int64_t chatId, std::uint64_t version, const std::string& view, const std::string& key, Load&& load,
+	    Render&& render) {
+		const auto pageKey = view + ' ' + key;
+		std::shared_ptr<const Items> items;
+		{
+			std::scoped_lock l(_m);
+			auto found = _chats.find(chatId);
+			if (found != _chats.end() && found->second.version == version) {
+				auto page = found->second.pages.find(pageKey);
+				if (page != found->second.pages.end()) {
+					counters(view).first->inc();
+					return page->second;
+				}
+				items = found->second.items;
+			}
+			counters(view).second->inc();
+		}
+
+		if (!items) {
+			TRACE_SCOPE("PageCache::load", "page_cache", chatId);
+			items = std::make_shared<const Items>(load());
+		}
+		Page page;
+		{
+			TRACE_SCOPE("PageCache::render", "page_cache", chatId);
+			page = std::make_shared<const RenderedPage>(render(*items));
+		}
+
+		std::scoped_lock l(_m);
+		auto found = _chats.find(chatId);
+		if (found == _chats.end() || found->second.version < version) {
+			if (found == _chats.end() && _chats.size() >= _maxChats) {
+				_chats.clear();
+			}
+			found = _chats.insert_or_assign(chatId, ChatPages{version, items, {}}).first;
+		}
+		if (found->second.version == version) {
+			if (found->second.pages.size() >= MAX_PAGES_PER_CHAT) {
+				found->second.pages.clear();
+			}
+			found->second.pages.emplace(pageKey, page);
+		}
+
+		return page;
+	}
+
+  private:
+	static constexpr size_t MAX_PAGES_PER_CHAT = 64;
+
+	// Hit and miss counters of a view.
+	std::pair<Counter*, Counter*> counters(const std::string& view) {
+		auto& c = _counters[view];
+		if (!c.first) {
+			c.first = &metrics().counter("page_cache_requests_total", "Rendered page lookups",
+			    fmt::format("view=\"{}\",result=\"hit\"", view));
+			c.second = &metrics().counter("page_cache_requests_total", "Rendered page lookups",
+			    fmt::format("view=\"{}\",result=\"miss\"", view));
+		}
+		return c;
+	}
+
+	struct ChatPages {
+		std::uint64_t version = 0;
+		std::shared_ptr<const Items> items;
+		std::unordered_map<std::string, Page> pages;
+	};
+
+	std::mutex _m;
+	const size_t _maxChats;
+	std::unordered_map<std::int64_t, ChatPages> _chats;
+	std::unordered_map<std::string, std::pair<Counter*, Counter*>> _counters;
+};
@@ -0,0 +1,775 @@
+#pragma once
+
+#include "flat_hash_map.hpp"
+#include "reminder_info.hpp"
+#include "utils.hpp"
+
+#include <date/date.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A word the phrase parser knows. `part` is the day part the word means after an hour ("в 3 дня"), for
+// words that are something else on their own ("через 2 дня").
+struct PhraseWord {
+	enum Kind : std::uint8_t {
+		Filler,   // "напомни", "remind", skipped at the start of the phrase
+		At,       // "в", "at", "on": joins the date or time that follows
+		In,       // "через", "in": a duration follows
+		Every,    // "каждый", "every"
+		By,       // "по" of "по понедельникам", "по будням"
+		Next,     // "следующий", "next" before a weekday
+		And,      // "и", "and" in a list of weekdays
+		Article,  // "a", "an" of "in an hour"
+		Day,      // value: days from today
+		Weekday,  // value: 0 for Monday .. 6
+		Weekdays, // value: 0 for Monday .. 6, plural forms that mean a repeat
+		Month,    // value: 1 .. 12
+		Unit,     // value: PhraseUnit
+		Half,     // "полчаса"
+		DayPart,  // value: PhrasePart, on its own or after an hour
+		Meridiem, // value: PhrasePart, only after an hour
+		Clock,    // value: minutes of the day, "полдень", "noon"
+		Repeat,   // value: PhraseRepeat
+	};
+
+	Kind kind;
+	std::int8_t value = 0;
+	std::int8_t part = -1;
+	bool weak = false; // only after At, Every, By or Next: "sun", "sat" are words as well
+};
+
+enum PhraseUnit : std::int8_t { Minutes, Hours, Days, Weeks, Months, Years };
+enum PhrasePart : std::int8_t { Morning, Afternoon, Evening, Night };
+enum PhraseRepeat : std::int8_t { Daily, Weekly, Monthly, Yearly, Workdays, Weekends };
+
+inline const FlatHashMap<std::string_view, PhraseWord>& phraseWords() {
+	using W = PhraseWord;
+	static const auto words = [] {
+		const std::pair<std::string_view, PhraseWord> table[] = {
+		    {"напомни", {W::Filler}}, {"напомнить", {W::Filler}}, {"напоминание", {W::Filler}}, {"мне", {W::Filler}},
+		    {"remind", {W::Filler}}, {"me", {W::Filler}}, {"to", {W::Filler}},
+
+		    {"в", {W::At}}, {"во", {W::At}}, {"на", {W::At}}, {"к", {W::At}}, {"at", {W::At}}, {"on", {W::At}},
+		    {"через", {W::In}}, {"in", {W::In}},
+		    {"каждый", {W::Every}}, {"каждую", {W::Every}}, {"каждое", {W::Every}}, {"каждые", {W::Every}},
+		    {"every", {W::Every}}, {"each", {W::Every}},
+		    {"по", {W::By}},
+		    {"следующий", {W::Next}}, {"следующую", {W::Next}}, {"следующее", {W::Next}}, {"next", {W::Next}},
+		    {"и", {W::And}}, {"and", {W::And}},
+		    {"a", {W::Article}}, {"an", {W::Article}},
+
+		    {"сегодня", {W::Day, 0}}, {"завтра", {W::Day, 1}}, {"послезавтра", {W::Day, 2}},
+		    {"today", {W::Day, 0}}, {"tonight", {W::Day, 0, Evening}}, {"tomorrow", {W::Day, 1}},
+
+		    {"понедельник", {W::Weekday, 0}}, {"вторник", {W::Weekday, 1}}, {"среду", {W::Weekday, 2}},
+		    {"среда", {W::Weekday, 2}}, {"четверг", {W::Weekday, 3}}, {"пятницу", {W::Weekday, 4}},
+		    {"пятница", {W::Weekday, 4}}, {"субботу", {W::Weekday, 5}}, {"суббота", {W::Weekday, 5}},
+		    {"воскресенье", {W::Weekday, 6}},
+		    {"пн", {W::Weekday, 0}}, {"вт", {W::Weekday, 1}}, {"ср", {W::Weekday, 2}}, {"чт", {W::Weekday, 3}},
+		    {"пт", {W::Weekday, 4}}, {"сб", {W::Weekday, 5}}, {"вс", {W::Weekday, 6}},
+		    {"monday", {W::Weekday, 0}}, {"tuesday", {W::Weekday, 1}}, {"wednesday", {W::Weekday, 2}},
+		    {"thursday", {W::Weekday, 3}}, {"friday", {W::Weekday, 4}}, {"saturday", {W::Weekday, 5}},
+		    {"sunday", {W::Weekday, 6}},
+		    {"mon", {W::Weekday, 0, -1, true}}, {"tue", {W::Weekday, 1, -1, true}}, {"wed", {W::Weekday, 2, -1, true}},
+		    {"thu", {W::Weekday, 3, -1, true}}, {"fri", {W::Weekday, 4, -1, true}}, {"sat", {W::Weekday, 5, -1, true}},
+		    {"sun", {W::Weekday, 6, -1, true}},
+		    {"понедельникам", {W::Weekdays, 0}}, {"вторникам", {W::Weekdays, 1}}, {"средам", {W::Weekdays, 2}},
+		    {"четвергам", {W::Weekdays, 3}}, {"пятницам", {W::Weekdays, 4}}, {"субботам", {W::Weekdays, 5}},
+		    {"воскресеньям", {W::Weekdays, 6}},
+		    {"mondays", {W::Weekdays, 0}}, {"tuesdays", {W::Weekdays, 1}}, {"wednesdays", {W::Weekdays, 2}},
+		    {"thursdays", {W::Weekdays, 3}}, {"fridays", {W::Weekdays, 4}}, {"saturdays", {W::Weekdays, 5}},
+		    {"sundays", {W::Weekdays, 6}},
+
+		    {"января", {W::Month, 1}}, {"февраля", {W::Month, 2}}, {"марта", {W::Month, 3}},
+		    {"апреля", {W::Month, 4}}, {"мая", {W::Month, 5}}, {"июня", {W::Month, 6}}, {"июля", {W::Month, 7}},
+		    {"августа", {W::Month, 8}}, {"сентября", {W::Month, 9}}, {"октября", {W::Month, 10}},
+		    {"ноября", {W::Month, 11}}, {"декабря", {W::Month, 12}},
+		    {"янв", {W::Month, 1}}, {"фев", {W::Month, 2}}, {"мар", {W::Month, 3}}, {"апр", {W::Month, 4}},
+		    {"июн", {W::Month, 6}}, {"июл", {W::Month, 7}}, {"авг", {W::Month, 8}}, {"сен", {W::Month, 9}},
+		    {"окт", {W::Month, 10}}, {"ноя", {W::Month, 11}}, {"дек", {W::Month, 12}},
+		    {"january", {W::Month, 1}}, {"february", {W::Month, 2}}, {"march", {W::Month, 3}},
+		    {"april", {W::Month, 4}}, {"may", {W::Month, 5}}, {"june", {W::Month, 6}}, {"july", {W::Month, 7}},
+		    {"august", {W::Month, 8}}, {"september", {W::Month, 9}}, {"october", {W::Month, 10}},
+		    {"november", {W::Month, 11}}, {"december", {W::Month, 12}},
+		    {"jan", {W::Month, 1}}, {"feb", {W::Month, 2}}, {"mar", {W::Month, 3}}, {"apr", {W::Month, 4}},
+		    {"jun", {W::Month, 6}}, {"jul", {W::Month, 7}}, {"aug", {W::Month, 8}}, {"sep", {W::Month, 9}},
+		    {"sept", {W::Month, 9}}, {"oct", {W::Month, 10}}, {"nov", {W::Month, 11}}, {"dec", {W::Month, 12}},
+
+		    {"минуту", {W::Unit, Minutes}}, {"минуты", {W::Unit, Minutes}}, {"минут", {W::Unit, Minutes}},
+		    {"мин", {W::Unit, Minutes}}, {"час", {W::Unit, Hours}}, {"часа", {W::Unit, Hours}},
+		    {"часов", {W::Unit, Hours}}, {"день", {W::Unit, Days}}, {"дня", {W::Unit, Days, Afternoon}},
+		    {"дней", {W::Unit, Days}}, {"неделю", {W::Unit, Weeks}}, {"недели", {W::Unit, Weeks}},
+		    {"недель", {W::Unit, Weeks}}, {"месяц", {W::Unit, Months}}, {"месяца", {W::Unit, Months}},
+		    {"месяцев", {W::Unit, Months}}, {"год", {W::Unit, Years}}, {"года", {W::Unit, Years}},
+		    {"лет", {W::Unit, Years}},
+		    {"minute", {W::Unit, Minutes}}, {"minutes", {W::Unit, Minutes}}, {"min", {W::Unit, Minutes}},
+		    {"mins", {W::Unit, Minutes}}, {"hour", {W::Unit, Hours}}, {"hours", {W::Unit, Hours}},
+		    {"day", {W::Unit, Days}}, {"days", {W::Unit, Days}}, {"week", {W::Unit, Weeks}},
+		    {"weeks", {W::Unit, Weeks}}, {"month", {W::Unit, Months}}, {"months", {W::Unit, Months}},
+		    {"year", {W::Unit, Years}}, {"years", {W::Unit, Years}},
+		    {"полчаса", {W::Half}},
+
+		    {"утра", {W::DayPart, Morning}}, {"утром", {W::DayPart, Morning}}, {"днем", {W::DayPart, Afternoon}},
+		    {"вечера", {W::DayPart, Evening}}, {"вечером", {W::DayPart, Evening}}, {"ночи", {W::DayPart, Night}},
+		    {"ночью", {W::DayPart, Night}}, {"morning", {W::DayPart, Morning}},
+		    {"afternoon", {W::DayPart, Afternoon}}, {"evening", {W::DayPart, Evening}},
+		    {"night", {W::DayPart, Night}},
+		    {"am", {W::Meridiem, Morning}}, {"pm", {W::Meridiem, Evening}},
+		    {"полдень", {W::Clock, 0}}, {"noon", {W::Clock, 0}}, {"полночь", {W::Clock, 1}},
+		    {"midnight", {W::Clock, 1}},
+
+		    {"ежедневно", {W::Repeat, Daily}}, {"daily", {W::Repeat, Daily}},
+		    {"еженедельно", {W::Repeat, Weekly}}, {"weekly", {W::Repeat, Weekly}},
+		    {"ежемесячно", {W::Repeat, Monthly}}, {"monthly", {W::Repeat, Monthly}},
+		    {"ежегодно", {W::Repeat, Yearly}}, {"yearly", {W::Repeat, Yearly}}, {"annually", {W::Repeat, Yearly}},
+		    {"будням", {W::Repeat, Workdays}}, {"weekdays", {W::Repeat, Workdays}},
+		    {"выходным", {W::Repeat, Weekends}}, {"weekends", {W::Repeat, Weekends}},
+		};
+		FlatHashMap<std::string_view, PhraseWord> words;
+		for (const auto& [word, meaning] : table) {
+			words.insert_or_assign(word, meaning);
+		}
+		return words;
+	}();
+	return words;
+}
+
+// Reads a reminder from a free text phrase in Russian or English: "завтра в 9 позвонить маме", "каждый
+// понедельник 10:30 планёрка", "через 15 минут выключить плиту", "every friday at 6pm gym". Words are looked
+// up in phraseWords() and a few rules combine them with the numbers, times and dates around; the words no
+// rule took are the description. Dates are day first. A time without a date is its next occurrence, a date
+// or weekday without a time is at 9:00.
+class PhraseParser {
+  public:
+	static constexpr int DEFAULT_MINUTES = 9 * 60;
+
+	PhraseParser(std::string_view text, time_point_s localNow): _now(localNow) { tokenize(text); }
+
+	// Empty if the phrase names no date, time or repeat, or a one-shot time of today that has passed ("сегодня
+	// в 9" at 10:00), which /add would reject.
+	std::optional<ReminderInfo> parse() {
+		size_t i = 0;
+		for (; i != _tokens.size() && is(i, PhraseWord::Filler); ++i) {
+			_tokens[i].taken = true;
+		}
+		for (; i < _tokens.size(); ++i) {
+			if (auto n = when(i)) {
+				take(i, n);
+				i += n - 1;
+			}
+		}
+		if (!_found) {
+			return {};
+		}
+		return resolve();
+	}
+
+  private:
+	struct Token {
+		std::string_view raw;
+		std::string word; // lower case, ё as е, without the punctuation around
+		const PhraseWord* meaning = nullptr;
+		bool taken = false;
+	};
+
+	struct Clock {
+		int minutes;
+		std::optional<std::int8_t> part;
+	};
+
+	void tokenize(std::string_view text) {
+		size_t pos = 0;
+		while (pos < text.size()) {
+			while (pos < text.size() && isSpace(text[pos])) {
+				++pos;
+			}
+			auto end = pos;
+			while (end < text.size() && !isSpace(text[end])) {
+				++end;
+			}
+			if (end == pos) {
+				break;
+			}
+			Token t;
+			t.raw = text.substr(pos, end - pos);
+			t.word = fold(trim(t.raw));
+			if (auto found = phraseWords().find(t.word); found != phraseWords().end()) {
+				t.meaning = &found->second;
+			}
+			_tokens.push_back(std::move(t));
+			pos = end;
+		}
+	}
+
+	static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r'; }
+
+	static std::string_view trim(std::string_view w) {
+		static constexpr std::string_view lead = "\"'(", trail = ".,!?;:)\"'";
+		static constexpr std::string_view quoteOpen = "\xC2\xAB", quoteClose = "\xC2\xBB"; // « »
+		while (!w.empty() && lead.find(w.front()) != std::string_view::npos) {
+			w.remove_prefix(1);
+		}
+		if (w.substr(0, 2) == quoteOpen) {
+			w.remove_prefix(2);
+		}
+		while (!w.empty() && trail.find(w.back()) != std::string_view::npos) {
+			w.remove_suffix(1);
+		}
+		if (w.size() >= 2 && w.substr(w.size() - 2) == quoteClose) {
+			w.remove_suffix(2);
+		}
+		return w;
+	}
+
+	// Lower case for ASCII and Cyrillic, ё folded to е.
+	static std::string fold(std::string_view w) {
+		std::string out;
+		out.reserve(w.size());
+		for (size_t i = 0; i != w.size(); ++i) {
+			const auto c = static_cast<unsigned char>(w[i]);
+			const auto d = i + 1 != w.size() ? static_cast<unsigned char>(w[i + 1]) : 0;
+			if (c >= 'A' && c <= 'Z') {
+				out += static_cast<char>(c + 32);
+			} else if (c == 0xD0 && d >= 0x90 && d <= 0x9F) { // А-П
+				out += '\xD0';
+				out += static_cast<char>(d + 0x20);
+				++i;
+			} else if (c == 0xD0 && d >= 0xA0 && d <= 0xAF) { // Р-Я
+				out += '\xD1';
+				out += static_cast<char>(d - 0x20);
+				++i;
+			} else if ((c == 0xD0 && d == 0x81) || (c == 0xD1 && d == 0x91)) { // Ё, ё
+				out += "\xD0\xB5";
+				++i;
+			} else {
+				out += static_cast<char>(c);
+			}
+		}
+		return out;
+	}
+
+	bool is(size_t i, PhraseWord::Kind kind) const {
+		return i < _tokens.size() && _tokens[i].meaning && _tokens[i].meaning->kind == kind;
+	}
+
+	bool weekday(size_t i) const { return is(i, PhraseWord::Weekday) || is(i, PhraseWord::Weekdays); }
+
+	const PhraseWord& meaning(size_t i) const { return *_tokens[i].meaning; }
+
+	void take(size_t i, size_t n) {
+		for (size_t j = i; j != i + n; ++j) {
+			_tokens[j].taken = true;
+		}
+		_found = true;
+	}
+
+	static std::optional<int> number(std::string_view w, size_t maxDigits = 4) {
+		for (auto suffix : {"st", "nd", "rd", "th"}) {
+			if (w.size() > 2 && w.substr(w.size() - 2) == suffix) {
+				w.remove_suffix(2);
+				break;
+			}
+		}
+		if (w.empty() || w.size() > maxDigits) {
+			return {};
+		}
+		int n = 0;
+		for (char c : w) {
+			if (c < '0' || c > '9') {
+				return {};
+			}
+			n = n * 10 + (c - '0');
+		}
+		return n;
+	}
+
+	// "10:30", "9am", "6:30pm"; "9.30" too after At, where it isn't a date.
+	static std::optional<Clock> clock(std::string_view w, bool afterAt) {
+		std::optional<std::int8_t> part;
+		if (w.size() > 2 && (w.substr(w.size() - 2) == "am" || w.substr(w.size() - 2) == "pm")) {
+			part = w[w.size() - 2] == 'a' ? Morning : Evening;
+			w.remove_suffix(2);
+		}
+		auto sep = w.find(':');
+		if (sep == std::string_view::npos && afterAt) {
+			sep = w.find('.');
+		}
+		std::optional<int> h, m = 0;
+		if (sep == std::string_view::npos) {
+			if (!part) {
+				return {};
+			}
+			h = number(w, 2);
+		} else {
+			h = number(w.substr(0, sep), 2);
+			m = w.size() - sep - 1 == 2 ? number(w.substr(sep + 1), 2) : std::nullopt;
+		}
+		if (!h || !m || *h > 23 || *m > 59 || (part && *h > 12)) {
+			return {};
+		}
+		return Clock{*h * 60 + *m, part};
+	}
+
+	// "23.12", "23.12.2026", "23/12/26", "2026-12-23".
+	static std::optional<date::year_month_day> dateToken(std::string_view w, bool& withYear) {
+		const auto sep = w.find_first_of("./-");
+		if (sep == std::string_view::npos) {
+			return {};
+		}
+		const char c = w[sep];
+		std::vector<std::string_view> parts;
+		for (size_t start = 0;;) {
+			const auto next = w.find(c, start);
+			parts.push_back(w.substr(start, next - start));
+			if (next == std::string_view::npos) {
+				break;
+			}
+			start = next + 1;
+		}
+		std::optional<int> d, m, y;
+		if (c == '-' && parts.size() == 3 && parts[0].size() == 4) {
+			y = number(parts[0]), m = number(parts[1], 2), d = number(parts[2], 2);
+		} else if (c != '-' && (parts.size() == 2 || parts.size() == 3)) {
+			d = number(parts[0], 2), m = number(parts[1], 2);
+			y = parts.size() == 3 ? number(parts[2]) : 0;
+		}
+		if (!d || !m || !y) {
+			return {};
+		}
+		withYear = *y != 0;
+		return ymd(*d, *m, *y < 100 && withYear ? *y + 2000 : *y);
+	}
+
+	static std::optional<date::year_month_day> ymd(int d, int m, int y) {
+		date::year_month_day out{date::year(y), date::month(static_cast<unsigned>(m)),
+		    date::day(static_cast<unsigned>(d))};
+		return out.ok() ? std::optional(out) : std::nullopt;
+	}
+
+	// Hour as said with a day part: "3 дня" is 15:00, "12 ночи" midnight, "2 ночи" 2:00.
+	static int withPart(int minutes, std::int8_t part) {
+		auto h = minutes / 60;
+		if (part == Morning && h == 12) {
+			h = 0;
+		} else if ((part == Afternoon || part == Evening) && h >= 1 && h < 12) {
+			h += 12;
+		} else if (part == Night && h >= 6 && h <= 12) {
+			h = (h + 12) % 24;
+		}
+		return h * 60 + minutes % 60;
+	}
+
+	// Day part after an hour at `i`: "утра", "pm"; "дня" only with `units`, "осталось 2 дня" is no time.
+	std::optional<std::int8_t> partAt(size_t i, bool units = true) const {
+		if (i >= _tokens.size() || !_tokens[i].meaning) {
+			return {};
+		}
+		const auto& w = meaning(i);
+		if (w.kind == PhraseWord::DayPart || w.kind == PhraseWord::Meridiem) {
+			return w.value;
+		}
+		return units && w.part >= 0 ? std::optional(w.part) : std::nullopt;
+	}
+
+	// Sets the time from the clock and an optional "часов"/day part after it, returns the tokens taken after
+	// `i`.
+	size_t setTime(Clock c, size_t i) {
+		size_t n = 0;
+		if (is(i, PhraseWord::Unit) && meaning(i).value == Hours && c.minutes % 60 == 0) {
+			++n;
+		}
+		if (!c.part) {
+			if (auto part = partAt(i + n)) {
+				c.part = part;
+				++n;
+			}
+		}
+		_minutes = c.part ? withPart(c.minutes, *c.part) : c.minutes;
+		_partGiven = c.part.has_value();
+		return n;
+	}
+
+	// Weekday list from `i` on: "понедельник", "пн ср", "mondays and fridays".
+	size_t weekdays(size_t i, int& mask) const {
+		size_t n = 0;
+		while (weekday(i + n)) {
+			mask |= 1 << meaning(i + n).value;
+			++n;
+			if (is(i + n, PhraseWord::And) && weekday(i + n + 1)) {
+				++n;
+			}
+		}
+		return n;
+	}
+
+	bool repeats() const { return _dayRepeat || _monthRepeat || _yearRepeat || _weekMask || _weekly; }
+
+	// Tokens taken by the rule matching at `i`, 0 if none does.
+	size_t when(size_t i, bool afterConnector = false) {
+		const auto& t = _tokens[i];
+		if (!t.meaning) {
+			return plain(i, afterConnector);
+		}
+		const auto& w = *t.meaning;
+		if (w.weak && !afterConnector) {
+			return 0;
+		}
+		switch (w.kind) {
+		case PhraseWord::At:
+			if (i + 1 < _tokens.size()) {
+				if (auto n = when(i + 1, true)) {
+					return n + 1;
+				}
+			}
+			return 0;
+		case PhraseWord::In:
+			if (auto n = duration(i + 1)) {
+				return n + 1;
+			}
+			return 0;
+		case PhraseWord::Every:
+			if (auto n = every(i + 1)) {
+				return n + 1;
+			}
+			return 0;
+		case PhraseWord::By: {
+			if (repeats() || i + 1 == _tokens.size()) {
+				return 0;
+			}
+			if (is(i + 1, PhraseWord::Repeat)) {
+				setRepeat(static_cast<PhraseRepeat>(meaning(i + 1).value));
+				return 2;
+			}
+			int mask = 0;
+			auto n = is(i + 1, PhraseWord::Weekdays) ? weekdays(i + 1, mask) : 0;
+			_weekMask |= mask;
+			return n ? n + 1 : 0;
+		}
+		case PhraseWord::Next:
+			if (is(i + 1, PhraseWord::Weekday) && !_weekday && !_date) {
+				_weekday = meaning(i + 1).value;
+				_nextWeek = true;
+				return 2;
+			}
+			return 0;
+		case PhraseWord::Day:
+			if (_dayOffset || _date) {
+				return 0;
+			}
+			_dayOffset = w.value;
+			if (w.part >= 0) {
+				_part = w.part;
+			}
+			return 1;
+		case PhraseWord::Weekday:
+		case PhraseWord::Weekdays: {
+			// "mondays", "в пн и ср": a plural or a list repeats weekly.
+			if (w.kind == PhraseWord::Weekdays || (is(i + 1, PhraseWord::And) && weekday(i + 2))) {
+				if (repeats()) {
+					return 0;
+				}
+				int mask = 0;
+				auto n = weekdays(i, mask);
+				_weekMask |= mask;
+				return n;
+			}
+			if (_weekday || _date || _dayOffset) {
+				return 0;
+			}
+			_weekday = w.value;
+			return 1;
+		}
+		case PhraseWord::Month:
+			// "march 5", "march 5 2027"
+			if (auto d = i + 1 < _tokens.size() ? number(_tokens[i + 1].word, 2) : std::nullopt; d && !_date) {
+				auto y = i + 2 < _tokens.size() ? number(_tokens[i + 2].word) : std::nullopt;
+				y = y && *y >= 2000 ? y : std::nullopt;
+				if (auto date = ymd(*d, w.value, y.value_or(2000))) {
+					_date = date;
+					_dateWithYear = y.has_value();
+					return y ? 3 : 2;
+				}
+			}
+			return 0;
+		case PhraseWord::Repeat:
+			if (repeats()) {
+				return 0;
+			}
+			setRepeat(static_cast<PhraseRepeat>(w.value));
+			return 1;
+		case PhraseWord::DayPart:
+			if (_part) {
+				return 0;
+			}
+			_part = w.value;
+			return 1;
+		case PhraseWord::Clock:
+			if (_minutes) {
+				return 0;
+			}
+			_minutes = w.value == 0 ? 12 * 60 : 0;
+			_partGiven = true;
+			return 1;
+		default:
+			return 0;
+		}
+	}
+
+	// A token not in the table: a clock, a date, or a number followed by a month or a day part.
+	size_t plain(size_t i, bool afterAt) {
+		const auto& w = _tokens[i].word;
+		if (auto c = clock(w, afterAt); c && !_minutes) {
+			return 1 + setTime(*c, i + 1);
+		}
+		bool withYear = false;
+		if (auto d = dateToken(w, withYear); d && !_date) {
+			_date = d;
+			_dateWithYear = withYear;
+			return 1;
+		}
+		auto n = number(w, 2);
+		if (!n) {
+			return 0;
+		}
+		// "5 марта", "5 марта 2027"
+		if (is(i + 1, PhraseWord::Month) && !_date) {
+			auto y = i + 2 < _tokens.size() ? number(_tokens[i + 2].word) : std::nullopt;
+			y = y && *y >= 2000 ? y : std::nullopt;
+			if (auto date = ymd(*n, meaning(i + 1).value, y.value_or(2000))) {
+				_date = date;
+				_dateWithYear = y.has_value();
+				return y ? 3 : 2;
+			}
+			return 0;
+		}
+		// "в 9", "9 вечера", "at 6 pm"
+		if (*n <= 23 && !_minutes && (afterAt || partAt(i + 1, false))) {
+			return 1 + setTime(Clock{*n * 60, std::nullopt}, i + 1);
+		}
+		return 0;
+	}
+
+	// "15 минут", "час", "полчаса", "an hour", "2 дня" after In.
+	size_t duration(size_t i) {
+		if (_after || _afterMonths || i >= _tokens.size()) {
+			return 0;
+		}
+		if (is(i, PhraseWord::Half)) {
+			_after = std::chrono::minutes(30);
+			return 1;
+		}
+		int count = 1;
+		size_t n = 0;
+		if (auto c = number(_tokens[i].word)) {
+			count = *c;
+			n = 1;
+		} else if (is(i, PhraseWord::Article)) {
+			n = 1;
+		}
+		if (!is(i + n, PhraseWord::Unit) || count <= 0) {
+			return 0;
+		}
+		switch (meaning(i + n).value) {
+		case Minutes:
+			_after = std::chrono::minutes(count);
+			break;
+		case Hours:
+			_after = std::chrono::hours(count);
+			break;
+		case Days:
+			_afterDays = count;
+			break;
+		case Weeks:
+			_afterDays = count * 7;
+			break;
+		case Months:
+			_afterMonths = count;
+			break;
+		case Years:
+			_afterMonths = count * 12;
+			break;
+		}
+		return n + 1;
+	}
+
+	// "день", "2 дня", "неделю", "месяц", "год", "понедельник и пятницу" after Every.
+	size_t every(size_t i) {
+		if (repeats() || i >= _tokens.size()) {
+			return 0;
+		}
+		if (weekday(i)) {
+			int mask = 0;
+			auto n = weekdays(i, mask);
+			_weekMask = mask;
+			return n;
+		}
+		int count = 1;
+		size_t n = 0;
+		if (auto c = number(_tokens[i].word, 3)) {
+			count = *c;
+			n = 1;
+		}
+		if (!is(i + n, PhraseWord::Unit) || count <= 0) {
+			return 0;
+		}
+		switch (meaning(i + n).value) {
+		case Days:
+			_dayRepeat = count;
+			break;
+		case Weeks:
+			if (count == 1) {
+				_weekly = true;
+			} else {
+				_dayRepeat = count * 7;
+			}
+			break;
+		case Months:
+			_monthRepeat = count;
+			break;
+		case Years:
+			if (count != 1) {
+				return 0;
+			}
+			_yearRepeat = true;
+			break;
+		default:
+			return 0;
+		}
+		return n + 1;
+	}
+
+	void setRepeat(PhraseRepeat r) {
+		switch (r) {
+		case Daily:
+			_dayRepeat = 1;
+			break;
+		case Weekly:
+			_weekly = true;
+			break;
+		case Monthly:
+			_monthRepeat = 1;
+			break;
+		case Yearly:
+			_yearRepeat = true;
+			break;
+		case Workdays:
+			_weekMask = 0b0011111;
+			break;
+		case Weekends:
+			_weekMask = 0b1100000;
+			break;
+		}
+	}
+
+	std::optional<ReminderInfo> resolve() const {
+		using namespace std::chrono;
+
+		const auto today = date::floor<date::days>(_now.time_since_epoch());
+		const auto nowMinutes = static_cast<int>(duration_cast<minutes>(_now.time_since_epoch() - today).count());
+		date::sys_days day{today};
+		auto at = _minutes.value_or(_part ? partDefault(*_part) : DEFAULT_MINUTES);
+		if (_minutes && _part && !_partGiven) {
+			at = withPart(at, *_part);
+		}
+
+		if (_after) {
+			const auto tp = date::floor<minutes>(_now.time_since_epoch()) + *_after;
+			day = date::sys_days{date::floor<date::days>(tp)};
+			at = static_cast<int>((tp - day.time_since_epoch()).count());
+		} else if (_afterDays || _afterMonths) {
+			auto ymd = date::year_month_day{day + date::days(_afterDays)} + date::months(_afterMonths);
+			day = ymd.ok() ? date::sys_days{ymd} : date::sys_days{ymd.year() / ymd.month() / date::last};
+			at = _minutes || _part ? at : nowMinutes;
+		} else if (_date) {
+			auto ymd = *_date;
+			if (!_dateWithYear) {
+				ymd = date::year_month_day{date::year_month_day{day}.year(), ymd.month(), ymd.day()};
+				if (date::sys_days{ymd} < day || (date::sys_days{ymd} == day && at <= nowMinutes)) {
+					ymd += date::years(1);
+				}
+			}
+			day = date::sys_days{ymd};
+		} else if (_dayOffset) {
+			if (*_dayOffset == 0 && !repeats() && at <= nowMinutes) {
+				return {};
+			}
+			day += date::days(*_dayOffset);
+		} else if (_weekday) {
+			const int todayWd = static_cast<int>(date::weekday{day}.iso_encoding()) - 1;
+			int ahead = (*_weekday - todayWd + 7) % 7;
+			if (ahead == 0 && (_nextWeek || at <= nowMinutes)) {
+				ahead = 7;
+			}
+			day += date::days(ahead);
+		} else if (!repeats() && at <= nowMinutes) {
+			day += date::days(1);
+		}
+
+		const date::year_month_day ymd{day};
+		ReminderInfo ri;
+		ri.day = static_cast<unsigned>(ymd.day());
+		ri.month = static_cast<unsigned>(ymd.month());
+		ri.year = static_cast<int>(ymd.year());
+		ri.hour = at / 60;
+		ri.minute = at % 60;
+		ri.day_repeat = _dayRepeat;
+		ri.month_repeat = _monthRepeat;
+		ri.year_repeat = _yearRepeat;
+		ri.week_repeat = _weekly ? 1 << (date::weekday{day}.iso_encoding() - 1) : _weekMask;
+		for (const auto& t : _tokens) {
+			if (!t.taken) {
+				ri.descr += (ri.descr.empty() ? "" : " ") + std::string(t.raw);
+			}
+		}
+		if (ri.descr.empty()) {
+			ri.descr = "Напоминание";
+		}
+		return ri;
+	}
+
+	static int partDefault(std::int8_t part) {
+		switch (part) {
+		case Morning:
+			return 9 * 60;
+		case Afternoon:
+			return 13 * 60;
+		case Evening:
+			return 19 * 60;
+		default:
+			return 23 * 60;
+		}
+	}
+
+  private:
+	const time_point_s _now;
+	std::vector<Token> _tokens;
+	bool _found = false;
+
+	std::optional<date::year_month_day> _date;
+	bool _dateWithYear = false;
+	std::optional<int> _dayOffset;
+	std::optional<int> _weekday;
+	bool _nextWeek = false;
+	std::optional<int> _minutes;   // time of day
+	bool _partGiven = false;       // _minutes came with its day part
+	std::optional<std::int8_t> _part; // "утром", "вечером" on their own
+	std::optional<std::chrono::minutes> _after;
+	int _afterDays = 0;
+	int _afterMonths = 0;
+
+	int _dayRepeat = 0;
+	int _monthRepeat = 0;
+	bool _yearRepeat = false;
+	bool _weekly = false; // on the weekday of the date
+	int _weekMask = 0;
+};
+
+inline std::optional<ReminderInfo> parsePhrase(std::string_view text, time_point_s localNow) {
+	return PhraseParser(text, localNow).parse();
+}
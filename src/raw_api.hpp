@@ -0,0 +1,84 @@
+#pragma once
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <tgbot/Bot.h>
+#include <tgbot/net/CurlHttpClient.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Thin Bot API client for calls whose reply_markup is already serialized to JSON.
+// tgbot::Api always takes a GenericReply tree and serializes it per call, this one
+// passes the string through as is.
+class RawApi {
+  public:
+	RawApi(const TgBot::HttpClient& client, std::string token, std::string url = "https://api.telegram.org"):
+	    _client(client), _token(std::move(token)), _url(std::move(url)) {}
+
+	// Returns the id of the sent message, 0 if the reply has none.
+	std::int32_t sendMessage(std::int64_t chatId, const std::string& text, const std::string& markup = {}) const {
+		std::vector<TgBot::HttpReqArg> args;
+		args.emplace_back("chat_id", chatId);
+		args.emplace_back("text", text);
+		if (!markup.empty()) {
+			args.emplace_back("reply_markup", markup);
+		}
+		const auto result = call("sendMessage", args);
+		return result.is_object() ? result.value("message_id", std::int32_t{0}) : 0;
+	}
+
+	void editMessageText(const std::string& text, std::int64_t chatId, std::int32_t messageId,
+	    const std::string& markup = {}) const {
+		std::vector<TgBot::HttpReqArg> args;
+		args.emplace_back("chat_id", chatId);
+		args.emplace_back("message_id", messageId);
+		args.emplace_back("text", text);
+		if (!markup.empty()) {
+			args.emplace_back("reply_markup", markup);
+		}
+		call("editMessageText", args);
+	}
+
+	void answerCallbackQuery(const std::string& queryId, const std::string& text = {}) const {
+		std::vector<TgBot::HttpReqArg> args;
+		args.emplace_back("callback_query_id", queryId);
+		if (!text.empty()) {
+			args.emplace_back("text", text);
+		}
+		call("answerCallbackQuery", args);
+	}
+
+	void deleteMessage(std::int64_t chatId, std::int32_t messageId) const {
+		std::vector<TgBot::HttpReqArg> args;
+		args.emplace_back("chat_id", chatId);
+		args.emplace_back("message_id", messageId);
+		call("deleteMessage", args);
+	}
+
+	const TgBot::HttpClient& client() const { return _client; }
+	const std::string& token() const { return _token; }
+	const std::string& url() const { return _url; }
+
+  private:
+	nlohmann::json call(const std::string& method, const std::vector<TgBot::HttpReqArg>& args) const {
+		auto resp = _client.makeRequest(TgBot::Url(fmt::format("{}/bot{}/{}", _url, _token, method)), args);
+
+		auto json = nlohmann::json::parse(resp, nullptr, false);
+		if (json.is_discarded()) {
+			throw std::runtime_error(fmt::format("{}: bad response", method));
+		}
+		if (!json.value("ok", false)) {
+			throw std::runtime_error(fmt::format("{}: {}", method, json.value("description", "unknown error")));
+		}
+
+		return json["result"];
+	}
+
+  private:
+	const TgBot::HttpClient& _client;
+	const std::string _token;
+	const std::string _url;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "reminder_info.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Fixed-size part of a binary encoded reminder, followed by `descrSize` bytes of description.
+// Host byte order, the files using it are not meant to move between architectures. Records written before
+// `version` existed carry 0 there and share the layout of version 1.
+struct PackedReminder {
+	std::int64_t id;
+	std::int64_t preReminder;
+	std::int32_t year;
+	std::int32_t monthRepeat;
+	std::int32_t dayRepeat;
+	std::uint8_t month;
+	std::uint8_t day;
+	std::uint8_t hour;
+	std::uint8_t minute;
+	std::uint8_t weekRepeat;
+	std::uint8_t flags;
+	std::uint16_t descrSize;
+	std::uint8_t version;
+	std::uint8_t reserved[3];
+};
+static_assert(sizeof(PackedReminder) == 40);
+
+constexpr std::uint8_t PACKED_ON = 1;
+constexpr std::uint8_t PACKED_YEAR_REPEAT = 2;
+constexpr std::uint8_t PACKED_VERSION = 1;
+
+inline void appendReminder(std::string& out, const ReminderInfo& ri) {
+	PackedReminder p{};
+	p.id = ri._id;
+	p.preReminder = ri.pre_reminder;
+	p.year = static_cast<std::int32_t>(ri.year);
+	p.monthRepeat = static_cast<std::int32_t>(ri.month_repeat);
+	p.dayRepeat = static_cast<std::int32_t>(ri.day_repeat);
+	p.month = static_cast<std::uint8_t>(ri.month);
+	p.day = static_cast<std::uint8_t>(ri.day);
+	p.hour = static_cast<std::uint8_t>(ri.hour);
+	p.minute = static_cast<std::uint8_t>(ri.minute);
+	p.weekRepeat = static_cast<std::uint8_t>(ri.week_repeat);
+	p.flags = (ri.on ? PACKED_ON : 0) | (ri.year_repeat ? PACKED_YEAR_REPEAT : 0);
+	p.descrSize = static_cast<std::uint16_t>(std::min<size_t>(ri.descr.size(), UINT16_MAX));
+	p.version = PACKED_VERSION;
+
+	out.append(reinterpret_cast<const char*>(&p), sizeof(p));
+	out.append(ri.descr.data(), p.descrSize);
+}
+
+// Advances `pos`, returns false if the data is truncated or written by a newer version.
+inline bool readReminder(const char*& pos, const char* end, ReminderInfo& ri) {
+	PackedReminder p;
+	if (static_cast<size_t>(end - pos) < sizeof(p)) {
+		return false;
+	}
+	std::memcpy(&p, pos, sizeof(p));
+	if (p.version > PACKED_VERSION || static_cast<size_t>(end - pos) < sizeof(p) + p.descrSize) {
+		return false;
+	}
+
+	ri._id = p.id;
+	ri.pre_reminder = p.preReminder;
+	ri.year = p.year;
+	ri.month_repeat = p.monthRepeat;
+	ri.day_repeat = p.dayRepeat;
+	ri.month = p.month;
+	ri.day = p.day;
+	ri.hour = p.hour;
+	ri.minute = p.minute;
+	ri.week_repeat = p.weekRepeat;
+	ri.on = p.flags & PACKED_ON;
+	ri.year_repeat = p.flags & PACKED_YEAR_REPEAT;
+	ri.descr.assign(pos + sizeof(p), p.descrSize);
+	pos += sizeof(p) + p.descrSize;
+
+	return true;
+}
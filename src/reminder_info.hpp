@@ -1,6 +1,5 @@
 #pragma once
 
-#include "auto_reminder.hpp"
 #include "utils.hpp"
 
 #include <boost/algorithm/string/split.hpp>
@@ -17,16 +16,40 @@
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <set>
 #include <shared_mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+
+// Pre-reminder offset in minutes as "1 д. 2 ч. 30 мин.".
+inline std::string prettyOffset(std::int64_t minutes) {
+	std::string out;
+	if (minutes >= 24 * 60) {
+		out += fmt::format("{} д. ", minutes / (24 * 60));
+	}
+	if (minutes % (24 * 60) >= 60) {
+		out += fmt::format("{} ч. ", minutes % (24 * 60) / 60);
+	}
+	if (minutes % 60 != 0) {
+		out += fmt::format("{} мин. ", minutes % 60);
+	}
+	if (!out.empty()) {
+		out.pop_back();
+	}
+
+	return out;
+}
 
 struct ReminderInfo {
+	static constexpr size_t MAX_PRE_REMINDERS = 4;
+
 	std::string descr;
 
 	bool on = true;
@@ -43,13 +66,52 @@ struct ReminderInfo {
 	std::int64_t week_repeat = 0; // bit schema here
 	std::int64_t day_repeat = 0;
 
-	std::int64_t pre_reminder = 0;
+	std::int64_t pre_reminder = 0; // up to MAX_PRE_REMINDERS offsets in minutes, 16 bits each
 
 	std::int64_t _id = -1;
 
 	std::string pretty() const {
-		return fmt::format("{:0>2}/{:0>2}/{} {:0>2}:{:0>2} {}{}", day, month, year, hour, minute, descr,
-		    prettyRepeat());
+		return fmt::format("{:0>2}/{:0>2}/{} {:0>2}:{:0>2} {}{}{}", day, month, year, hour, minute, descr,
+		    prettyRepeat(), prettyPreReminders());
+	}
+
+	// Non-empty offsets (minutes before the reminder) in ascending order.
+	std::vector<std::int64_t> preReminders() const {
+		std::vector<std::int64_t> out;
+		const auto packed = static_cast<std::uint64_t>(pre_reminder);
+		for (size_t i = 0; i != MAX_PRE_REMINDERS; ++i) {
+			if (auto offset = static_cast<std::int64_t>((packed >> (16 * i)) & 0xffff)) {
+				out.push_back(offset);
+			}
+		}
+		std::sort(out.begin(), out.end());
+
+		return out;
+	}
+
+	// Sorts and drops repeated offsets, so limits are checked against what will actually be stored.
+	static void normalizePreReminders(std::vector<std::int64_t>& minutes) {
+		std::sort(minutes.begin(), minutes.end());
+		minutes.erase(std::unique(minutes.begin(), minutes.end()), minutes.end());
+	}
+
+	// Offsets must be in (0, 65535], at most MAX_PRE_REMINDERS distinct ones.
+	void setPreReminders(std::vector<std::int64_t> minutes) {
+		normalizePreReminders(minutes);
+		std::uint64_t packed = 0;
+		for (size_t i = 0; i != minutes.size() && i != MAX_PRE_REMINDERS; ++i) {
+			packed |= (static_cast<std::uint64_t>(minutes[i]) & 0xffff) << (16 * i);
+		}
+		pre_reminder = static_cast<std::int64_t>(packed);
+	}
+
+	std::string prettyPreReminders() const {
+		std::string out;
+		for (auto offset : preReminders()) {
+			out += (out.empty() ? "\nПредварительно за " : ", ") + prettyOffset(offset);
+		}
+
+		return out;
 	}
 
 	std::string prettyRepeat() const {
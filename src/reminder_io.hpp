@@ -0,0 +1,600 @@
+#pragma once
+
+#include "auto_reminder.hpp"
+#include "reminder_info.hpp"
+#include "reminder_query.hpp"
+#include "reminder_storage.hpp"
+#include "trace.hpp"
+#include "tz_table.hpp"
+#include "utils.hpp"
+
+#include <boost/algorithm/string/split.hpp>
+#include <date/date.h>
+#include <fmt/format.h>
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Bulk import/export of a chat's reminders.
+//
+// CSV: header "date,time,repeat,descr,pre", one reminder per row. date/time/repeat are the /add
+// arguments (13.06.2023, 14:30, n|y|m[N]|d[N]|w12345), pre is optional pre-reminder minutes separated by
+// ';'. Fields may be quoted, "" inside quotes is a quote.
+//
+// iCalendar: VEVENTs with DTSTART (floating, UTC or TZID), SUMMARY, RRULE with FREQ=DAILY|WEEKLY|MONTHLY|
+// YEARLY, INTERVAL and BYDAY, and VALARM TRIGGERs before the start as pre-reminders.
+//
+// Rows go through ReminderInfo::parseCommand(), the same validation /add uses, and like /add a
+// non-repeating reminder that has already passed is rejected.
+enum class ReminderFormat { Csv, Ics };
+
+inline std::optional<ReminderFormat> reminderFormat(const std::string& name) {
+	auto lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+	auto endsWith = [&](const std::string& suffix) {
+		return lower.size() >= suffix.size() && lower.compare(lower.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	if (endsWith("csv")) {
+		return ReminderFormat::Csv;
+	}
+	if (endsWith("ics") || endsWith("ical")) {
+		return ReminderFormat::Ics;
+	}
+	return {};
+}
+
+constexpr size_t MAX_DESCR_SIZE = 200;
+
+struct ImportStats {
+	size_t imported = 0;
+	size_t failed = 0;
+	std::vector<std::string> errors; // first MAX_ERRORS of them, with line numbers
+
+	static constexpr size_t MAX_ERRORS = 10;
+
+	void fail(size_t line, const std::string& error) {
+		if (++failed <= MAX_ERRORS) {
+			errors.push_back(fmt::format("{}: {}", line, error));
+		}
+	}
+};
+
+namespace reminder_io {
+
+// Validates the /add style fields and fills `ri`, returns the error otherwise.
+inline std::string parseFields(const std::string& date, const std::string& time, const std::string& repeat,
+    const std::string& descr, std::vector<std::int64_t> pre, ReminderInfo& ri) {
+	if (descr.empty()) {
+		return "⚠️ Пустое описание!";
+	}
+	if (descr.size() > MAX_DESCR_SIZE) {
+		return "⚠️ Сообщение должно быть меньше 200 байт!";
+	}
+	ReminderInfo::normalizePreReminders(pre);
+	if (pre.size() > ReminderInfo::MAX_PRE_REMINDERS) {
+		return fmt::format("⚠️ Не больше {} предварительных напоминаний!", ReminderInfo::MAX_PRE_REMINDERS);
+	}
+	for (auto offset : pre) {
+		if (offset <= 0 || offset > 0xffff) {
+			return "⚠️ Неверный формат предварительного напоминания!";
+		}
+	}
+
+	std::string error;
+	if (!ri.parseCommand(fmt::format("/add {} {} {} {}", date, time, repeat.empty() ? "n" : repeat, descr), error)) {
+		return error;
+	}
+	ri.setPreReminders(pre);
+
+	return {};
+}
+
+inline std::string repeatToken(const ReminderInfo& ri) {
+	if (ri.year_repeat) {
+		return "y";
+	} else if (ri.month_repeat != 0) {
+		return fmt::format("m{}", ri.month_repeat);
+	} else if (ri.day_repeat != 0) {
+		return fmt::format("d{}", ri.day_repeat);
+	} else if (ri.week_repeat != 0) {
+		std::string out = "w";
+		for (size_t i = 0; i != 7; ++i) {
+			if (ri.week_repeat & (1 << i)) {
+				out += static_cast<char>('1' + i);
+			}
+		}
+		return out;
+	}
+	return "n";
+}
+
+// Reads one CSV record, quoted fields may span lines. Returns false at the end of input.
+inline bool readCsvRecord(std::istream& in, std::vector<std::string>& fields, size_t& line) {
+	fields.clear();
+	std::string row;
+	if (!std::getline(in, row)) {
+		return false;
+	}
+	++line;
+
+	std::string field;
+	bool quoted = false;
+	while (true) {
+		for (size_t i = 0; i != row.size(); ++i) {
+			const char c = row[i];
+			if (quoted) {
+				if (c == '"' && i + 1 < row.size() && row[i + 1] == '"') {
+					field += '"';
+					++i;
+				} else if (c == '"') {
+					quoted = false;
+				} else {
+					field += c;
+				}
+			} else if (c == '"') {
+				quoted = true;
+			} else if (c == ',') {
+				fields.push_back(std::move(field));
+				field.clear();
+			} else if (c != '\r') {
+				field += c;
+			}
+		}
+		if (!quoted || !std::getline(in, row)) {
+			break;
+		}
+		++line;
+		field += '\n';
+	}
+	fields.push_back(std::move(field));
+
+	return true;
+}
+
+inline std::string csvField(const std::string& s) {
+	if (s.find_first_of(",\"\n\r") == std::string::npos) {
+		return s;
+	}
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"') {
+			out += '"';
+		}
+		out += c;
+	}
+	out += '"';
+
+	return out;
+}
+
+inline void readCsv(
+    std::istream& in, const std::function<void(ReminderInfo&&, size_t line)>& sink, ImportStats& stats) {
+	std::vector<std::string> fields;
+	size_t line = 0;
+	while (readCsvRecord(in, fields, line)) {
+		if (fields.size() == 1 && fields[0].empty()) {
+			continue;
+		}
+		if (line == 1 && fields[0] == "date") {
+			continue;
+		}
+		if (fields.size() < 4 || fields.size() > 5) {
+			stats.fail(line, "⚠️ Неверное колличество столбцов!");
+			continue;
+		}
+
+		std::vector<std::int64_t> pre;
+		if (fields.size() == 5 && !fields[4].empty()) {
+			std::vector<std::string> parts;
+			boost::split(parts, fields[4], [](char c) { return c == ';'; });
+			try {
+				for (const auto& p : parts) {
+					pre.push_back(std::stoll(p));
+				}
+			} catch (const std::exception& e) {
+				stats.fail(line, "⚠️ Неверный формат предварительного напоминания!");
+				continue;
+			}
+		}
+
+		ReminderInfo ri;
+		if (auto error = parseFields(fields[0], fields[1], fields[2], fields[3], pre, ri); !error.empty()) {
+			stats.fail(line, error);
+			continue;
+		}
+		sink(std::move(ri), line);
+	}
+}
+
+// Reads a content line, joining folded continuation lines.
+inline bool readIcsLine(std::istream& in, std::string& out, size_t& line) {
+	if (!std::getline(in, out)) {
+		return false;
+	}
+	++line;
+	if (!out.empty() && out.back() == '\r') {
+		out.pop_back();
+	}
+	while (in.peek() == ' ' || in.peek() == '\t') {
+		std::string next;
+		std::getline(in, next);
+		++line;
+		if (!next.empty() && next.back() == '\r') {
+			next.pop_back();
+		}
+		out += next.substr(1);
+	}
+
+	return true;
+}
+
+inline std::string icsUnescape(const std::string& s) {
+	std::string out;
+	for (size_t i = 0; i != s.size(); ++i) {
+		if (s[i] == '\\' && i + 1 != s.size()) {
+			++i;
+			out += s[i] == 'n' || s[i] == 'N' ? ' ' : s[i];
+		} else {
+			out += s[i];
+		}
+	}
+
+	return out;
+}
+
+// Content lines longer than 75 bytes are folded, never inside a UTF-8 sequence.
+inline std::string icsFold(const std::string& line) {
+	std::string out;
+	size_t width = 0;
+	for (size_t i = 0; i != line.size();) {
+		const auto lead = static_cast<unsigned char>(line[i]);
+		const size_t len = lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+		if (width + len > 75) {
+			out += "\r\n ";
+			width = 1;
+		}
+		out.append(line, i, len);
+		width += len;
+		i += len;
+	}
+	out += "\r\n";
+
+	return out;
+}
+
+inline std::string icsEscape(const std::string& s) {
+	std::string out;
+	for (char c : s) {
+		if (c == '\\' || c == ';' || c == ',') {
+			out += '\\';
+			out += c;
+		} else if (c == '\n') {
+			out += "\\n";
+		} else {
+			out += c;
+		}
+	}
+
+	return out;
+}
+
+// YYYYMMDD[THHMM...] as a time point in the zone it was written in.
+inline std::optional<time_point_s> icsTime(const std::string& value) {
+	auto number = [&](size_t pos, size_t n) { return std::stoi(value.substr(pos, n)); };
+	try {
+		if (value.size() < 8) {
+			return {};
+		}
+		date::year_month_day ymd{date::year(number(0, 4)), date::month(number(4, 2)), date::day(number(6, 2))};
+		if (!ymd.ok()) {
+			return {};
+		}
+		auto tp = time_point_s(date::sys_days{ymd}.time_since_epoch());
+		if (value.size() >= 13 && value[8] == 'T') {
+			tp += std::chrono::hours(number(9, 2)) + std::chrono::minutes(number(11, 2));
+		}
+		return tp;
+	} catch (const std::exception& e) { return {}; }
+}
+
+// "-PT15M", "-P1DT2H", "-PT1H30M" -> minutes before the start, 0 if not a duration before the start.
+inline std::int64_t icsOffsetMinutes(const std::string& trigger) {
+	if (trigger.size() < 3 || trigger[0] != '-' || trigger[1] != 'P') {
+		return 0;
+	}
+	std::int64_t minutes = 0;
+	std::int64_t number = 0;
+	for (size_t i = 2; i != trigger.size(); ++i) {
+		const char c = trigger[i];
+		if (c >= '0' && c <= '9') {
+			number = number * 10 + (c - '0');
+		} else if (c == 'W') {
+			minutes += number * 7 * 24 * 60;
+			number = 0;
+		} else if (c == 'D') {
+			minutes += number * 24 * 60;
+			number = 0;
+		} else if (c == 'H') {
+			minutes += number * 60;
+			number = 0;
+		} else if (c == 'M') {
+			minutes += number;
+			number = 0;
+		} else if (c == 'S' || c == 'T') {
+			number = 0;
+		} else {
+			return 0;
+		}
+	}
+
+	return minutes;
+}
+
+inline void readIcs(std::istream& in, const TzTable& zone,
+    const std::function<void(ReminderInfo&&, size_t line)>& sink, ImportStats& stats) {
+	struct Event {
+		size_t line = 0;
+		std::string start; // YYYYMMDD[THHMMSS[Z]]
+		std::string tzid;
+		std::string summary;
+		std::string rrule;
+		std::vector<std::int64_t> pre;
+	};
+
+	std::optional<Event> event;
+	bool inAlarm = false;
+	std::string content;
+	size_t line = 0;
+	while (readIcsLine(in, content, line)) {
+		const auto colon = content.find(':');
+		if (colon == std::string::npos) {
+			continue;
+		}
+		auto nameAndParams = content.substr(0, colon);
+		const auto value = content.substr(colon + 1);
+		std::vector<std::string> params;
+		boost::split(params, nameAndParams, [](char c) { return c == ';'; });
+		const auto& name = params.front();
+
+		if (name == "BEGIN" && value == "VEVENT") {
+			event = Event{line};
+		} else if (name == "BEGIN" && value == "VALARM") {
+			inAlarm = true;
+		} else if (name == "END" && value == "VALARM") {
+			inAlarm = false;
+		} else if (!event) {
+			continue;
+		} else if (inAlarm) {
+			if (name == "TRIGGER") {
+				if (auto offset = icsOffsetMinutes(value)) {
+					event->pre.push_back(offset);
+				}
+			}
+		} else if (name == "DTSTART") {
+			event->start = value;
+			for (const auto& p : params) {
+				if (p.rfind("TZID=", 0) == 0) {
+					event->tzid = p.substr(5);
+				}
+			}
+		} else if (name == "SUMMARY") {
+			event->summary = icsUnescape(value);
+		} else if (name == "RRULE") {
+			event->rrule = value;
+		} else if (name == "END" && value == "VEVENT") {
+			auto e = std::move(*event);
+			event.reset();
+
+			auto startTp = icsTime(e.start);
+			if (!startTp) {
+				stats.fail(e.line, "⚠️ Неверный формат даты!");
+				continue;
+			}
+			// UTC and TZID starts are moved to the chat's zone, floating ones already are local.
+			if (e.start.back() == 'Z') {
+				startTp = zone.toLocal(*startTp);
+			} else if (!e.tzid.empty()) {
+				try {
+					startTp = zone.toLocal(tzTable(e.tzid).toUtc(*startTp));
+				} catch (const std::exception& ex) {
+					stats.fail(e.line, fmt::format("⚠️ Неизвестный часовой пояс! ({})", e.tzid));
+					continue;
+				}
+			}
+			auto [ymd, tod] = ymdTodFromTp(*startTp);
+			const auto dateStr = fmt::format("{}.{}.{}", static_cast<unsigned>(ymd.day()),
+			    static_cast<unsigned>(ymd.month()), static_cast<int>(ymd.year()));
+			const auto timeStr = fmt::format("{}:{}", tod.hours().count(), tod.minutes().count());
+
+			std::string repeat = "n";
+			if (!e.rrule.empty()) {
+				std::string freq, byDay;
+				std::int64_t interval = 1;
+				std::vector<std::string> parts;
+				boost::split(parts, e.rrule, [](char c) { return c == ';'; });
+				for (const auto& p : parts) {
+					if (p.rfind("FREQ=", 0) == 0) {
+						freq = p.substr(5);
+					} else if (p.rfind("INTERVAL=", 0) == 0) {
+						interval = std::atoll(p.c_str() + 9);
+					} else if (p.rfind("BYDAY=", 0) == 0) {
+						byDay = p.substr(6);
+					}
+				}
+				// Weekly and yearly repeats have no step of their own, their INTERVAL can't be kept.
+				const bool stepped = freq == "DAILY" || freq == "MONTHLY";
+				if (interval < 1 || (interval != 1 && !stepped)) {
+					stats.fail(e.line, fmt::format("⚠️ Неподдерживаемый повтор! ({})", e.rrule));
+					continue;
+				}
+				if (freq == "DAILY") {
+					repeat = fmt::format("d{}", interval);
+				} else if (freq == "WEEKLY") {
+					static const char* const DAYS[] = {"MO", "TU", "WE", "TH", "FR", "SA", "SU"};
+					repeat = "w";
+					for (size_t i = 0; i != 7; ++i) {
+						if (byDay.find(DAYS[i]) != std::string::npos) {
+							repeat += static_cast<char>('1' + i);
+						}
+					}
+					if (repeat.size() == 1) {
+						repeat += static_cast<char>('0' + date::weekday(date::sys_days{ymd}).iso_encoding());
+					}
+				} else if (freq == "MONTHLY") {
+					repeat = fmt::format("m{}", interval);
+				} else if (freq == "YEARLY") {
+					repeat = "y";
+				} else {
+					stats.fail(e.line, fmt::format("⚠️ Неподдерживаемый повтор! ({})", e.rrule));
+					continue;
+				}
+			}
+
+			ReminderInfo ri;
+			if (auto error = parseFields(dateStr, timeStr, repeat, e.summary, e.pre, ri); !error.empty()) {
+				stats.fail(e.line, error);
+				continue;
+			}
+			sink(std::move(ri), e.line);
+		}
+	}
+}
+
+} // namespace reminder_io
+
+// Parses `in` reminder by reminder, invalid rows are counted in `stats` and skipped.
+inline void readReminders(std::istream& in, ReminderFormat format, const TzTable& zone,
+    const std::function<void(ReminderInfo&&, size_t line)>& sink, ImportStats& stats) {
+	TRACE_SCOPE("readReminders", "io");
+	if (format == ReminderFormat::Csv) {
+		reminder_io::readCsv(in, sink, stats);
+	} else {
+		reminder_io::readIcs(in, zone, sink, stats);
+	}
+}
+
+// Writes reminders as they come, without building the whole file.
+class ReminderWriter {
+  public:
+	ReminderWriter(std::ostream& out, ReminderFormat format): _out(out), _format(format) {
+		if (_format == ReminderFormat::Csv) {
+			_out << "date,time,repeat,descr,pre\r\n";
+		} else {
+			_out << "BEGIN:VCALENDAR\r\nVERSION:2.0\r\nPRODID:-//TgReminderBot//RU\r\n";
+		}
+	}
+
+	~ReminderWriter() {
+		if (_format == ReminderFormat::Ics) {
+			_out << "END:VCALENDAR\r\n";
+		}
+	}
+
+	ReminderWriter(const ReminderWriter&) = delete;
+	ReminderWriter& operator=(const ReminderWriter&) = delete;
+
+	void write(const ReminderInfo& ri) {
+		using reminder_io::csvField;
+
+		const auto pre = ri.preReminders();
+		if (_format == ReminderFormat::Csv) {
+			std::string preStr;
+			for (auto offset : pre) {
+				preStr += (preStr.empty() ? "" : ";") + std::to_string(offset);
+			}
+			_out << fmt::format("{:0>2}.{:0>2}.{},{:0>2}:{:0>2},{},{},{}\r\n", ri.day, ri.month, ri.year, ri.hour,
+			    ri.minute, reminder_io::repeatToken(ri), csvField(ri.descr), preStr);
+			return;
+		}
+
+		_out << fmt::format("BEGIN:VEVENT\r\nUID:{}@tg-reminder-bot\r\nDTSTART:{:0>4}{:0>2}{:0>2}T{:0>2}{:0>2}00\r\n",
+		            ri._id, ri.year, ri.month, ri.day, ri.hour, ri.minute)
+		     << reminder_io::icsFold("SUMMARY:" + reminder_io::icsEscape(ri.descr));
+		if (ri.year_repeat) {
+			_out << "RRULE:FREQ=YEARLY\r\n";
+		} else if (ri.month_repeat != 0) {
+			_out << fmt::format("RRULE:FREQ=MONTHLY;INTERVAL={}\r\n", ri.month_repeat);
+		} else if (ri.day_repeat != 0) {
+			_out << fmt::format("RRULE:FREQ=DAILY;INTERVAL={}\r\n", ri.day_repeat);
+		} else if (ri.week_repeat != 0) {
+			static const char* const DAYS[] = {"MO", "TU", "WE", "TH", "FR", "SA", "SU"};
+			std::string byDay;
+			for (size_t i = 0; i != 7; ++i) {
+				if (ri.week_repeat & (1 << i)) {
+					byDay += (byDay.empty() ? "" : ",") + std::string(DAYS[i]);
+				}
+			}
+			_out << fmt::format("RRULE:FREQ=WEEKLY;BYDAY={}\r\n", byDay);
+		}
+		for (auto offset : pre) {
+			_out << "BEGIN:VALARM\r\nACTION:DISPLAY\r\n"
+			     << reminder_io::icsFold("DESCRIPTION:" + reminder_io::icsEscape(ri.descr))
+			     << fmt::format("TRIGGER:-PT{}M\r\nEND:VALARM\r\n", offset);
+		}
+		_out << "END:VEVENT\r\n";
+	}
+
+  private:
+	std::ostream& _out;
+	const ReminderFormat _format;
+};
+
+struct ImportResult {
+	ImportStats stats;
+	std::vector<ReminderQuery::Timer> timers; // of the imported reminders, for one ReminderQuery::addTimers()
+};
+
+// Stores every valid reminder of `in` in the chat's reminders, committing every `batchSize` of them
+// instead of once per reminder.
+inline ImportResult importReminders(ReminderStore& store, std::int64_t chatId, std::istream& in, ReminderFormat format,
+    const TzTable& zone, time_point_s utcTp, size_t batchSize = 1000) {
+	TRACE_SCOPE("importReminders", "io", chatId);
+	ImportResult result;
+	const auto localTp = zone.toLocal(utcTp);
+	size_t pending = 0;
+	readReminders(
+	    in, format, zone,
+	    [&](ReminderInfo&& ri, size_t line) {
+		    auto nextTp = nextOccurrence(ri, localTp);
+		    if (nextTp <= localTp) {
+			    result.stats.fail(line, "⚠️ Напоминание уже прошло, так же оно не повоторяется!");
+			    return;
+		    }
+		    ri._id = storeReminder(store, chatId, ri);
+		    ++result.stats.imported;
+		    result.timers.push_back({chatId, zone.toUtc(nextTp), std::move(ri)});
+		    if (++pending == batchSize) {
+			    store.commit();
+			    pending = 0;
+		    }
+	    },
+	    result.stats);
+	if (pending) {
+		store.commit();
+	}
+
+	return result;
+}
+
+// Streams the chat's reminders to `out`.
+inline size_t exportReminders(ReminderStore& store, std::int64_t chatId, std::ostream& out, ReminderFormat format) {
+	TRACE_SCOPE("exportReminders", "io", chatId);
+	ReminderWriter writer(out, format);
+	size_t count = 0;
+	for (const auto& ri : loadReminders(store, chatId)) {
+		writer.write(ri);
+		++count;
+	}
+
+	return count;
+}
@@ -0,0 +1,502 @@
+#pragma once
+
+#include "chat_zones.hpp"
+#include "clock.hpp"
+#include "flat_hash_map.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "reminder_info.hpp"
+#include "scheduler_wal.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// First occurrence strictly after `localTp`, or a time point <= `localTp` if there is none. Daily repeats
+// report `localTp` itself when it is on their grid, so they are asked again a second later.
+inline time_point_s nextOccurrence(const ReminderInfo& r, time_point_s localTp) {
+	auto nextTp = r.getNearTs(localTp);
+	if (nextTp == localTp) {
+		nextTp = r.getNearTs(localTp + std::chrono::seconds(1));
+	}
+
+	return nextTp;
+}
+
+// Timers are kept in UTC, each chat's zone is only used to compute the next occurrence of a
+// repeatable reminder and to render it. A reminder with pre-reminders is queued as several triggers
+// sharing one ReminderInfo, pre-reminder triggers are derived from the main one and never journaled.
+class ReminderQuery {
+  public:
+	using Sender = std::function<void(std::int64_t chatId, const std::string& text)>;
+	using FireHook = std::function<void(std::int64_t chatId, const ReminderInfo& reminder, time_point_s deadline,
+	    time_point_s firedAt)>;
+
+	struct Timer {
+		std::int64_t chatId;
+		time_point_s tp;
+		ReminderInfo reminder;
+	};
+
+	ReminderQuery(Sender sender, const ChatZones& zones, Clock& clock = systemClock()):
+	    _sender(std::move(sender)), _zones(zones), _clock(clock) {}
+
+	void addTimer(std::int64_t chatId, time_point_s tp, const ReminderInfo& reminder) {
+		std::scoped_lock l(_m);
+		const auto utcTp = _clock.now();
+		modifyChat(chatId, [&](auto& rms) { addTriggers(rms, tp, share(reminder), utcTp); });
+		if (_wal) {
+			_wal->add(chatId, tp, reminder);
+		}
+		rearm();
+	}
+
+	void addTimers(const std::vector<Timer>& timers) {
+		std::scoped_lock l(_m);
+		const auto utcTp = _clock.now();
+		for (const auto& t : timers) {
+			modifyChat(t.chatId, [&](auto& rms) { addTriggers(rms, t.tp, share(t.reminder), utcTp); });
+			if (_wal) {
+				_wal->add(t.chatId, t.tp, t.reminder);
+			}
+		}
+		rearm();
+	}
+
+	// Replaces the chat's timers unless they were modified after `expectedVersion` was read by
+	// chatVersion().
+	bool replaceChat(std::int64_t chatId, const std::vector<std::pair<time_point_s, ReminderInfo>>& timers,
+	    std::uint64_t expectedVersion) {
+		std::scoped_lock l(_m);
+		if (chatVersionImpl(chatId) != expectedVersion) {
+			return false;
+		}
+		const auto utcTp = _clock.now();
+		modifyChat(chatId, [&](auto& rms) {
+			rms.clear();
+			for (const auto& [tp, r] : timers) {
+				addTriggers(rms, tp, share(r), utcTp);
+			}
+		});
+		if (_wal) {
+			_wal->clear(chatId);
+			for (const auto& [tp, r] : timers) {
+				_wal->add(chatId, tp, r);
+			}
+		}
+		rearm();
+
+		return true;
+	}
+
+	void removeTimer(std::int64_t chatId, std::int64_t reminderId) {
+		std::scoped_lock l(_m);
+		modifyChat(chatId, [&](auto& rms) {
+			for (auto it = rms.begin(); it != rms.end();) {
+				if (it->second.reminder->_id != reminderId) {
+					it++;
+				} else {
+					it = rms.erase(it);
+				}
+			}
+		});
+		if (_wal) {
+			_wal->remove(chatId, reminderId);
+		}
+		rearm();
+	}
+
+	void clearChat(std::int64_t chatId) {
+		std::scoped_lock l(_m);
+		modifyChat(chatId, [&](auto& rms) { rms.clear(); });
+		if (_wal) {
+			_wal->clear(chatId);
+		}
+		rearm();
+	}
+
+	void stop() {
+		std::scoped_lock l(_m);
+		_running = false;
+		_alarm->wake();
+	}
+
+	// Every later mutation is appended to `wal` under the queue lock, so the log order matches the
+	// order the queue saw.
+	void setJournal(SchedulerWal* wal) {
+		std::scoped_lock l(_m);
+		_wal = wal;
+	}
+
+	// A chat's earliest trigger is held up to `window` past its deadline, and everything of the chat due by
+	// then is fired with it and sent in the same message. Nothing is fired before its deadline.
+	void setCoalesceWindow(std::chrono::seconds window) {
+		std::scoped_lock l(_m);
+		_window = window;
+		rearm();
+	}
+
+	// Called on the scheduler thread for every fired trigger, before the message is sent.
+	void setFireHook(FireHook hook) {
+		std::scoped_lock l(_m);
+		_fireHook = std::move(hook);
+	}
+
+	std::vector<std::pair<time_point_s, ReminderInfo>> getInterval(std::int64_t chatId, time_point_s from,
+	    time_point_s to) {
+		std::unique_lock lk(_m);
+
+		std::vector<std::pair<time_point_s, ReminderInfo>> out;
+		auto found = _order.find(chatId);
+		if (found == _order.end()) {
+			return out;
+		}
+		for (auto& [tp, trigger] : found->second) {
+			if (tp <= from || trigger.preMinutes) {
+				continue;
+			}
+			if (tp > to) {
+				break;
+			}
+			out.emplace_back(tp, *trigger.reminder);
+		}
+
+		return out;
+	}
+
+	std::vector<Timer> timers() const { return checkpoint().first; }
+
+	// Queue image together with the last journal record it includes.
+	std::pair<std::vector<Timer>, std::uint64_t> checkpoint() const {
+		std::scoped_lock l(_m);
+		std::vector<Timer> out;
+		for (const auto& [chatId, reminders] : _order) {
+			for (const auto& [tp, trigger] : reminders) {
+				if (!trigger.preMinutes) {
+					out.push_back({chatId, tp, *trigger.reminder});
+				}
+			}
+		}
+		return {std::move(out), _wal ? _wal->lsn() : 0};
+	}
+
+	std::vector<std::int64_t> chats() const {
+		std::scoped_lock l(_m);
+		std::vector<std::int64_t> out;
+		for (const auto& [chatId, reminders] : _order) {
+			out.push_back(chatId);
+		}
+		return out;
+	}
+
+	// Bumped on every change of the queue.
+	std::uint64_t version() const { return _version; }
+
+	std::uint64_t chatVersion(std::int64_t chatId) const {
+		std::scoped_lock l(_m);
+		return chatVersionImpl(chatId);
+	}
+
+	// Bumps the chat's version when its stored reminders changed without a change of its timers.
+	void touchChat(std::int64_t chatId) {
+		std::scoped_lock l(_m);
+		++_chatVersions[chatId];
+	}
+
+	// Queued triggers, pre-reminders included.
+	size_t size() const {
+		std::scoped_lock l(_m);
+		size_t s = 0;
+		for (const auto& [chatId, reminders] : _order) {
+			s += reminders.size();
+		}
+		return s;
+	}
+
+	size_t fired() const { return _fired; }
+
+	void run() {
+		std::unique_lock lk(_m);
+		_running = true;
+
+		while (_running) {
+			sleep(lk, fire(lk));
+		}
+	}
+
+	// Fires everything due up to `end` waiting on the clock in between, with a VirtualClock each wait
+	// jumps straight to the next deadline.
+	void runUntil(time_point_s end) {
+		std::unique_lock lk(_m);
+
+		while (true) {
+			auto nextTpWakeUp = fire(lk);
+			if (nextTpWakeUp > end) {
+				break;
+			}
+			sleep(lk, nextTpWakeUp);
+		}
+	}
+
+	// One turn of run() without the sleep, for a thread serving several queues (see SchedulerGroup): takes
+	// what woke the alarm, fires what is due and sets the alarm to the next deadline.
+	void poll() {
+		std::unique_lock lk(_m);
+		if (const auto reason = _alarm->poll(); reason != Alarm::Reason::Other) {
+			woke(reason);
+		}
+		_alarm->set(fire(lk));
+	}
+
+	// Readable when poll() has work, -1 if the clock's alarm can't be polled and the queue needs run().
+	int alarmFd() const { return _alarm->fd(); }
+
+  private:
+	// A pre-reminder trigger fires `preMinutes` before the reminder, the main one has 0.
+	struct Trigger {
+		std::shared_ptr<const ReminderInfo> reminder;
+		std::int64_t preMinutes;
+	};
+	using Reminders = std::multimap<time_point_s, Trigger>;
+
+	static std::shared_ptr<const ReminderInfo> share(const ReminderInfo& reminder) {
+		return std::make_shared<const ReminderInfo>(reminder);
+	}
+
+	// The main trigger at `tp` and the pre-reminders of that occurrence which are still ahead.
+	static void addTriggers(Reminders& rms, time_point_s tp, const std::shared_ptr<const ReminderInfo>& reminder,
+	    time_point_s utcTp) {
+		rms.emplace(tp, Trigger{reminder, 0});
+		if (reminder->pre_reminder) {
+			addPreTriggers(rms, tp, reminder, utcTp);
+		}
+	}
+
+	static void addPreTriggers(Reminders& rms, time_point_s tp, const std::shared_ptr<const ReminderInfo>& reminder,
+	    time_point_s utcTp) {
+		for (auto offset : reminder->preReminders()) {
+			const auto preTp = tp - std::chrono::minutes(offset);
+			if (preTp > utcTp) {
+				rms.emplace(preTp, Trigger{reminder, offset});
+			}
+		}
+	}
+
+	// Keeps _heads (the earliest deadline of every non-empty chat) in sync with the chat's timers, so
+	// a sweep only touches chats that are due.
+	std::uint64_t chatVersionImpl(std::int64_t chatId) const {
+		auto found = _chatVersions.find(chatId);
+		return found == _chatVersions.end() ? 0 : found->second;
+	}
+
+	template<class F>
+	void modifyChat(std::int64_t chatId, F&& f) {
+		++_version;
+		++_chatVersions[chatId];
+		auto& rms = _order[chatId];
+		const auto before = static_cast<std::int64_t>(rms.size());
+		if (!rms.empty()) {
+			_heads.erase({rms.begin()->first, chatId});
+		}
+		f(rms);
+		_queueSize.add(static_cast<std::int64_t>(rms.size()) - before);
+		if (rms.empty()) {
+			_order.erase(chatId);
+		} else {
+			_heads.emplace(rms.begin()->first, chatId);
+		}
+	}
+
+	// Points the alarm at the earliest deadline after a change. A timerfd alarm is re-armed in place, a
+	// CondAlarm wakes the scheduler only if the deadline moved earlier.
+	void rearm() {
+		if (!_heads.empty()) {
+			_alarm->set(_heads.begin()->first + _window);
+		}
+	}
+
+	void sleep(std::unique_lock<std::mutex>& lk, time_point_s deadline) {
+		_alarm->set(deadline);
+		woke(_alarm->wait(lk));
+	}
+
+	void woke(Alarm::Reason reason) {
+		_wakeups.inc();
+		if (reason == Alarm::Reason::ClockJump) {
+			_clockJumps.inc();
+		}
+		if (_running && (_heads.empty() || _heads.begin()->first + _window > _clock.now())) {
+			_spuriousWakeups.inc();
+		}
+	}
+
+	// Returns the next wake up point.
+	time_point_s fire(std::unique_lock<std::mutex>& lk) {
+		TRACE_SCOPE("ReminderQuery::fire", "scheduler");
+		const auto utcTp = _clock.now();
+
+		while (!_heads.empty() && _heads.begin()->first + _window <= utcTp) {
+			const auto chatId = _heads.begin()->second;
+			modifyChat(chatId, [&](Reminders& reminders) {
+				while (!reminders.empty() && reminders.begin()->first <= utcTp) {
+					auto node = reminders.extract(reminders.begin());
+					const auto& trigger = node.mapped();
+					_ringNow.push_back({chatId, trigger.reminder, trigger.preMinutes, node.key(), {}});
+					auto& r = _ringNow.back();
+					if (r.preMinutes) {
+						continue;
+					}
+					if (r.reminder->isRepeatable()) {
+						const auto& zone = _zones.zone(chatId);
+						const auto base = std::max(utcTp, r.deadline);
+						r.nextTp = nextOccurrence(*r.reminder, zone.toLocal(base));
+						auto nextUtc = zone.toUtc(r.nextTp);
+						if (nextUtc > base) {
+							if (_wal) {
+								_wal->rescheduled(chatId, r.reminder->_id, r.deadline, nextUtc);
+							}
+							if (r.reminder->pre_reminder) {
+								addPreTriggers(reminders, nextUtc, r.reminder, base);
+							}
+							node.key() = nextUtc;
+							reminders.insert(std::move(node));
+							continue;
+						}
+					}
+					if (_wal) {
+						_wal->fired(chatId, r.reminder->_id, r.deadline);
+					}
+				}
+			});
+		}
+		if (!_ringNow.empty()) {
+			auto ringNow = std::move(_ringNow);
+			_ringNow.clear();
+			auto hook = _fireHook;
+
+			lk.unlock();
+			// A chat's triggers are adjacent in ringNow, each run goes out as as few messages as fit.
+			size_t messagesSent = 0;
+			for (size_t i = 0; i != ringNow.size();) {
+				const auto chatId = ringNow[i].chatId;
+				const auto first = i;
+				std::vector<std::string> messages(1);
+				for (; i != ringNow.size() && ringNow[i].chatId == chatId; ++i) {
+					const auto& r = ringNow[i];
+					if (hook) {
+						hook(r.chatId, *r.reminder, r.deadline, utcTp);
+					}
+					_lateness.observe(std::max(0.0, std::chrono::duration<double>(utcTp - r.deadline).count()));
+					std::string text;
+					if (r.preMinutes) {
+						text = fmt::format("🔔 Через {}:\n\n⏰{}⏰\n\n{}", prettyOffset(r.preMinutes), r.reminder->descr,
+						    r.reminder->pretty());
+					} else {
+						std::string nextRing;
+						if (r.reminder->isRepeatable()) {
+							nextRing = fmt::format("\n\nСледующее напоминание:\n{}", prettyDateTime(r.nextTp));
+						}
+						text = fmt::format("⏰{}⏰\n\n{}{}", r.reminder->descr, r.reminder->pretty(), nextRing);
+					}
+					if (!messages.back().empty()) {
+						if (messages.back().size() + 2 + text.size() > MAX_MESSAGE_SIZE) {
+							messages.emplace_back();
+						} else {
+							messages.back() += "\n\n";
+						}
+					}
+					messages.back() += text;
+				}
+				for (const auto& msg : messages) {
+					try {
+						TRACE_SCOPE("ReminderQuery::send", "scheduler", chatId);
+						_sender(chatId, msg);
+					} catch (const std::exception& e) {
+						_sendErrors.inc();
+						std::string ids;
+						for (auto j = first; j != i; ++j) {
+							ids += fmt::format("{}{}", ids.empty() ? "" : ",", ringNow[j].reminder->_id);
+						}
+						logger().error("send_failed chat={} reminders={} error={}", chatId, ids, e.what());
+					}
+				}
+				messagesSent += messages.size();
+			}
+			_fired += ringNow.size();
+			_firedTotal.inc(ringNow.size());
+			_messagesTotal.inc(messagesSent);
+			_callsSaved.inc(ringNow.size() - messagesSent);
+			lk.lock();
+		}
+
+		return _heads.empty() ? utcTp + date::years(1) : _heads.begin()->first + _window;
+	}
+
+  private:
+	mutable std::mutex _m;
+	std::atomic_bool _running = true;
+	std::atomic<size_t> _fired = 0;
+	std::atomic<std::uint64_t> _version = 0;
+
+	Gauge& _queueSize = metrics().gauge("reminder_queue_size", "Timers queued in the scheduler");
+	Counter& _firedTotal = metrics().counter("reminder_fired_total", "Fired reminder triggers");
+	Counter& _sendErrors = metrics().counter("reminder_send_errors_total", "Failed reminder sends");
+	Counter& _messagesTotal = metrics().counter("reminder_messages_total", "Reminder messages sent");
+	Counter& _callsSaved =
+	    metrics().counter("reminder_send_calls_saved_total", "Reminder triggers merged into another message");
+	Counter& _wakeups = metrics().counter("scheduler_wakeups_total", "Scheduler thread wakeups");
+	Counter& _spuriousWakeups =
+	    metrics().counter("scheduler_spurious_wakeups_total", "Scheduler wakeups with nothing due");
+	Counter& _clockJumps = metrics().counter("scheduler_clock_jumps_total", "Wall clock changes seen by the scheduler");
+	Histogram& _lateness = metrics().histogram("reminder_fire_lateness_seconds", "Fire time minus deadline",
+	    {0, 1, 2, 5, 10, 30, 60, 300, 900});
+
+	Sender _sender;
+	FireHook _fireHook;
+	const ChatZones& _zones;
+	Clock& _clock;
+	std::unique_ptr<Alarm> _alarm = _clock.makeAlarm();
+	SchedulerWal* _wal = nullptr;
+	std::chrono::seconds _window{0};
+
+	struct RingInfo {
+		std::int64_t chatId;
+		std::shared_ptr<const ReminderInfo> reminder;
+		std::int64_t preMinutes;
+		time_point_s deadline;
+		time_point_s nextTp;
+	};
+	std::vector<RingInfo> _ringNow;
+
+	FlatHashMap<std::int64_t /*chatId*/, Reminders> _order;
+	std::set<std::pair<time_point_s, std::int64_t /*chatId*/>> _heads;
+	FlatHashMap<std::int64_t /*chatId*/, std::uint64_t> _chatVersions;
+};
+
+// Next fire points (UTC) of the reminders which still have one.
+inline std::vector<std::pair<time_point_s, ReminderInfo>> nextTimers(const std::vector<ReminderInfo>& reminders,
+    const TzTable& zone, time_point_s utcTp) {
+	std::vector<std::pair<time_point_s, ReminderInfo>> timers;
+	const auto localTp = zone.toLocal(utcTp);
+	for (const auto& r : reminders) {
+		auto nextTp = nextOccurrence(r, localTp);
+		if (nextTp > localTp) {
+			timers.emplace_back(zone.toUtc(nextTp), r);
+		}
+	}
+
+	return timers;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "reminder_info.hpp"
+#include "reminder_store.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <unqlite_cpp/unqlite_cpp.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline bool eraseReminder(ReminderStore& store, std::int64_t chatId, std::int64_t recId) {
+	TRACE_SCOPE("eraseReminder", "storage", chatId);
+	bool erased = store.erase(chatId, recId);
+	store.commit();
+
+	return erased;
+}
+
+// Uncommitted, so a batch of reminders can share one commit.
+inline std::int64_t storeReminder(ReminderStore& store, std::int64_t chatId, const ReminderInfo& ri) {
+	TRACE_SCOPE("storeReminder", "storage", chatId);
+	return store.add(chatId, ri);
+}
+
+inline bool updateReminder(ReminderStore& store, std::int64_t chatId, const ReminderInfo& ri) {
+	TRACE_SCOPE("updateReminder", "storage", chatId);
+	bool updated = store.update(chatId, ri);
+	store.commit();
+
+	return updated;
+}
+
+inline std::vector<ReminderInfo> loadReminders(ReminderStore& store, std::int64_t chatId) {
+	TRACE_SCOPE("loadReminders", "storage", chatId);
+	return store.load(chatId);
+}
+
+// Reminders kept as documents of the chat's collection, the format before ReminderStore.
+inline std::vector<ReminderInfo> loadReminderDocuments(up::db& db, std::int64_t chatId) {
+	TRACE_SCOPE("loadReminderDocuments", "storage", chatId);
+	auto collection = fmt::format("reminders_{}", chatId);
+	up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw(collection);
+
+	if (!value.is_array() || value.size() == 0) {
+		return {};
+	}
+
+	std::vector<ReminderInfo> res;
+	value.foreach_array([&](int64_t i, const up::value& v) {
+		ReminderInfo ri;
+		ri.fromValue(v);
+		res.push_back(ri);
+
+		return true;
+	});
+
+	return res;
+}
+
+struct UserChat {
+	std::int64_t userId;
+	std::int64_t chatId;
+};
+inline std::vector<UserChat> loadUserChats(up::db& db) {
+	up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw("users");
+
+	if (!value.is_array() || value.size() == 0) {
+		return {};
+	}
+
+	std::vector<UserChat> res;
+	value.foreach_array([&](int64_t i, const up::value& v) {
+		res.push_back({v.at("id").get_int_or_throw(), v.at("chat_id").get_int_or_throw()});
+
+		return true;
+	});
+
+	return res;
+}
+
+inline bool isChatRegistered(up::db& db, std::int64_t chatId) {
+	auto collection = fmt::format("reminders_{}", chatId);
+	return up::vm_collection_exist(db).exist(collection);
+}
+
+inline void registerChat(up::db& db, std::int64_t userId, std::int64_t chatId) {
+	auto collection = fmt::format("reminders_{}", chatId);
+	db.compile_or_throw("db_create($col);").bind_or_throw("col", collection).exec_or_throw();
+	commitOrThrow(db);
+
+	up::vm_store_record(db).store_or_throw("users", up::value::object{{"id", userId}, {"chat_id", chatId}});
+}
+
+// Drops the chat's registration, its reminders stay wherever they are stored.
+inline void unregisterChat(up::db& db, std::int64_t chatId) {
+	up::value value = up::vm_fetch_all_records(db).fetch_value_or_throw("users");
+	std::vector<std::int64_t> ids;
+	value.foreach_if_array([&](int64_t, const up::value& v) {
+		if (v.at("chat_id").get_int_or_throw() == chatId) {
+			ids.push_back(v.at("__id").get_int_or_throw());
+		}
+		return true;
+	});
+	for (auto id : ids) {
+		up::vm_drop_record(db).drop("users", id);
+	}
+	db.compile_or_throw("db_drop_collection($col);")
+	    .bind_or_throw("col", fmt::format("reminders_{}", chatId))
+	    .exec_or_throw();
+	commitOrThrow(db);
+}
+
+constexpr std::int64_t REMINDER_STORE_FORMAT = 1;
+
+// Copies the reminder documents of every registered chat into `store` once, keeping their ids. The documents
+// stay in db.bin untouched, an older build still finds them. Returns the number of copied reminders.
+inline size_t migrateReminders(up::db& db, ReminderStore& store) {
+	if (store.format() >= REMINDER_STORE_FORMAT) {
+		return 0;
+	}
+	TRACE_SCOPE("migrateReminders", "storage");
+	size_t count = 0;
+	for (const auto& uc : loadUserChats(db)) {
+		auto reminders = loadReminderDocuments(db, uc.chatId);
+		count += reminders.size();
+		store.put(uc.chatId, reminders);
+	}
+	store.setFormat(REMINDER_STORE_FORMAT);
+	store.commit();
+
+	return count;
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "reminder_codec.hpp"
+#include "reminder_info.hpp"
+
+#include <fmt/format.h>
+#include <unqlite.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Reminders in UnQLite's key/value layer: one value per chat holding its PackedReminder records back to
+// back, so loading a chat is one fetch and a run of memcpy's instead of a document per reminder with
+// string-keyed field lookups. Ids are handed out by a per-chat counter and never reused.
+// Not synchronized, callers serialize access as they do for up::db.
+class ReminderStore {
+  public:
+	// A chat's records and id counter as stored, for copying the store to another file.
+	struct Packed {
+		std::int64_t chatId = 0;
+		std::string records;
+		std::int64_t nextId = 0;
+	};
+
+	explicit ReminderStore(std::string path): _path(std::move(path)) {
+		if (unqlite_open(&_db, _path.c_str(), UNQLITE_OPEN_CREATE) != UNQLITE_OK) {
+			throw std::runtime_error(fmt::format("can't open {}", _path));
+		}
+	}
+	ReminderStore(const ReminderStore&) = delete;
+	ReminderStore& operator=(const ReminderStore&) = delete;
+	~ReminderStore() { unqlite_close(_db); }
+
+	std::vector<ReminderInfo> load(std::int64_t chatId) {
+		std::vector<ReminderInfo> res;
+		auto data = fetch(key(RECORDS, chatId));
+		if (!data) {
+			return res;
+		}
+		const char* pos = data->data();
+		const char* end = pos + data->size();
+		ReminderInfo ri;
+		while (pos != end) {
+			if (!readReminder(pos, end, ri)) {
+				throw std::runtime_error(fmt::format("corrupted reminders of chat {}", chatId));
+			}
+			res.push_back(std::move(ri));
+		}
+
+		return res;
+	}
+
+	// Appends `ri` under a new id, returns the id. Uncommitted.
+	std::int64_t add(std::int64_t chatId, ReminderInfo ri) {
+		ri._id = nextId(chatId);
+		std::string record;
+		appendReminder(record, ri);
+		check(unqlite_kv_append(_db, key(RECORDS, chatId).data(), KEY_SIZE, record.data(), record.size()));
+		_changed.insert(chatId);
+
+		return ri._id;
+	}
+
+	// Replaces the reminder with the same id, returns false if there is none. Uncommitted.
+	bool update(std::int64_t chatId, const ReminderInfo& ri) {
+		auto reminders = load(chatId);
+		for (auto& r : reminders) {
+			if (r._id == ri._id) {
+				r = ri;
+				put(chatId, reminders);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Returns false if there is no reminder with `id`. Uncommitted.
+	bool erase(std::int64_t chatId, std::int64_t id) {
+		auto reminders = load(chatId);
+		auto found = std::find_if(reminders.begin(), reminders.end(), [id](const auto& r) { return r._id == id; });
+		if (found == reminders.end()) {
+			return false;
+		}
+		reminders.erase(found);
+		put(chatId, reminders);
+
+		return true;
+	}
+
+	// Replaces all reminders of the chat keeping their ids. Uncommitted.
+	void put(std::int64_t chatId, const std::vector<ReminderInfo>& reminders) {
+		std::string data;
+		std::int64_t maxId = -1;
+		for (const auto& ri : reminders) {
+			appendReminder(data, ri);
+			maxId = std::max(maxId, ri._id);
+		}
+		check(unqlite_kv_store(_db, key(RECORDS, chatId).data(), KEY_SIZE, data.data(), data.size()));
+		if (maxId >= peekId(chatId)) {
+			storeId(chatId, maxId + 1);
+		}
+		_changed.insert(chatId);
+	}
+
+	void commit() { check(unqlite_commit(_db)); }
+
+	// Format of the store, 0 until migrateReminders() has copied the documents over.
+	std::int64_t format() {
+		auto data = fetch(key(META, 0));
+		std::int64_t v = 0;
+		if (data && data->size() == sizeof(v)) {
+			std::memcpy(&v, data->data(), sizeof(v));
+		}
+
+		return v;
+	}
+
+	void setFormat(std::int64_t v) { check(unqlite_kv_store(_db, key(META, 0).data(), KEY_SIZE, &v, sizeof(v))); }
+
+	const std::string& path() const { return _path; }
+
+	// Chats that have reminder records, including emptied ones.
+	std::vector<std::int64_t> chats() {
+		std::vector<std::int64_t> res;
+		unqlite_kv_cursor* cursor = nullptr;
+		check(unqlite_kv_cursor_init(_db, &cursor));
+		for (unqlite_kv_cursor_first_entry(cursor); unqlite_kv_cursor_valid_entry(cursor);
+		     unqlite_kv_cursor_next_entry(cursor)) {
+			char k[KEY_SIZE];
+			int size = 0;
+			if (unqlite_kv_cursor_key(cursor, nullptr, &size) == UNQLITE_OK && size == KEY_SIZE &&
+			    unqlite_kv_cursor_key(cursor, k, &size) == UNQLITE_OK && k[0] == RECORDS) {
+				std::int64_t chatId;
+				std::memcpy(&chatId, k + 1, sizeof(chatId));
+				res.push_back(chatId);
+			}
+		}
+		unqlite_kv_cursor_release(_db, cursor);
+
+		return res;
+	}
+
+	// Chats written since the previous call.
+	std::vector<std::int64_t> takeChanged() {
+		std::vector<std::int64_t> res(_changed.begin(), _changed.end());
+		_changed.clear();
+		return res;
+	}
+
+	Packed packed(std::int64_t chatId) { return {chatId, fetch(key(RECORDS, chatId)).value_or(""), peekId(chatId)}; }
+
+	// Stores the chat as packed() returned it. Uncommitted.
+	void putPacked(const Packed& p) {
+		check(unqlite_kv_store(_db, key(RECORDS, p.chatId).data(), KEY_SIZE, p.records.data(), p.records.size()));
+		storeId(p.chatId, p.nextId);
+		_changed.insert(p.chatId);
+	}
+
+	// Moves `from` over the store's file and switches to it. The old file stays open until the new one has
+	// been opened and read, if the move or that read fails the old file is put back and false is returned.
+	bool replaceFile(const std::string& from) {
+		const auto previous = _path + ".previous";
+		std::remove(previous.c_str());
+		if (::link(_path.c_str(), previous.c_str()) != 0) {
+			return false;
+		}
+		if (std::rename(from.c_str(), _path.c_str()) != 0) {
+			std::remove(previous.c_str());
+			return false;
+		}
+		unqlite* db = nullptr;
+		unqlite_int64 size = 0;
+		const auto meta = key(META, 0);
+		const bool opened = unqlite_open(&db, _path.c_str(), UNQLITE_OPEN_CREATE) == UNQLITE_OK;
+		if (!opened || unqlite_kv_fetch(db, meta.data(), KEY_SIZE, nullptr, &size) != UNQLITE_OK) {
+			if (opened) {
+				unqlite_close(db);
+			}
+			std::rename(previous.c_str(), _path.c_str());
+			return false;
+		}
+		unqlite_close(_db);
+		_db = db;
+		std::remove(previous.c_str());
+
+		return true;
+	}
+
+  private:
+	static constexpr char RECORDS = 'r';
+	static constexpr char NEXT_ID = 'n';
+	static constexpr char META = 'm';
+	static constexpr int KEY_SIZE = 1 + sizeof(std::int64_t);
+
+	static std::string key(char tag, std::int64_t chatId) {
+		std::string k(KEY_SIZE, tag);
+		std::memcpy(&k[1], &chatId, sizeof(chatId));
+		return k;
+	}
+
+	static void check(int rc) {
+		if (rc != UNQLITE_OK) {
+			throw std::runtime_error(fmt::format("unqlite kv error {}", rc));
+		}
+	}
+
+	std::optional<std::string> fetch(const std::string& k) {
+		unqlite_int64 size = 0;
+		int rc = unqlite_kv_fetch(_db, k.data(), KEY_SIZE, nullptr, &size);
+		if (rc == UNQLITE_NOTFOUND) {
+			return {};
+		}
+		check(rc);
+		std::string data(size, '\0');
+		check(unqlite_kv_fetch(_db, k.data(), KEY_SIZE, data.data(), &size));
+		data.resize(size);
+
+		return data;
+	}
+
+	std::int64_t peekId(std::int64_t chatId) {
+		auto data = fetch(key(NEXT_ID, chatId));
+		std::int64_t id = 0;
+		if (data && data->size() == sizeof(id)) {
+			std::memcpy(&id, data->data(), sizeof(id));
+		}
+
+		return id;
+	}
+
+	void storeId(std::int64_t chatId, std::int64_t id) {
+		check(unqlite_kv_store(_db, key(NEXT_ID, chatId).data(), KEY_SIZE, &id, sizeof(id)));
+	}
+
+	std::int64_t nextId(std::int64_t chatId) {
+		auto id = peekId(chatId);
+		storeId(chatId, id + 1);
+		return id;
+	}
+
+	const std::string _path;
+	unqlite* _db = nullptr;
+	std::unordered_set<std::int64_t> _changed;
+};
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "log.hpp"
+#include "metrics.hpp"
+#include "scheduler_wal.hpp"
+
+#include <boost/asio.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Messages of the replication stream, framed as u8 kind | u32 size | payload.
+enum class ReplicationMsg : std::uint8_t {
+	Begin = 1,     // a full image follows, the follower starts over
+	Record = 2,    // a SchedulerWal frame
+	End = 3,       // u64 lsn: the image is complete up to lsn, live records follow
+	Heartbeat = 4, // u64 primary lsn | i64 sent at, ms since epoch
+};
+
+// State of the primary a follower starts from: StoreChat records of every chat and Add records of the
+// queued timers, all as of journal record `lsn`.
+struct ReplicationSnapshot {
+	std::uint64_t lsn = 0;
+	std::vector<WalRecord> records;
+};
+
+// Exclusive flock on <socket>.lock, held by the primary serving on the socket for as long as it runs. The
+// kernel releases it only when the holder is gone, so a follower that gets it knows the primary is dead and
+// not just slow, and a restarted primary that can't get it knows a follower took over meanwhile.
+class PrimaryLock {
+  public:
+	explicit PrimaryLock(const std::string& socketPath):
+	    _fd(::open((socketPath + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+		if (_fd < 0) {
+			throw std::runtime_error("can't open " + socketPath + ".lock");
+		}
+	}
+	PrimaryLock(PrimaryLock&& other) noexcept: _fd(std::exchange(other._fd, -1)) {}
+	PrimaryLock& operator=(PrimaryLock&&) = delete;
+	~PrimaryLock() { unlock(); }
+
+	bool tryLock() { return ::flock(_fd, LOCK_EX | LOCK_NB) == 0; }
+
+	// Releases the lock for good.
+	void unlock() {
+		if (_fd >= 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+
+  private:
+	int _fd;
+};
+
+// Streams the journal of a primary to followers over a unix socket. A follower that connects gets a
+// snapshot and then every frame appended to the journal after it; one that falls too far behind is
+// disconnected and resyncs from a new snapshot when it reconnects.
+class ReplicationServer {
+  public:
+	// `snapshot` is called on a thread of its own, it has to be consistent with the journal's lsn.
+	using SnapshotFn = std::function<ReplicationSnapshot()>;
+
+	static constexpr size_t MAX_BACKLOG = 1 << 16;
+
+	// An idle stream, or one waiting for its snapshot, carries a heartbeat every `heartbeat`. The caller holds
+	// the PrimaryLock of `path`.
+	ReplicationServer(const std::string& path, SchedulerWal& wal, SnapshotFn snapshot,
+	    std::chrono::milliseconds heartbeat = std::chrono::seconds(1)):
+	    _wal(wal), _snapshot(std::move(snapshot)), _heartbeat(heartbeat), _acceptor(_io) {
+		::unlink(path.c_str());
+		boost::asio::local::stream_protocol::endpoint endpoint(path);
+		_acceptor.open(endpoint.protocol());
+		_acceptor.bind(endpoint);
+		_acceptor.listen();
+		_wal.setListener([this](std::uint64_t lsn, const std::string& frame) { publish(lsn, frame); });
+		_running = true;
+		_acceptThread = std::thread([this] { acceptLoop(); });
+	}
+
+	~ReplicationServer() { stop(); }
+
+	void stop() {
+		if (!_running.exchange(false)) {
+			return;
+		}
+		_wal.setListener(nullptr);
+		// Closing the acceptor doesn't wake a blocked accept(), shutting it down does.
+		::shutdown(_acceptor.native_handle(), SHUT_RDWR);
+		boost::system::error_code ec;
+		_acceptor.close(ec);
+		if (_acceptThread.joinable()) {
+			_acceptThread.join();
+		}
+
+		std::vector<std::shared_ptr<Session>> served;
+		{
+			std::scoped_lock l(_m);
+			for (auto& s : _sessions) {
+				s->socket.shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, ec);
+			}
+			served.swap(_served);
+			_cond.notify_all();
+		}
+		for (auto& s : served) {
+			s->thread.join();
+		}
+	}
+
+	size_t followers() const {
+		std::scoped_lock l(_m);
+		return _sessions.size();
+	}
+
+  private:
+	struct Session {
+		explicit Session(boost::asio::io_context& io): socket(io) {}
+
+		boost::asio::local::stream_protocol::socket socket;
+		std::deque<std::pair<std::uint64_t, std::string>> backlog;
+		bool overflowed = false;
+		std::thread thread;
+		std::atomic_bool done = false;
+	};
+
+	static std::string message(ReplicationMsg kind, const std::string& payload) {
+		std::string out;
+		out.reserve(5 + payload.size());
+		out += static_cast<char>(kind);
+		const auto size = static_cast<std::uint32_t>(payload.size());
+		out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		out += payload;
+		return out;
+	}
+
+	template<class... T>
+	static std::string pack(T... v) {
+		std::string out;
+		(out.append(reinterpret_cast<const char*>(&v), sizeof(v)), ...);
+		return out;
+	}
+
+	// Journal listener, runs under the journal's lock so it only queues the frame.
+	void publish(std::uint64_t lsn, const std::string& frame) {
+		std::scoped_lock l(_m);
+		for (auto& s : _sessions) {
+			if (s->backlog.size() >= MAX_BACKLOG) {
+				s->overflowed = true;
+				continue;
+			}
+			s->backlog.emplace_back(lsn, frame);
+		}
+		_cond.notify_all();
+	}
+
+	void acceptLoop() {
+		while (_running) {
+			auto session = std::make_shared<Session>(_io);
+			boost::system::error_code ec;
+			_acceptor.accept(session->socket, ec);
+			if (ec) {
+				if (_running) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+				continue;
+			}
+
+			std::scoped_lock l(_m);
+			reapSessions();
+			_sessions.push_back(session);
+			_served.push_back(session);
+			_followers.set(_sessions.size());
+			session->thread = std::thread([this, s = session.get()] {
+				serve(*s);
+				s->done = true;
+			});
+		}
+	}
+
+	// Joins the threads of finished sessions, a follower reconnecting over and over doesn't pile them up.
+	// Called under _m.
+	void reapSessions() {
+		for (auto it = _served.begin(); it != _served.end();) {
+			if ((*it)->done) {
+				(*it)->thread.join();
+				it = _served.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void serve(Session& session) {
+		boost::system::error_code ec;
+		auto send = [&](ReplicationMsg kind, const std::string& payload) {
+			boost::asio::write(session.socket, boost::asio::buffer(message(kind, payload)), ec);
+			return !ec;
+		};
+		auto heartbeat = [&] {
+			const auto sentAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+			    std::chrono::system_clock::now().time_since_epoch());
+			return send(ReplicationMsg::Heartbeat, pack(_wal.lsn(), static_cast<std::int64_t>(sentAt.count())));
+		};
+
+		// The session already collects frames, those the snapshot includes are skipped. The snapshot waits for
+		// the primary's locks, which a compaction or an import may hold for long, so it is built on a thread
+		// of its own while the session keeps heartbeating.
+		std::uint64_t snapshotLsn = 0;
+		try {
+			auto pending = std::async(std::launch::async, [this] { return _snapshot(); });
+			bool ok = true;
+			while (pending.wait_for(_heartbeat) != std::future_status::ready) {
+				ok = ok && heartbeat();
+			}
+			auto snapshot = pending.get();
+			snapshotLsn = snapshot.lsn;
+			ok = ok && send(ReplicationMsg::Begin, {});
+			for (const auto& r : snapshot.records) {
+				std::string frame;
+				SchedulerWal::encode(frame, r);
+				ok = ok && send(ReplicationMsg::Record, frame);
+			}
+			ok = ok && send(ReplicationMsg::End, pack(snapshotLsn));
+			if (!ok) {
+				drop(session);
+				return;
+			}
+		} catch (const std::exception& e) {
+			logger().error("replication_snapshot_failed error={}", e.what());
+			drop(session);
+			return;
+		}
+
+		std::unique_lock lk(_m);
+		while (_running && !session.overflowed) {
+			if (session.backlog.empty()) {
+				if (!_cond.wait_for(lk, _heartbeat, [&] { return !_running || !session.backlog.empty(); })) {
+					lk.unlock();
+					const bool ok = heartbeat();
+					lk.lock();
+					if (!ok) {
+						break;
+					}
+				}
+				continue;
+			}
+			auto backlog = std::move(session.backlog);
+			session.backlog.clear();
+			lk.unlock();
+			bool ok = true;
+			for (const auto& [lsn, frame] : backlog) {
+				if (lsn > snapshotLsn && !(ok = send(ReplicationMsg::Record, frame))) {
+					break;
+				}
+			}
+			lk.lock();
+			if (!ok) {
+				break;
+			}
+		}
+		if (session.overflowed) {
+			_overflows.inc();
+		}
+		lk.unlock();
+		drop(session);
+	}
+
+	void drop(Session& session) {
+		boost::system::error_code ec;
+		session.socket.shutdown(boost::asio::local::stream_protocol::socket::shutdown_both, ec);
+		std::scoped_lock l(_m);
+		_sessions.erase(std::remove_if(_sessions.begin(), _sessions.end(),
+		                    [&](const auto& s) { return s.get() == &session; }),
+		    _sessions.end());
+		_followers.set(_sessions.size());
+	}
+
+  private:
+	SchedulerWal& _wal;
+	SnapshotFn _snapshot;
+	const std::chrono::milliseconds _heartbeat;
+	std::atomic_bool _running = false;
+
+	boost::asio::io_context _io;
+	boost::asio::local::stream_protocol::acceptor _acceptor;
+	std::thread _acceptThread;
+
+	mutable std::mutex _m;
+	std::condition_variable _cond;
+	std::vector<std::shared_ptr<Session>> _sessions; // receiving frames
+	std::vector<std::shared_ptr<Session>> _served;   // with a thread to join
+
+	Gauge& _followers = metrics().gauge("replication_followers", "Followers connected to the primary");
+	Counter& _overflows =
+	    metrics().counter("replication_overflows_total", "Followers disconnected for falling too far behind");
+};
+
+// Hot standby side of ReplicationServer: applies the primary's snapshot and journal through the callbacks
+// and, once the primary is gone, returns so the process can take over. Gone means its PrimaryLock could be
+// taken: a primary that is only slow or stuck keeps its lock and is waited for, taking over from it would
+// leave two processes polling the same bot.
+class ReplicationFollower {
+  public:
+	struct Callbacks {
+		std::function<void()> begin;                   // a full image follows
+		std::function<void(const WalRecord&)> record;  // snapshot or live record
+		std::function<void(std::uint64_t lsn)> end;    // the image is complete
+	};
+
+	ReplicationFollower(std::string path, Callbacks callbacks):
+	    _path(std::move(path)), _callbacks(std::move(callbacks)), _lock(_path) {}
+
+	// Follows the primary until it is gone, reconnecting while it is alive. Returns only after at least one
+	// complete image (or once `stop` is set), true if the last image was completed too, otherwise the queue
+	// image is partial and has to be rebuilt from the replicated storage.
+	bool run(const std::atomic_bool& stop) {
+		while (!stop) {
+			if (_synced && _lock.tryLock()) {
+				break;
+			}
+			boost::asio::io_context io;
+			boost::asio::local::stream_protocol::socket socket(io);
+			boost::system::error_code ec;
+			socket.connect(boost::asio::local::stream_protocol::endpoint(_path), ec);
+			if (ec) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				continue;
+			}
+			follow(socket, stop);
+		}
+		return _complete;
+	}
+
+	std::uint64_t appliedLsn() const { return _appliedLsn; }
+
+	// The dead primary's lock once run() returned, holding it keeps that primary from coming back.
+	PrimaryLock takeLock() { return std::move(_lock); }
+
+  private:
+	void follow(boost::asio::local::stream_protocol::socket& socket, const std::atomic_bool& stop) {
+		boost::system::error_code ec;
+		std::string payload;
+		while (!stop) {
+			pollfd pfd{socket.native_handle(), POLLIN, 0};
+			if (::poll(&pfd, 1, 100) <= 0) {
+				// A connection outliving its primary (inherited by a child) doesn't hold up the takeover.
+				if (_synced && _lock.tryLock()) {
+					return;
+				}
+				continue;
+			}
+
+			char header[5];
+			boost::asio::read(socket, boost::asio::buffer(header), ec);
+			if (ec) {
+				return;
+			}
+			std::uint32_t size;
+			std::memcpy(&size, header + 1, sizeof(size));
+			const auto kind = static_cast<ReplicationMsg>(header[0]);
+			if (size > MAX_MESSAGE_SIZE || size < payloadSize(kind)) {
+				logger().error("replication_bad_message kind={} size={}", static_cast<int>(header[0]), size);
+				return;
+			}
+			payload.resize(size);
+			boost::asio::read(socket, boost::asio::buffer(payload), ec);
+			if (ec) {
+				return;
+			}
+
+			switch (kind) {
+			case ReplicationMsg::Begin:
+				_complete = false;
+				_callbacks.begin();
+				break;
+			case ReplicationMsg::Record: {
+				WalRecord r;
+				if (!SchedulerWal::decode(payload.data(), payload.size(), r)) {
+					logger().error("replication_corrupted_record size={}", payload.size());
+					return;
+				}
+				_callbacks.record(r);
+				_applied.inc();
+				if (_complete) {
+					_appliedLsn = r.lsn;
+				}
+				break;
+			}
+			case ReplicationMsg::End: {
+				std::uint64_t lsn;
+				std::memcpy(&lsn, payload.data(), sizeof(lsn));
+				_appliedLsn = lsn;
+				_callbacks.end(lsn);
+				_synced = _complete = true;
+				break;
+			}
+			case ReplicationMsg::Heartbeat: {
+				std::uint64_t primaryLsn;
+				std::int64_t sentAt;
+				std::memcpy(&primaryLsn, payload.data(), sizeof(primaryLsn));
+				std::memcpy(&sentAt, payload.data() + sizeof(primaryLsn), sizeof(sentAt));
+				const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+				    std::chrono::system_clock::now().time_since_epoch());
+				_lagRecords.set(primaryLsn > _appliedLsn ? static_cast<std::int64_t>(primaryLsn - _appliedLsn) : 0);
+				_lagMs.set(std::max<std::int64_t>(0, now.count() - sentAt));
+				break;
+			}
+			}
+		}
+	}
+
+	// Smallest valid payload of a message of `kind`.
+	static size_t payloadSize(ReplicationMsg kind) {
+		switch (kind) {
+		case ReplicationMsg::End: return sizeof(std::uint64_t);
+		case ReplicationMsg::Heartbeat: return sizeof(std::uint64_t) + sizeof(std::int64_t);
+		default: return 0;
+		}
+	}
+
+  private:
+	static constexpr std::uint32_t MAX_MESSAGE_SIZE = 64 << 20;
+
+	const std::string _path;
+	Callbacks _callbacks;
+	PrimaryLock _lock;
+
+	bool _synced = false;   // an image was completed at least once
+	bool _complete = false; // the last image was completed
+	std::atomic<std::uint64_t> _appliedLsn = 0;
+
+	Counter& _applied = metrics().counter("replication_records_applied_total", "Records applied by the follower");
+	Gauge& _lagRecords =
+	    metrics().gauge("replication_lag_records", "Journal records the primary had that the follower hasn't applied");
+	Gauge& _lagMs = metrics().gauge("replication_lag_ms", "Age of the last primary heartbeat the follower applied");
+};
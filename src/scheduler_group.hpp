@@ -0,0 +1,168 @@
+#pragma once
+
+#include "log.hpp"
+#include "reminder_query.hpp"
+
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Runs the schedulers of the bots hosted in one process on one thread. It sleeps on an epoll over their
+// alarms and polls the queue whose alarm fired, so an idle bot costs a descriptor rather than a thread.
+// Sends of all the bots go out from that thread, one queue's burst delays the others by its send time.
+//
+// A queue whose clock has no pollable alarm (a VirtualClock, or not Linux) gets a run() thread of its own.
+class SchedulerGroup {
+  public:
+	SchedulerGroup() {
+#ifdef __linux__
+		_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+		_wake = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (_epoll < 0 || _wake < 0) {
+			close();
+			throw std::runtime_error("Can't create the scheduler group");
+		}
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &ev);
+		_thread = std::thread([this] { run(); });
+#endif
+	}
+
+	~SchedulerGroup() {
+		stop();
+		close();
+	}
+
+	SchedulerGroup(const SchedulerGroup&) = delete;
+	SchedulerGroup& operator=(const SchedulerGroup&) = delete;
+
+	// Serves `q` until remove(), q.run() must not be called.
+	void add(ReminderQuery& q) {
+		std::unique_lock l(_m);
+		if (q.alarmFd() < 0 || _epoll < 0) {
+			_threads.emplace(&q, std::thread([&q] { q.run(); }));
+			return;
+		}
+#ifdef __linux__
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.ptr = &q;
+		if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, q.alarmFd(), &ev) != 0) {
+			throw std::runtime_error("Can't add a scheduler to the group");
+		}
+		_polled.emplace(&q, q.alarmFd());
+		l.unlock();
+		// Fires what is already due and arms the alarm for the rest.
+		std::shared_lock sl(_polling);
+		q.poll();
+#endif
+	}
+
+	// Stops serving `q`. Once it returns the group no longer touches the queue.
+	void remove(ReminderQuery& q) {
+		std::thread thread;
+		{
+			std::unique_lock l(_m);
+			if (auto found = _threads.find(&q); found != _threads.end()) {
+				thread = std::move(found->second);
+				_threads.erase(found);
+			} else if (auto polled = _polled.find(&q); polled != _polled.end()) {
+#ifdef __linux__
+				::epoll_ctl(_epoll, EPOLL_CTL_DEL, polled->second, nullptr);
+#endif
+				_polled.erase(polled);
+			}
+		}
+		if (thread.joinable()) {
+			q.stop();
+			thread.join();
+		}
+		// Waits out a poll of `q` the group thread may have started before the removal.
+		std::unique_lock wait(_polling);
+	}
+
+	void stop() {
+		{
+			std::unique_lock l(_m);
+			if (_stopped) {
+				return;
+			}
+			_stopped = true;
+		}
+#ifdef __linux__
+		const std::uint64_t one = 1;
+		[[maybe_unused]] auto n = ::write(_wake, &one, sizeof(one));
+#endif
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+		std::map<ReminderQuery*, std::thread> threads;
+		{
+			std::unique_lock l(_m);
+			threads.swap(_threads);
+		}
+		for (auto& [q, thread] : threads) {
+			q->stop();
+			thread.join();
+		}
+	}
+
+  private:
+#ifdef __linux__
+	void run() {
+		epoll_event events[16];
+		while (true) {
+			const int n = ::epoll_wait(_epoll, events, 16, -1);
+			for (int i = 0; i < n; ++i) {
+				auto* q = static_cast<ReminderQuery*>(events[i].data.ptr);
+				if (!q) {
+					return;
+				}
+				std::shared_lock polling(_polling);
+				{
+					std::unique_lock l(_m);
+					if (!_polled.count(q)) {
+						continue;
+					}
+				}
+				try {
+					q->poll();
+				} catch (const std::exception& e) { logger().error("scheduler_poll_failed error={}", e.what()); }
+			}
+		}
+	}
+#endif
+
+	void close() {
+#ifdef __linux__
+		for (int fd : {_epoll, _wake}) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+		}
+		_epoll = _wake = -1;
+#endif
+	}
+
+  private:
+	int _epoll = -1;
+	int _wake = -1;
+	std::thread _thread;
+
+	std::mutex _m;
+	bool _stopped = false;
+	std::map<ReminderQuery*, int /*alarm fd*/> _polled;
+	std::map<ReminderQuery*, std::thread> _threads;
+	// Held shared while a queue is polled, remove() takes it exclusively to wait for a poll to finish.
+	std::shared_mutex _polling;
+};
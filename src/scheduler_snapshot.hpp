@@ -0,0 +1,265 @@
+#pragma once
+
+#include "reminder_codec.hpp"
+#include "reminder_query.hpp"
+#include "scheduler_wal.hpp"
+#include "trace.hpp"
+
+#include <boost/crc.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+class MappedFile {
+  public:
+	explicit MappedFile(const std::string& path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		struct stat st;
+		if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				_data = static_cast<const char*>(p);
+				_size = st.st_size;
+			}
+		}
+		::close(fd);
+	}
+
+	~MappedFile() {
+		if (_data) {
+			::munmap(const_cast<char*>(_data), _size);
+		}
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+
+  private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+};
+
+// Scheduler queue image: header, then per timer the fire point, chat id and a binary encoded
+// reminder (see reminder_codec.hpp).
+struct SnapshotHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::int64_t createdAt; // UTC seconds
+	std::uint64_t count;
+	std::uint64_t lsn; // last journal record included
+	std::uint32_t crc; // of everything after the header
+	std::uint32_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 40);
+
+constexpr std::uint32_t SNAPSHOT_MAGIC = 0x53515254; // "TRQS"
+constexpr std::uint32_t SNAPSHOT_VERSION = 2;
+
+struct SchedulerSnapshot {
+	time_point_s createdAt;
+	std::uint64_t lsn = 0;
+	std::vector<ReminderQuery::Timer> timers;
+};
+
+inline std::uint32_t crc32(const char* data, size_t size) {
+	boost::crc_32_type crc;
+	crc.process_bytes(data, size);
+
+	return crc.checksum();
+}
+
+// Writes to a temporary file and renames it over `path`, so readers see either the old or the new
+// snapshot.
+inline bool writeSchedulerSnapshot(const std::string& path, const std::vector<ReminderQuery::Timer>& timers,
+    time_point_s createdAt, std::uint64_t lsn = 0) {
+	TRACE_SCOPE("writeSchedulerSnapshot", "snapshot");
+
+	std::string buf(sizeof(SnapshotHeader), '\0');
+	buf.reserve(sizeof(SnapshotHeader) + timers.size() * (16 + sizeof(PackedReminder) + 16));
+	for (const auto& t : timers) {
+		const std::int64_t fields[2] = {t.tp.time_since_epoch().count(), t.chatId};
+		buf.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+		appendReminder(buf, t.reminder);
+	}
+
+	SnapshotHeader h{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, createdAt.time_since_epoch().count(), timers.size(), lsn,
+	    crc32(buf.data() + sizeof(h), buf.size() - sizeof(h)), 0};
+	std::memcpy(buf.data(), &h, sizeof(h));
+
+	const auto tmp = path + ".tmp";
+	const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	size_t written = 0;
+	while (written < buf.size()) {
+		auto n = ::write(fd, buf.data() + written, buf.size() - written);
+		if (n <= 0) {
+			::close(fd);
+			return false;
+		}
+		written += n;
+	}
+	::fsync(fd);
+	::close(fd);
+
+	return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+inline std::optional<SchedulerSnapshot> loadSchedulerSnapshot(const std::string& path) {
+	TRACE_SCOPE("loadSchedulerSnapshot", "snapshot");
+
+	MappedFile file(path);
+	SnapshotHeader h;
+	if (!file.data() || file.size() < sizeof(h)) {
+		return {};
+	}
+	std::memcpy(&h, file.data(), sizeof(h));
+	if (h.magic != SNAPSHOT_MAGIC || h.version != SNAPSHOT_VERSION ||
+	    h.crc != crc32(file.data() + sizeof(h), file.size() - sizeof(h))) {
+		return {};
+	}
+
+	SchedulerSnapshot snap{time_point_s(std::chrono::seconds(h.createdAt)), h.lsn, {}};
+	snap.timers.reserve(h.count);
+
+	const char* pos = file.data() + sizeof(h);
+	const char* end = file.data() + file.size();
+	for (std::uint64_t i = 0; i != h.count; ++i) {
+		std::int64_t fields[2];
+		if (static_cast<size_t>(end - pos) < sizeof(fields)) {
+			return {};
+		}
+		std::memcpy(fields, pos, sizeof(fields));
+		pos += sizeof(fields);
+
+		ReminderQuery::Timer t{fields[1], time_point_s(std::chrono::seconds(fields[0])), {}};
+		if (!readReminder(pos, end, t.reminder)) {
+			return {};
+		}
+		snap.timers.push_back(std::move(t));
+	}
+
+	return snap;
+}
+
+// Timers of a snapshot as a cold start would compute them at `utcTp`: passed one-shot timers are
+// dropped, passed repeatable ones move to their next occurrence.
+inline std::vector<ReminderQuery::Timer> resumeTimers(std::vector<ReminderQuery::Timer> timers,
+    const ChatZones& zones, time_point_s utcTp) {
+	std::vector<ReminderQuery::Timer> out;
+	out.reserve(timers.size());
+	for (auto& t : timers) {
+		if (t.tp <= utcTp) {
+			if (!t.reminder.isRepeatable()) {
+				continue;
+			}
+			const auto& zone = zones.zone(t.chatId);
+			const auto localTp = zone.toLocal(utcTp);
+			auto nextTp = nextOccurrence(t.reminder, localTp);
+			if (nextTp <= localTp) {
+				continue;
+			}
+			t.tp = zone.toUtc(nextTp);
+		}
+		out.push_back(std::move(t));
+	}
+
+	return out;
+}
+
+inline void applyWalRecord(std::map<std::int64_t, std::multimap<time_point_s, ReminderInfo>>& queue, const WalRecord& r) {
+	auto& rms = queue[r.chatId];
+	auto eraseOne = [&](time_point_s tp) -> std::optional<ReminderInfo> {
+		auto [b, e] = rms.equal_range(tp);
+		for (auto it = b; it != e; ++it) {
+			if (it->second._id == r.reminderId) {
+				auto reminder = std::move(it->second);
+				rms.erase(it);
+				return reminder;
+			}
+		}
+		return {};
+	};
+
+	switch (r.op) {
+	case WalOp::Add:
+		rms.emplace(r.tp, r.reminder);
+		break;
+	case WalOp::Remove:
+		for (auto it = rms.begin(); it != rms.end();) {
+			it = it->second._id == r.reminderId ? rms.erase(it) : std::next(it);
+		}
+		break;
+	case WalOp::Clear:
+		rms.clear();
+		break;
+	case WalOp::Fired:
+		eraseOne(r.tp);
+		break;
+	case WalOp::Rescheduled:
+		if (auto reminder = eraseOne(r.tp)) {
+			rms.emplace(r.newTp, std::move(*reminder));
+		}
+		break;
+	case WalOp::StoreChat:
+		break;
+	}
+	if (rms.empty()) {
+		queue.erase(r.chatId);
+	}
+}
+
+// Queue as it was at the last journal record: the snapshot with the journal tail replayed over it.
+// Empty if the journal doesn't continue the snapshot (e.g. the snapshot is lost after a checkpoint
+// truncated the journal), then the queue has to be rebuilt from the database.
+inline std::optional<SchedulerSnapshot> recoverScheduler(const std::string& snapshotPath, const std::string& walPath) {
+	TRACE_SCOPE("recoverScheduler", "snapshot");
+
+	std::map<std::int64_t, std::multimap<time_point_s, ReminderInfo>> queue;
+	auto snapshot = loadSchedulerSnapshot(snapshotPath);
+	SchedulerSnapshot out;
+	if (snapshot) {
+		out.createdAt = snapshot->createdAt;
+		out.lsn = snapshot->lsn;
+		for (auto& t : snapshot->timers) {
+			queue[t.chatId].emplace(t.tp, std::move(t.reminder));
+		}
+	}
+
+	const auto first = SchedulerWal::replay(walPath, out.lsn, [&](const WalRecord& r) {
+		applyWalRecord(queue, r);
+		out.lsn = r.lsn;
+	});
+	if (first > (snapshot ? snapshot->lsn + 1 : 1)) {
+		return {};
+	}
+	if (!snapshot && !first) {
+		return {};
+	}
+
+	for (auto& [chatId, reminders] : queue) {
+		for (auto& [tp, r] : reminders) {
+			out.timers.push_back({chatId, tp, std::move(r)});
+		}
+	}
+
+	return out;
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "reminder_codec.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+
+#include <boost/crc.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+enum class WalOp : std::uint8_t {
+	Add = 1,
+	Remove = 2,
+	Clear = 3,
+	Fired = 4,
+	Rescheduled = 5,
+	StoreChat = 6, // a chat's stored state for followers, the queue ignores it
+};
+
+struct WalRecord {
+	std::uint64_t lsn = 0;
+	WalOp op = WalOp::Add;
+	std::int64_t chatId = 0;
+	std::int64_t reminderId = 0;
+	time_point_s tp{};
+	time_point_s newTp{};
+	ReminderInfo reminder; // Add only
+	std::string data;      // StoreChat only: encodeChatTransfer()
+};
+
+// Append-only log of scheduler mutations. Every record is framed as
+//   u32 crc | u32 size | u64 lsn | u8 op | i64 chatId | i64 reminderId | i64 tp | i64 newTp | [reminder|data]
+// with the crc covering everything after itself. Records are written with one write() each, so they
+// survive a crash of the process, sync() makes them survive a crash of the machine. A listener sees
+// every frame as it is appended, that is the change stream followers replicate.
+class SchedulerWal {
+  public:
+	// Cuts a torn or corrupted tail left by a crash and continues after the last valid record, or after
+	// `lastLsn` if the log was emptied by a checkpoint.
+	explicit SchedulerWal(std::string path, std::uint64_t lastLsn = 0): _path(std::move(path)), _lsn(lastLsn) {
+		size_t validSize = 0;
+		scan(_path, [&](const WalRecord& r, size_t end) {
+			_lsn = std::max(_lsn, r.lsn);
+			validSize = end;
+		});
+		_fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (_fd < 0) {
+			throw std::runtime_error("Can't open " + _path);
+		}
+		_hadTornTail = ::lseek(_fd, 0, SEEK_END) != static_cast<off_t>(validSize);
+		if (_hadTornTail && ::ftruncate(_fd, validSize) != 0) {
+			throw std::runtime_error("Can't truncate " + _path);
+		}
+	}
+
+	~SchedulerWal() {
+		if (_fd >= 0) {
+			::fdatasync(_fd);
+			::close(_fd);
+		}
+	}
+
+	SchedulerWal(const SchedulerWal&) = delete;
+	SchedulerWal& operator=(const SchedulerWal&) = delete;
+
+	void add(std::int64_t chatId, time_point_s tp, const ReminderInfo& reminder) {
+		WalRecord r;
+		r.op = WalOp::Add;
+		r.chatId = chatId;
+		r.reminderId = reminder._id;
+		r.tp = tp;
+		r.reminder = reminder;
+		append(r);
+	}
+
+	void remove(std::int64_t chatId, std::int64_t reminderId) { append(WalRecord{0, WalOp::Remove, chatId, reminderId}); }
+	void clear(std::int64_t chatId) { append(WalRecord{0, WalOp::Clear, chatId}); }
+	void fired(std::int64_t chatId, std::int64_t reminderId, time_point_s tp) {
+		append(WalRecord{0, WalOp::Fired, chatId, reminderId, tp});
+	}
+	void rescheduled(std::int64_t chatId, std::int64_t reminderId, time_point_s tp, time_point_s newTp) {
+		append(WalRecord{0, WalOp::Rescheduled, chatId, reminderId, tp, newTp});
+	}
+
+	void storeChat(std::int64_t chatId, std::string data) {
+		WalRecord r;
+		r.op = WalOp::StoreChat;
+		r.chatId = chatId;
+		r.data = std::move(data);
+		append(r);
+	}
+
+	// Called with every appended frame, under the log's lock and in lsn order.
+	using Listener = std::function<void(std::uint64_t lsn, const std::string& frame)>;
+	void setListener(Listener listener) {
+		std::scoped_lock l(_m);
+		_listener = std::move(listener);
+	}
+
+	std::uint64_t lsn() const {
+		std::scoped_lock l(_m);
+		return _lsn;
+	}
+
+	bool hadTornTail() const { return _hadTornTail; }
+
+	void sync() {
+		TRACE_SCOPE("SchedulerWal::sync", "wal");
+		std::scoped_lock l(_m);
+		::fdatasync(_fd);
+	}
+
+	// Drops records up to `lsn`, they are covered by a snapshot.
+	void truncate(std::uint64_t lsn) {
+		TRACE_SCOPE("SchedulerWal::truncate", "wal");
+		std::scoped_lock l(_m);
+
+		std::string tail;
+		scan(_path, [&](const WalRecord& r, size_t) {
+			if (r.lsn > lsn) {
+				encode(tail, r);
+			}
+		});
+
+		const auto tmp = _path + ".tmp";
+		const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || !writeAll(fd, tail) || ::fdatasync(fd) != 0) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+			throw std::runtime_error("Can't write " + tmp);
+		}
+		if (std::rename(tmp.c_str(), _path.c_str()) != 0) {
+			::close(fd);
+			throw std::runtime_error("Can't replace " + _path);
+		}
+		::close(_fd);
+		_fd = fd;
+		::lseek(_fd, 0, SEEK_END);
+	}
+
+	// Calls `apply` for every valid record with lsn > `afterLsn`, stops at the first torn or corrupted
+	// one. Returns the lsn of the first record in the file (0 if empty).
+	static std::uint64_t replay(const std::string& path, std::uint64_t afterLsn,
+	    const std::function<void(const WalRecord&)>& apply) {
+		std::uint64_t first = 0;
+		scan(path, [&](const WalRecord& r, size_t) {
+			if (!first) {
+				first = r.lsn;
+			}
+			if (r.lsn > afterLsn) {
+				apply(r);
+			}
+		});
+		return first;
+	}
+
+  private:
+	static constexpr size_t FIXED_SIZE = 8 + 1 + 8 * 4;
+
+	void append(WalRecord r) {
+		std::scoped_lock l(_m);
+		r.lsn = ++_lsn;
+		std::string buf;
+		encode(buf, r);
+		if (!writeAll(_fd, buf)) {
+			throw std::runtime_error("Can't append to " + _path);
+		}
+		if (_listener) {
+			_listener(r.lsn, buf);
+		}
+	}
+
+  public:
+	static void encode(std::string& out, const WalRecord& r) {
+		std::string body;
+		body.reserve(FIXED_SIZE + sizeof(PackedReminder) + r.reminder.descr.size());
+		put(body, r.lsn);
+		put(body, static_cast<std::uint8_t>(r.op));
+		put(body, r.chatId);
+		put(body, r.reminderId);
+		put(body, static_cast<std::int64_t>(r.tp.time_since_epoch().count()));
+		put(body, static_cast<std::int64_t>(r.newTp.time_since_epoch().count()));
+		if (r.op == WalOp::Add) {
+			appendReminder(body, r.reminder);
+		} else if (r.op == WalOp::StoreChat) {
+			body += r.data;
+		}
+
+		const auto size = static_cast<std::uint32_t>(body.size());
+		boost::crc_32_type crc;
+		crc.process_bytes(&size, sizeof(size));
+		crc.process_bytes(body.data(), body.size());
+		put(out, static_cast<std::uint32_t>(crc.checksum()));
+		put(out, size);
+		out += body;
+	}
+
+	// Decodes the frame at the start of `data`, returns its size or 0 if it is truncated or corrupted.
+	static size_t decode(const char* data, size_t size, WalRecord& r) {
+		if (size < 8) {
+			return 0;
+		}
+		std::uint32_t crc, bodySize;
+		std::memcpy(&crc, data, 4);
+		std::memcpy(&bodySize, data + 4, 4);
+		if (bodySize < FIXED_SIZE || size - 8 < bodySize) {
+			return 0;
+		}
+		const char* body = data + 8;
+		boost::crc_32_type actual;
+		actual.process_bytes(&bodySize, sizeof(bodySize));
+		actual.process_bytes(body, bodySize);
+		if (actual.checksum() != crc) {
+			return 0;
+		}
+
+		const char* pos = body;
+		std::uint8_t op;
+		std::int64_t tp, newTp;
+		get(pos, r.lsn);
+		get(pos, op);
+		get(pos, r.chatId);
+		get(pos, r.reminderId);
+		get(pos, tp);
+		get(pos, newTp);
+		r.op = static_cast<WalOp>(op);
+		r.tp = time_point_s(std::chrono::seconds(tp));
+		r.newTp = time_point_s(std::chrono::seconds(newTp));
+		if (r.op == WalOp::Add && !readReminder(pos, body + bodySize, r.reminder)) {
+			return 0;
+		}
+		if (r.op == WalOp::StoreChat) {
+			r.data.assign(pos, body + bodySize);
+		}
+
+		return 8 + bodySize;
+	}
+
+  private:
+	// Calls `f(record, offsetAfterRecord)` for the valid prefix of the file.
+	template<class F>
+	static void scan(const std::string& path, F&& f) {
+		std::string data;
+		{
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return;
+			}
+			char buf[1 << 16];
+			ssize_t n;
+			while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+				data.append(buf, n);
+			}
+			::close(fd);
+		}
+
+		size_t offset = 0;
+		std::uint64_t prevLsn = 0;
+		while (offset < data.size()) {
+			WalRecord r;
+			const auto size = decode(data.data() + offset, data.size() - offset, r);
+			if (!size || r.lsn <= prevLsn) {
+				return;
+			}
+			prevLsn = r.lsn;
+			offset += size;
+
+			f(r, offset);
+		}
+	}
+
+	static bool writeAll(int fd, const std::string& buf) {
+		size_t written = 0;
+		while (written < buf.size()) {
+			auto n = ::write(fd, buf.data() + written, buf.size() - written);
+			if (n <= 0) {
+				return false;
+			}
+			written += n;
+		}
+		return true;
+	}
+
+	template<class T>
+	static void put(std::string& out, T v) {
+		out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+
+	template<class T>
+	static void get(const char*& pos, T& v) {
+		std::memcpy(&v, pos, sizeof(v));
+		pos += sizeof(v);
+	}
+
+  private:
+	const std::string _path;
+	mutable std::mutex _m;
+	int _fd = -1;
+	std::uint64_t _lsn = 0;
+	bool _hadTornTail = false;
+	Listener _listener;
+};
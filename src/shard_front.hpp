@@ -0,0 +1,672 @@
+#pragma once
+
+#include "chat_transfer.hpp"
+#include "consistent_hash.hpp"
+#include "http_server.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <tgbot/Bot.h>
+#include <tgbot/net/CurlHttpClient.h>
+
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Chat of an update, 0 if it has none.
+inline std::int64_t updateChatId(const nlohmann::json& update) {
+	for (const auto* key : {"message", "edited_message", "channel_post", "my_chat_member"}) {
+		if (update.contains(key) && update[key].contains("chat")) {
+			return update[key]["chat"].value("id", std::int64_t(0));
+		}
+	}
+	if (update.contains("callback_query")) {
+		const auto& query = update["callback_query"];
+		if (query.contains("message") && query["message"].contains("chat")) {
+			return query["message"]["chat"].value("id", std::int64_t(0));
+		}
+		if (query.contains("from")) {
+			return query["from"].value("id", std::int64_t(0));
+		}
+	}
+
+	return 0;
+}
+
+// Front of a sharded bot: long polls the Bot API and hands every update to the worker owning its chat on a
+// ConsistentHashRing. Workers are ordinary bot processes whose api_url points at the front, under
+// /w/<name>: their getUpdates is served from their queue, every other call is passed through upstream.
+// Adding or removing a worker copies the chats that change owner through the workers' /shard routes
+// while their updates are held back, then switches the ring. Workers whose process is gone are restarted.
+// Upstream only confirms updates up to the oldest one a worker hasn't fetched past yet, so updates still
+// queued here when the front stops are delivered again after a restart. One a worker doesn't fetch within
+// MAX_UNFETCHED_AGE stops holding the rest back.
+class ShardFront {
+  public:
+	struct Worker {
+		std::string adminUrl;         // http://host:port of the worker's /shard routes
+		std::function<void()> stop;   // stops the process and waits for it
+		std::function<bool()> exited; // whether the process is gone, reaping it
+	};
+	using Launch = std::function<Worker(const std::string& name, const std::string& apiUrl)>;
+
+	ShardFront(const TgBot::HttpClient& client, std::string token, std::string upstreamUrl, Launch launch,
+	    unsigned short port = 0):
+	    _client(client), _token(std::move(token)), _upstreamUrl(std::move(upstreamUrl)), _launch(std::move(launch)),
+	    _server("127.0.0.1", port, [this](const HttpRequest& r) { return handle(r); }) {}
+
+	std::string url() const { return "http://127.0.0.1:" + std::to_string(_server.port()); }
+
+	// Launches the workers of a fresh front, no chats move. Workers added later are named w<n> after them.
+	void start(const std::vector<std::string>& names) {
+		for (const auto& name : names) {
+			launch(name);
+			std::scoped_lock l(_m);
+			_ring.add(name);
+			if (name.size() > 1 && name[0] == 'w' && name.find_first_not_of("0123456789", 1) == std::string::npos) {
+				_nextWorker = std::max<size_t>(_nextWorker, std::stoul(name.substr(1)) + 1);
+			}
+		}
+	}
+
+	// Returns the number of moved chats.
+	size_t addWorker(const std::string& name) {
+		std::scoped_lock rl(_rebalanceM);
+		{
+			std::scoped_lock l(_m);
+			if (_ring.workers().count(name)) {
+				return 0;
+			}
+		}
+		launch(name);
+		auto next = ring();
+		next.add(name);
+		try {
+			auto moved = rebalance(std::move(next));
+			logger().info("shard_worker_added worker={} moved={}", name, moved);
+			return moved;
+		} catch (const std::exception& e) {
+			logger().error("shard_worker_add_failed worker={} error={}", name, e.what());
+			// The new worker got no chats, it goes away with the failed rebalance.
+			Worker w;
+			{
+				std::scoped_lock l(_m);
+				w = std::move(_workers.at(name));
+				_workers.erase(name);
+				_queues.erase(name);
+			}
+			w.stop();
+			throw;
+		}
+	}
+
+	size_t removeWorker(const std::string& name) {
+		std::scoped_lock rl(_rebalanceM);
+		try {
+			return remove(name, false);
+		} catch (const std::exception& e) {
+			logger().error("shard_worker_remove_failed worker={} error={}", name, e.what());
+			throw;
+		}
+	}
+
+	// Restarts the workers whose process is gone, their queued updates wait for them meanwhile. One that
+	// fails to restart MAX_RESTART_FAILURES times in a row is removed, its chats go to the other workers
+	// without their stored state.
+	void supervise() {
+		std::scoped_lock rl(_rebalanceM);
+		std::vector<std::string> dead;
+		{
+			std::scoped_lock l(_m);
+			for (const auto& [name, w] : _workers) {
+				if (w.exited && w.exited()) {
+					dead.push_back(name);
+				}
+			}
+		}
+		for (const auto& name : dead) {
+			logger().error("shard_worker_exited worker={}", name);
+			try {
+				launch(name);
+				_restartFailures.erase(name);
+				_restarts.inc();
+				logger().info("shard_worker_restarted worker={}", name);
+			} catch (const std::exception& e) {
+				const auto failures = ++_restartFailures[name];
+				logger().error("shard_worker_restart_failed worker={} failures={} error={}", name, failures, e.what());
+				if (failures < MAX_RESTART_FAILURES) {
+					continue;
+				}
+				try {
+					remove(name, true);
+					_restartFailures.erase(name);
+				} catch (const std::exception& e) {
+					logger().error("shard_worker_remove_failed worker={} error={}", name, e.what());
+				}
+			}
+		}
+	}
+
+	std::vector<std::string> workers() const {
+		std::scoped_lock l(_m);
+		return {_ring.workers().begin(), _ring.workers().end()};
+	}
+
+	// Long polls upstream until `stop` is set.
+	void poll(const std::atomic_bool& stop) {
+		while (!stop) {
+			try {
+				expireUnfetched();
+				const auto offset = upstreamOffset();
+				std::vector<TgBot::HttpReqArg> args;
+				args.emplace_back("offset", offset);
+				args.emplace_back("timeout", 10);
+				auto resp = nlohmann::json::parse(
+				    _client.makeRequest(TgBot::Url(fmt::format("{}/bot{}/getUpdates", _upstreamUrl, _token)), args));
+				if (!resp.value("ok", false)) {
+					throw std::runtime_error(resp.value("description", "getUpdates failed"));
+				}
+				size_t fresh = 0;
+				for (auto& update : resp["result"]) {
+					fresh += receive(std::move(update));
+				}
+				// Only updates still waiting for a worker came back: ask again once one of them is fetched.
+				if (fresh == 0 && !resp["result"].empty()) {
+					std::unique_lock lk(_m);
+					_cond.wait_for(lk, std::chrono::seconds(1), [&] { return upstreamOffsetLocked() != offset; });
+				}
+			} catch (const std::exception& e) {
+				logger().error("shard_poll_failed error={}", e.what());
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		}
+	}
+
+	void stopWorkers() {
+		std::map<std::string, Worker> workers;
+		{
+			std::scoped_lock l(_m);
+			_stopped = true;
+			_cond.notify_all();
+			workers.swap(_workers);
+		}
+		for (auto& [name, w] : workers) {
+			w.stop();
+		}
+	}
+
+  private:
+	static constexpr auto MAX_UNFETCHED_AGE = std::chrono::minutes(5);
+	static constexpr auto DRAIN_TIMEOUT = std::chrono::seconds(30);
+	static constexpr int MAX_RESTART_FAILURES = 3;
+
+	struct Move {
+		std::int64_t chatId;
+		std::string from;
+		std::string to;
+	};
+
+	static std::int64_t updateId(const nlohmann::json& update) { return update.value("update_id", std::int64_t(0)); }
+
+	// Takes the worker out of the ring, `dead` if its process is gone and can't hand over its chats. Callers
+	// hold _rebalanceM.
+	size_t remove(const std::string& name, bool dead) {
+		auto next = ring();
+		if (!next.workers().count(name) || next.workers().size() == 1) {
+			return 0;
+		}
+		next.remove(name);
+		auto moved = rebalance(std::move(next), dead ? name : std::string());
+
+		// The worker is stopped before its queue is looked at: updates it was handed may have been handled
+		// already, only those it never got (of chats it didn't know) go to the new owners.
+		Worker w;
+		{
+			std::scoped_lock l(_m);
+			w = std::move(_workers.at(name));
+			_workers.erase(name);
+		}
+		w.stop();
+		{
+			std::scoped_lock l(_m);
+			auto queue = std::move(_queues.at(name));
+			_queues.erase(name);
+			for (auto& u : queue) {
+				const auto id = updateId(u);
+				if (_delivered.erase(id)) {
+					_unfetched.erase(id);
+				} else {
+					routeLocked(std::move(u));
+				}
+			}
+			_cond.notify_all();
+		}
+		logger().info("shard_worker_removed worker={} moved={} dead={}", name, moved, dead);
+		return moved;
+	}
+
+	ConsistentHashRing ring() const {
+		std::scoped_lock l(_m);
+		return _ring;
+	}
+
+	void launch(const std::string& name) {
+		auto w = _launch(name, fmt::format("{}/w/{}", url(), name));
+		std::scoped_lock l(_m);
+		_queues[name];
+		_workers.insert_or_assign(name, std::move(w));
+	}
+
+	// Callers hold _m.
+	bool changesOwnerLocked(std::int64_t chatId) const {
+		return _pending && _pending->owner(chatId) != _ring.owner(chatId);
+	}
+
+	// Callers hold _m.
+	void routeLocked(nlohmann::json update) {
+		const auto chatId = updateChatId(update);
+		if (changesOwnerLocked(chatId)) {
+			_held.push_back(std::move(update));
+			return;
+		}
+		_queues[_ring.owner(chatId)].push_back(std::move(update));
+		_routed.inc();
+	}
+
+	// Routes an update seen for the first time, returns false for one upstream delivered again because it
+	// isn't confirmed yet.
+	bool receive(nlohmann::json update) {
+		const auto id = updateId(update);
+		std::scoped_lock l(_m);
+		if (id < _received) {
+			return false;
+		}
+		_received = id + 1;
+		_unfetched.emplace(id, std::chrono::steady_clock::now());
+		routeLocked(std::move(update));
+		_cond.notify_all();
+		return true;
+	}
+
+	std::int64_t upstreamOffset() const {
+		std::scoped_lock l(_m);
+		return upstreamOffsetLocked();
+	}
+
+	std::int64_t upstreamOffsetLocked() const { return _unfetched.empty() ? _received : _unfetched.begin()->first; }
+
+	// Lets upstream confirm updates a worker hasn't fetched for MAX_UNFETCHED_AGE (it is down or stuck), so
+	// one worker doesn't hold back every chat. They stay queued for it, but a front restart loses them.
+	void expireUnfetched() {
+		std::scoped_lock l(_m);
+		const auto now = std::chrono::steady_clock::now();
+		size_t expired = 0;
+		for (auto it = _unfetched.begin(); it != _unfetched.end();) {
+			if (now - it->second > MAX_UNFETCHED_AGE) {
+				it = _unfetched.erase(it);
+				++expired;
+			} else {
+				++it;
+			}
+		}
+		if (expired) {
+			logger().warn("shard_updates_expired count={} offset={}", expired, upstreamOffsetLocked());
+		}
+	}
+
+	// Switches to `next`, copying the chats that change owner. `dead` is a worker whose process is gone:
+	// its chats are neither listed nor copied, they reach their new owners without their stored state.
+	size_t rebalance(ConsistentHashRing next, const std::string& dead = {}) {
+		const auto current = ring();
+
+		// From here on updates of every chat changing owner are held for the new one. Those already queued
+		// are fetched first, so a chat they register is in its owner's listing; if they aren't fetched in
+		// time the rebalance is called off.
+		{
+			std::unique_lock lk(_m);
+			_pending = next;
+			const bool drained = _cond.wait_for(lk, DRAIN_TIMEOUT, [&] {
+				for (const auto& [worker, queue] : _queues) {
+					for (const auto& u : queue) {
+						if (worker != dead && changesOwnerLocked(updateChatId(u))) {
+							return false;
+						}
+					}
+				}
+				return true;
+			});
+			if (!drained) {
+				lk.unlock();
+				release();
+				throw std::runtime_error("workers didn't fetch the updates of moving chats in time");
+			}
+		}
+
+		std::vector<Move> moves;
+		try {
+			for (const auto& worker : current.workers()) {
+				if (worker == dead) {
+					continue;
+				}
+				auto chats = nlohmann::json::parse(admin(worker, "/shard/chats", {}));
+				for (std::int64_t chatId : chats) {
+					if (const auto& owner = next.owner(chatId); owner != worker) {
+						moves.push_back({chatId, worker, owner});
+					}
+				}
+			}
+		} catch (const std::exception&) {
+			release();
+			throw;
+		}
+
+		size_t copied = 0;
+		try {
+			for (; copied != moves.size(); ++copied) {
+				const auto& m = moves[copied];
+				auto data = admin(m.from, fmt::format("/shard/export?chat={}", m.chatId), {});
+				if (!decodeChatTransfer(data)) {
+					throw std::runtime_error(fmt::format("bad export of chat {} from {}", m.chatId, m.from));
+				}
+				std::vector<TgBot::HttpReqArg> args;
+				args.emplace_back("data", data, true, "application/octet-stream", "chat.bin");
+				if (admin(m.to, fmt::format("/shard/import?chat={}", m.chatId), args) != "ok") {
+					throw std::runtime_error(fmt::format("import of chat {} into {} failed", m.chatId, m.to));
+				}
+			}
+		} catch (const std::exception& e) {
+			for (size_t i = 0; i != copied; ++i) {
+				try {
+					admin(moves[i].to, fmt::format("/shard/drop?chat={}", moves[i].chatId), {});
+				} catch (const std::exception& e) {
+					logger().error(
+					    "shard_chat_drop_failed worker={} chat={} error={}", moves[i].to, moves[i].chatId, e.what());
+				}
+			}
+			release();
+			throw;
+		}
+
+		const auto workerCount = next.workers().size();
+		{
+			std::scoped_lock l(_m);
+			_ring = std::move(next);
+		}
+		release();
+		for (const auto& m : moves) {
+			try {
+				admin(m.from, fmt::format("/shard/drop?chat={}", m.chatId), {});
+			} catch (const std::exception& e) {
+				logger().error("shard_chat_drop_failed worker={} chat={} error={}", m.from, m.chatId, e.what());
+			}
+		}
+		_moved.inc(moves.size());
+		logger().info("shard_rebalanced workers={} moved={}", workerCount, moves.size());
+
+		return moves.size();
+	}
+
+	void release() {
+		std::scoped_lock l(_m);
+		_pending.reset();
+		std::deque<nlohmann::json> held;
+		held.swap(_held);
+		for (auto& u : held) {
+			routeLocked(std::move(u));
+		}
+		_cond.notify_all();
+	}
+
+	std::string admin(const std::string& worker, const std::string& path,
+	    const std::vector<TgBot::HttpReqArg>& args) const {
+		std::string adminUrl;
+		{
+			std::scoped_lock l(_m);
+			adminUrl = _workers.at(worker).adminUrl;
+		}
+		return _client.makeRequest(TgBot::Url(adminUrl + path), args);
+	}
+
+	HttpResponse handle(const HttpRequest& req) {
+		const auto path = req.path();
+		if (path == "/admin/add") {
+			auto args = parseForm(req);
+			std::string name;
+			if (args.count("worker")) {
+				name = args.at("worker");
+			} else {
+				std::scoped_lock l(_m);
+				name = fmt::format("w{}", _nextWorker++);
+			}
+			auto moved = addWorker(name);
+			return HttpResponse{200, "application/json", nlohmann::json{{"worker", name}, {"moved", moved}}.dump()};
+		}
+		if (path == "/admin/remove") {
+			auto args = parseForm(req);
+			const auto& name = args.at("worker");
+			auto moved = removeWorker(name);
+			return HttpResponse{200, "application/json", nlohmann::json{{"worker", name}, {"moved", moved}}.dump()};
+		}
+		if (path == "/admin/workers") {
+			return HttpResponse{200, "application/json", nlohmann::json(workers()).dump()};
+		}
+		if (path.rfind("/w/", 0) != 0) {
+			return HttpResponse{404, "text/plain", "not found"};
+		}
+
+		const auto slash = path.find('/', 3);
+		const auto worker = path.substr(3, slash - 3);
+		const auto rest = slash == std::string::npos ? std::string() : path.substr(slash);
+		const auto method = rest.substr(rest.rfind('/') + 1);
+		if (rest.rfind("/bot", 0) == 0 && method == "getUpdates") {
+			return getUpdates(worker, parseForm(req));
+		}
+
+		std::unordered_map<std::string, std::string> fileNames;
+		std::vector<TgBot::HttpReqArg> args;
+		for (auto& [name, value] : parseForm(req, &fileNames)) {
+			if (auto f = fileNames.find(name); f != fileNames.end()) {
+				args.emplace_back(name, value, true, "application/octet-stream", f->second);
+			} else {
+				args.emplace_back(name, value);
+			}
+		}
+		_proxied.inc();
+		return HttpResponse{200, "application/json", _client.makeRequest(TgBot::Url(_upstreamUrl + rest), args)};
+	}
+
+	HttpResponse getUpdates(const std::string& worker, const std::unordered_map<std::string, std::string>& args) {
+		const std::int64_t offset = args.count("offset") ? std::stoll(args.at("offset")) : 0;
+		const size_t limit = args.count("limit") ? std::stoul(args.at("limit")) : 100;
+		const auto timeout = std::chrono::seconds(args.count("timeout") ? std::stoll(args.at("timeout")) : 0);
+
+		auto out = nlohmann::json::array();
+		{
+			std::unique_lock lk(_m);
+			auto found = _queues.find(worker);
+			if (found == _queues.end()) {
+				return HttpResponse{404, "application/json", R"({"ok":false,"description":"unknown worker"})"};
+			}
+			auto& queue = found->second;
+			while (!queue.empty() && updateId(queue.front()) < offset) {
+				_unfetched.erase(updateId(queue.front()));
+				_delivered.erase(updateId(queue.front()));
+				queue.pop_front();
+			}
+			// Acknowledged updates may be what a rebalance waits for.
+			_cond.notify_all();
+			_cond.wait_for(lk, timeout, [&] {
+				found = _queues.find(worker);
+				return _stopped || found == _queues.end() || !found->second.empty();
+			});
+			for (size_t i = 0; found != _queues.end() && i != found->second.size() && i != limit; ++i) {
+				out.push_back(found->second[i]);
+				_delivered.insert(updateId(found->second[i]));
+			}
+		}
+
+		nlohmann::json resp = nlohmann::json::object();
+		resp["ok"] = true;
+		resp["result"] = std::move(out);
+		return HttpResponse{200, "application/json", resp.dump()};
+	}
+
+  private:
+	const TgBot::HttpClient& _client;
+	const std::string _token;
+	const std::string _upstreamUrl;
+	const Launch _launch;
+
+	mutable std::mutex _m;
+	std::condition_variable _cond;
+	bool _stopped = false;
+	ConsistentHashRing _ring;
+	std::map<std::string, Worker> _workers;
+	std::map<std::string, std::deque<nlohmann::json>> _queues;
+	std::optional<ConsistentHashRing> _pending; // the ring a rebalance switches to
+	std::deque<nlohmann::json> _held;
+	std::int64_t _received = 0; // next update id not seen yet
+	// Ids routed but not fetched past by their worker yet, with the time they were routed.
+	std::map<std::int64_t, std::chrono::steady_clock::time_point> _unfetched;
+	std::set<std::int64_t> _delivered; // ids handed to their worker but not fetched past yet
+
+	std::mutex _rebalanceM;
+	std::map<std::string, int> _restartFailures; // guarded by _rebalanceM
+	size_t _nextWorker = 0;                      // guarded by _m
+
+	Counter& _routed = metrics().counter("shard_updates_routed_total", "Updates handed to a worker queue");
+	Counter& _proxied = metrics().counter("shard_calls_proxied_total", "Worker API calls passed upstream");
+	Counter& _moved = metrics().counter("shard_chats_moved_total", "Chats moved between workers");
+	Counter& _restarts = metrics().counter("shard_worker_restarts_total", "Workers restarted after their process died");
+
+	HttpServer _server;
+};
+
+// `self --front <workers>`: runs the front in the bot's working directory and every worker in its own
+// shard_<name> directory next to it, each with its own db.bin, reminders.kv and scheduler files. The list of
+// workers is kept in shard_workers, so a restart brings back the ring of the last run.
+inline int runShardFront(const std::string& self, size_t workers, const std::atomic_bool& stop) {
+	const auto token = findToken();
+
+	auto launch = [&](const std::string& name, const std::string& apiUrl) {
+		const auto dir = "shard_" + name;
+		mkdir(dir.c_str(), 0755);
+		std::ofstream(dir + "/token") << token;
+		std::ofstream(dir + "/api_url") << apiUrl;
+		std::ofstream(dir + "/metrics_port") << "any";
+		std::ofstream(dir + "/shard_worker") << name;
+		std::remove((dir + "/metrics_port.bound").c_str());
+
+		const auto parent = getpid();
+		const auto pid = fork();
+		if (pid == 0) {
+			// Workers stop with the front, however it ends.
+			if (prctl(PR_SET_PDEATHSIG, SIGINT) != 0 || getppid() != parent || chdir(dir.c_str()) != 0) {
+				_exit(1);
+			}
+			execl(self.c_str(), self.c_str(), nullptr);
+			_exit(1);
+		}
+
+		// The worker listens on a port of its own choosing and reports it, it's up once its /shard routes
+		// answer (before that the endpoint only serves metrics).
+		auto reaped = std::make_shared<std::atomic_bool>(false);
+		auto stopWorker = [pid, reaped] {
+			if (!reaped->exchange(true)) {
+				kill(pid, SIGINT);
+				waitpid(pid, nullptr, 0);
+			}
+		};
+		auto workerExited = [pid, reaped] {
+			if (!*reaped && waitpid(pid, nullptr, WNOHANG) == pid) {
+				*reaped = true;
+			}
+			return reaped->load();
+		};
+		std::string adminUrl;
+		TgBot::CurlHttpClient client;
+		for (int attempt = 0;; ++attempt) {
+			unsigned short port = 0;
+			std::ifstream(dir + "/metrics_port.bound") >> port;
+			if (port) {
+				adminUrl = fmt::format("http://127.0.0.1:{}", port);
+				try {
+					const auto chats = client.makeRequest(TgBot::Url(adminUrl + "/shard/chats"), {});
+					if (nlohmann::json::parse(chats, nullptr, false).is_array()) {
+						break;
+					}
+				} catch (const std::exception& e) {}
+			}
+			if (workerExited()) {
+				throw std::runtime_error(fmt::format("worker {} exited while starting", name));
+			}
+			if (attempt == 300) {
+				stopWorker();
+				throw std::runtime_error(fmt::format("worker {} didn't start", name));
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		logger().info("shard_worker_started worker={} pid={} admin={}", name, pid, adminUrl);
+
+		return ShardFront::Worker{adminUrl, stopWorker, workerExited};
+	};
+
+	std::vector<std::string> names;
+	{
+		std::ifstream in("shard_workers");
+		for (std::string name; in >> name;) {
+			names.push_back(name);
+		}
+	}
+	if (names.empty()) {
+		for (size_t i = 0; i != workers; ++i) {
+			names.push_back(fmt::format("w{}", i));
+		}
+	}
+
+	TgBot::CurlHttpClient client;
+	ShardFront front(client, token, findApiUrl(), launch);
+	front.start(names);
+	std::ofstream("front_url") << front.url();
+	logger().info("shard_front_started url={} workers={}", front.url(), names.size());
+
+	// Workers that died are restarted, membership changes made through /admin are saved for the next start.
+	std::thread saver([&] {
+		while (!stop) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			front.supervise();
+			std::ofstream out("shard_workers.tmp", std::ios::trunc);
+			for (const auto& name : front.workers()) {
+				out << name << '\n';
+			}
+			out.close();
+			std::rename("shard_workers.tmp", "shard_workers");
+		}
+	});
+	front.poll(stop);
+	saver.join();
+	front.stopWorkers();
+
+	return 0;
+}
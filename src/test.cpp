@@ -8,47 +8,790 @@
 #include <tgbot/net/TgLongPoll.h>
 #include <unqlite_cpp/unqlite_cpp.hpp>
 
+#include "auto_reminder.hpp"
+#include "catch_up.hpp"
+#include "chat_zones.hpp"
+#include "clock.hpp"
+#include "consistent_hash.hpp"
+#include "db_maintenance.hpp"
 #include "dynamic_storage.hpp"
+#include "edit_queue.hpp"
+#include "flat_hash_map.hpp"
+#include "idempotency_filter.hpp"
+#include "phrase_parser.hpp"
+#include "reminder_query.hpp"
+#include "reminder_storage.hpp"
+#include "reminder_store.hpp"
+#include "scheduler_group.hpp"
+#include "scheduler_snapshot.hpp"
+#include "scheduler_wal.hpp"
+
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <random>
 #include <set>
 #include <shared_mutex>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using namespace nlohmann::json_literals;
 
+std::string queueState(std::vector<ReminderQuery::Timer> timers) {
+	std::sort(timers.begin(), timers.end(), [](const auto& a, const auto& b) {
+		return std::tie(a.chatId, a.tp, a.reminder._id) < std::tie(b.chatId, b.tp, b.reminder._id);
+	});
+	std::string out;
+	for (const auto& t : timers) {
+		out += fmt::format("{}:{}:{}:{};", t.chatId, t.tp.time_since_epoch().count(), t.reminder._id, t.reminder.descr);
+	}
+	return out;
+}
+
+std::string readFile(const std::string& path) {
+	std::ifstream in(path, std::ios::binary);
+	std::stringstream ss;
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << data;
+}
+
+// Local times inside a spring-forward gap move forward by the gap, local times repeated on a fall-back
+// resolve to the earlier instant; times away from a transition keep the plain offset.
+bool testTimeZoneTransitions() {
+	using namespace std::chrono_literals;
+	const auto at = [](unsigned month, unsigned day, std::chrono::minutes time) {
+		const date::sys_days d = date::year{2026} / date::month{month} / date::day{day};
+		return time_point_s(std::chrono::duration_cast<std::chrono::seconds>(d.time_since_epoch() + time));
+	};
+	const auto& berlin = tzTable("Europe/Berlin");
+	const std::vector<std::pair<time_point_s, time_point_s>> localToUtc = {
+	    {at(3, 29, 2h), at(3, 29, 1h)},
+	    {at(3, 29, 2h + 30min), at(3, 29, 1h + 30min)},
+	    {at(3, 29, 3h), at(3, 29, 1h)},
+	    {at(10, 25, 2h), at(10, 25, 0h)},
+	    {at(10, 25, 2h + 30min), at(10, 25, 30min)},
+	    {at(10, 25, 3h), at(10, 25, 2h)},
+	    {at(7, 1, 12h), at(7, 1, 10h)},
+	    {at(1, 15, 12h), at(1, 15, 11h)},
+	};
+	size_t failures = 0;
+	for (const auto& [local, utc] : localToUtc) {
+		failures += berlin.toUtc(local) != utc;
+	}
+	// The skipped 02:30 reads back as 03:30, both instants of the repeated 02:30 read back as 02:30.
+	failures += berlin.toLocal(at(3, 29, 1h + 30min)) != at(3, 29, 3h + 30min);
+	failures += berlin.toLocal(at(10, 25, 30min)) != at(10, 25, 2h + 30min);
+	failures += berlin.toLocal(at(10, 25, 1h + 30min)) != at(10, 25, 2h + 30min);
+
+	std::cout << fmt::format("time zones: {} cases, {} failures", localToUtc.size() + 3, failures) << std::endl;
+	return failures == 0;
+}
+
+// Runs random scheduler mutations with a journal, checkpoints halfway, then simulates crashes by cutting
+// and corrupting the journal at every offset: recovery must always give the queue as it was after the
+// last complete record.
+bool testWalCrashRecovery() {
+	const std::string snapshotPath = "test_wal.snap";
+	const std::string walPath = "test_wal.wal";
+	std::remove("test_wal.db");
+	std::remove(snapshotPath.c_str());
+	std::remove(walPath.c_str());
+
+	const auto start = time_point_s(date::sys_days{date::year(2026) / 1 / 1}.time_since_epoch());
+	up::db db("test_wal.db");
+	VirtualClock clock(start);
+	ChatZones zones(db, clock);
+	ReminderQuery q([](std::int64_t, const std::string&) {}, zones, clock);
+	SchedulerWal wal(walPath);
+	q.setJournal(&wal);
+
+	// Queue state after each record boundary of the journal since the last checkpoint.
+	std::map<size_t, std::string> states{{0, ""}};
+	std::mt19937_64 rng(7);
+	std::int64_t nextId = 0;
+	for (int step = 0; step != 400; ++step) {
+		const std::int64_t chatId = rng() % 5;
+		switch (rng() % 8) {
+		case 0:
+			q.removeTimer(chatId, rng() % (nextId + 1));
+			break;
+		case 1:
+			q.clearChat(chatId);
+			break;
+		case 2:
+			q.runUntil(clock.now() + std::chrono::hours(rng() % 48));
+			break;
+		default: {
+			auto [ymd, tod] = ymdTodFromTp(defaultTzTable().toLocal(clock.now()) + std::chrono::minutes(rng() % 10000));
+			ReminderInfo r;
+			r._id = nextId++;
+			r.descr = fmt::format("r{}", r._id);
+			r.day = static_cast<unsigned>(ymd.day());
+			r.month = static_cast<unsigned>(ymd.month());
+			r.year = static_cast<int>(ymd.year());
+			r.hour = tod.hours().count();
+			r.minute = tod.minutes().count();
+			r.day_repeat = rng() % 3 == 0;
+			q.addTimer(chatId, defaultTzTable().toUtc(r.getNearTs(defaultTzTable().toLocal(clock.now()))), r);
+		}
+		}
+
+		if (step == 200) {
+			auto [timers, lsn] = q.checkpoint();
+			writeSchedulerSnapshot(snapshotPath, timers, clock.now(), lsn);
+			wal.truncate(lsn);
+			states = {{0, queueState(timers)}};
+		}
+		states[readFile(walPath).size()] = queueState(q.timers());
+	}
+
+	const auto full = readFile(walPath);
+	const std::string cutPath = "test_wal_cut.wal";
+	size_t failures = 0;
+	auto expectAt = [&](size_t offset, const char* what) {
+		auto expected = std::prev(states.upper_bound(offset))->second;
+		auto recovered = recoverScheduler(snapshotPath, cutPath);
+		if (!recovered || queueState(recovered->timers) != expected) {
+			std::cout << "WAL recovery mismatch: " << what << " at " << offset << std::endl;
+			++failures;
+		}
+	};
+	for (size_t cut = 0; cut <= full.size(); ++cut) {
+		writeFile(cutPath, full.substr(0, cut));
+		expectAt(cut, "truncated");
+	}
+	for (size_t offset = 0; offset < full.size(); offset += 7) {
+		auto corrupted = full;
+		corrupted[offset] ^= 0x5a;
+		writeFile(cutPath, corrupted);
+		expectAt(offset, "corrupted");
+	}
+
+	// Reopening cuts the torn tail, records appended afterwards must still replay.
+	writeFile(cutPath, full.substr(0, full.size() - 3));
+	auto beforeReopen = recoverScheduler(snapshotPath, cutPath);
+	{
+		SchedulerWal reopened(cutPath, beforeReopen ? beforeReopen->lsn : 0);
+		if (!reopened.hadTornTail()) {
+			std::cout << "WAL torn tail not detected" << std::endl;
+			++failures;
+		}
+		reopened.clear(0);
+	}
+	auto afterReopen = recoverScheduler(snapshotPath, cutPath);
+	if (beforeReopen && afterReopen) {
+		auto& timers = beforeReopen->timers;
+		timers.erase(std::remove_if(timers.begin(), timers.end(), [](const auto& t) { return t.chatId == 0; }),
+		    timers.end());
+	}
+	if (!beforeReopen || !afterReopen || queueState(beforeReopen->timers) != queueState(afterReopen->timers)) {
+		std::cout << "WAL append after torn tail lost" << std::endl;
+		++failures;
+	}
+
+	std::cout << fmt::format("WAL crash recovery: {} cut points, {} failures", full.size() + 1, failures) << std::endl;
+	return failures == 0;
+}
+
+// 20k reminders in 2k chats, the bot is down for 30 hours: the catch-up summaries must list exactly what
+// the scheduler would have fired meanwhile, and go out within the batch sender's rate limits.
+bool testCatchUp() {
+	using namespace std::chrono;
+
+	std::remove("test_catch_up.db");
+	const auto shutdownTp = time_point_s(date::sys_days{date::year(2026) / 3 / 1}.time_since_epoch());
+	const auto restartTp = shutdownTp + hours(30);
+	up::db db("test_catch_up.db");
+	VirtualClock clock(shutdownTp);
+	ChatZones zones(db, clock);
+
+	std::map<std::pair<std::int64_t, std::int64_t>, size_t> fired;
+	ReminderQuery q([](std::int64_t, const std::string&) {}, zones, clock);
+	q.setFireHook(
+	    [&](std::int64_t chatId, const ReminderInfo& r, time_point_s, time_point_s) { ++fired[{chatId, r._id}]; });
+
+	std::mt19937_64 rng(34);
+	const auto& zone = defaultTzTable();
+	for (std::int64_t id = 0; id != 20000; ++id) {
+		auto [ymd, tod] = ymdTodFromTp(zone.toLocal(shutdownTp) + minutes(1 + rng() % (48 * 60)));
+		ReminderInfo r;
+		r._id = id;
+		r.descr = fmt::format("r{}", id);
+		r.day = static_cast<unsigned>(ymd.day());
+		r.month = static_cast<unsigned>(ymd.month());
+		r.year = static_cast<int>(ymd.year());
+		r.hour = tod.hours().count();
+		r.minute = tod.minutes().count();
+		if (id % 5 == 0) {
+			r.week_repeat = 1 + rng() % 127;
+		}
+		q.addTimer(id % 2000, zone.toUtc(r.getNearTs(zone.toLocal(shutdownTp))), r);
+	}
+
+	const auto image = q.timers();
+	q.runUntil(restartTp);
+	clock.set(restartTp);
+
+	size_t failures = 0;
+	const auto missed = missedFromTimers(image, zones, restartTp);
+	std::map<std::pair<std::int64_t, std::int64_t>, size_t> reported;
+	for (const auto& [chatId, reminders] : missed) {
+		for (const auto& m : reminders) {
+			reported[{chatId, m.reminder._id}] = m.occurrences.size();
+		}
+	}
+	if (reported != fired) {
+		std::cout << fmt::format("catch-up reported {} reminders, scheduler fired {}", reported.size(), fired.size())
+		          << std::endl;
+		++failures;
+	}
+
+	std::map<time_point_s, size_t> perSecond;
+	std::set<std::pair<time_point_s, std::int64_t>> chatSeconds;
+	std::set<std::int64_t> notified;
+	size_t sends = 0;
+	BatchSender sender(
+	    [&](std::int64_t chatId, const std::string& text) {
+		    if (text.size() > MAX_MESSAGE_SIZE || !chatSeconds.insert({clock.now(), chatId}).second) {
+			    ++failures;
+		    }
+		    if (++perSecond[clock.now()] > 25) {
+			    ++failures;
+		    }
+		    if (sends++ % 1000 == 0) {
+			    throw std::runtime_error("injected send error\n");
+		    }
+		    notified.insert(chatId);
+	    },
+	    25, clock);
+	enqueueMissed(sender, missed);
+	sender.drain();
+	if (notified.size() != missed.size()) {
+		std::cout << fmt::format("catch-up notified {} of {} chats", notified.size(), missed.size()) << std::endl;
+		++failures;
+	}
+
+	std::cout << fmt::format("catch-up: {} missed reminders in {} chats, {} sends over {} s, {} failures",
+	                 reported.size(), missed.size(), sends, perSecond.size(), failures)
+	          << std::endl;
+	return failures == 0;
+}
+
+// Values counting their live copies, constructing one from a negative number throws.
+struct TrackedValue {
+	static inline int live = 0;
+
+	explicit TrackedValue(int v): v(v) {
+		if (v < 0) {
+			throw std::runtime_error("injected constructor error");
+		}
+		++live;
+	}
+	TrackedValue(const TrackedValue& other): v(other.v) { ++live; }
+	TrackedValue(TrackedValue&& other) noexcept: v(other.v) { ++live; }
+	TrackedValue& operator=(const TrackedValue&) = default;
+	~TrackedValue() { --live; }
+
+	int v;
+};
+
+// Contents of `m` that differ from `ref`, counted both ways.
+template<class Map>
+size_t flatMapMismatches(const Map& m, const std::unordered_map<std::int64_t, int>& ref) {
+	size_t mismatches = 0, iterated = 0;
+	for (const auto& [k, v] : m) {
+		auto found = ref.find(k);
+		mismatches += found == ref.end() || found->second != v.v;
+		++iterated;
+	}
+	for (const auto& [k, v] : ref) {
+		auto found = m.find(k);
+		mismatches += found == m.end() || found->second.v != v;
+	}
+	return mismatches + (iterated != ref.size()) + (m.size() != ref.size());
+}
+
+// The key is its own hash: the high bits pick the home group, the low 7 bits are the control byte.
+struct IdentityHash {
+	size_t operator()(std::int64_t key) const { return static_cast<size_t>(key); }
+};
+
+// Random inserts, assignments, erases (by key and through an iterator while iterating), copies and moves
+// give the same contents as std::unordered_map, and a throwing constructor leaves no slot behind. Keys
+// sharing a home group pack whole groups, erasing them leaves groups of tombstones that fresh keys skip, so
+// those fill the map up at its capacity and force a rehash in place.
+bool testFlatHashMap() {
+	using Reference = std::unordered_map<std::int64_t, int>;
+	std::mt19937_64 rng(7);
+	size_t failures = 0, checks = 0;
+
+	{
+		FlatHashMap<std::int64_t, TrackedValue> m;
+		Reference ref;
+		for (int round = 0; round != 200; ++round) {
+			// Early rounds grow the map, later ones keep it small over a wide key range.
+			const std::int64_t keys = round < 100 ? 4096 : 1 << 20;
+			const int target = round < 100 ? round * 40 : 64;
+			for (int op = 0; op != 500; ++op) {
+				const auto key = static_cast<std::int64_t>(rng() % keys);
+				const int value = static_cast<int>(rng() % 1000);
+				switch (static_cast<int>(ref.size()) < target ? rng() % 4 : 4 + rng() % 3) {
+				case 0: m.emplace(key, value), ref.emplace(key, value); break;
+				case 1: m.insert_or_assign(key, TrackedValue(value)), ref.insert_or_assign(key, value); break;
+				case 2:
+					try {
+						m.emplace(key, -1);
+						failures += !ref.count(key);
+					} catch (const std::runtime_error&) { failures += ref.count(key); }
+					break;
+				case 3: failures += m.count(key) != ref.count(key); break;
+				default: {
+					auto victim = ref.empty() ? key : std::next(ref.begin(), rng() % ref.size())->first;
+					failures += m.erase(victim) != ref.erase(victim);
+				}
+				}
+			}
+			if (round % 10 == 0) {
+				const auto residue = static_cast<std::int64_t>(rng() % 7);
+				for (auto it = m.begin(); it != m.end();) {
+					if (it->first % 7 == residue) {
+						it = m.erase(it);
+					} else {
+						++it;
+					}
+				}
+				for (auto it = ref.begin(); it != ref.end();) {
+					it = it->first % 7 == residue ? ref.erase(it) : std::next(it);
+				}
+			}
+			if (round % 25 == 0) {
+				auto copy = m;
+				failures += flatMapMismatches(copy, ref);
+				copy.emplace(-1, 1);
+				failures += m.count(-1) != 0;
+				auto moved = std::move(m);
+				m = std::move(moved);
+			}
+			failures += flatMapMismatches(m, ref);
+			++checks;
+		}
+		failures += TrackedValue::live != static_cast<int>(m.size());
+		m.clear();
+		failures += flatMapMismatches(m, {});
+	}
+
+	{
+		FlatHashMap<std::int64_t, TrackedValue, IdentityHash> m;
+		Reference ref;
+		for (std::int64_t j = 0; j != 800; ++j) {
+			m.emplace(j << 40 | (j & 0x7f), 1);
+		}
+		for (std::int64_t j = 0; j != 800; ++j) {
+			m.erase(j << 40 | (j & 0x7f));
+		}
+		for (int i = 0; i != 1000; ++i) {
+			const auto key = static_cast<std::int64_t>(rng() >> 1);
+			m.emplace(key, i);
+			ref.emplace(key, i);
+			if (i % 100 == 0) {
+				failures += flatMapMismatches(m, ref);
+				++checks;
+			}
+		}
+		failures += flatMapMismatches(m, ref);
+		++checks;
+	}
+	failures += TrackedValue::live != 0;
+
+	std::cout << fmt::format("flat hash map: {} checks against std::unordered_map, {} failures", checks, failures)
+	          << std::endl;
+	return failures == 0;
+}
+
+// Documents migrated to the key/value store keep their ids and fields, ids of later reminders never collide
+// with them, and edits survive reopening the store.
+bool testReminderStore() {
+	std::remove("test_store.db");
+	std::remove("test_store.kv");
+	std::vector<ReminderInfo> expected;
+	std::string error;
+	{
+		up::db db("test_store.db");
+		db.compile_or_throw("db_create($col);").bind_or_throw("col", "reminders_7").exec_or_throw();
+		up::vm_store_record(db).store_or_throw("users", up::value::object{{"id", 1}, {"chat_id", 7}});
+		for (int i = 0; i != 5; ++i) {
+			ReminderInfo ri;
+			ri.parseCommand(fmt::format("/add 1{}.05.2031 1{}:3{} w135 Запись {}", i, i, i, i), error);
+			ri.pre_reminder = i * 15;
+			up::value v;
+			ri.toValue(v);
+			ri._id = up::vm_store_record(db).store_or_throw("reminders_7", v);
+			expected.push_back(ri);
+		}
+		commitOrThrow(db);
+
+		ReminderStore store("test_store.kv");
+		migrateReminders(db, store);
+		if (migrateReminders(db, store) != 0) {
+			expected.clear();
+		}
+		ReminderInfo added;
+		added.parseCommand("/add 01.01.2032 08:00 - Новая", error);
+		added._id = storeReminder(store, 7, added);
+		store.commit();
+		expected.push_back(added);
+
+		eraseReminder(store, 7, expected[1]._id);
+		expected.erase(expected.begin() + 1);
+		expected[0].descr = "Изменена";
+		updateReminder(store, 7, expected[0]);
+	}
+
+	ReminderStore store("test_store.kv");
+	auto loaded = loadReminders(store, 7);
+	auto str = [](const std::vector<ReminderInfo>& v) {
+		std::string out;
+		for (const auto& ri : v) {
+			out += fmt::format("{} {} {}\n", ri._id, ri.pre_reminder, ri.toString());
+		}
+		return out;
+	};
+	const bool ok = !expected.empty() && str(loaded) == str(expected);
+	std::cout << fmt::format("reminder store: {} reminders, {}", loaded.size(), ok ? "ok" : "MISMATCH") << std::endl;
+	return ok;
+}
+
+// Adding a worker only moves chats to it, removing one only moves its own chats, and the shares stay even.
+bool testConsistentHash() {
+	const std::int64_t CHATS = 100000;
+	ConsistentHashRing ring;
+	for (const auto* w : {"w0", "w1", "w2", "w3"}) {
+		ring.add(w);
+	}
+	std::vector<std::string> before;
+	for (std::int64_t chatId = 0; chatId != CHATS; ++chatId) {
+		before.push_back(ring.owner(chatId * 7919 - CHATS));
+	}
+
+	size_t failures = 0;
+	auto grown = ring;
+	grown.add("w4");
+	auto shrunk = ring;
+	shrunk.remove("w1");
+	size_t added = 0, removed = 0;
+	std::map<std::string, size_t> shares;
+	for (std::int64_t chatId = 0; chatId != CHATS; ++chatId) {
+		const auto& owner = before[chatId];
+		++shares[owner];
+		if (const auto& now = grown.owner(chatId * 7919 - CHATS); now != owner) {
+			failures += now != "w4";
+			++added;
+		}
+		if (const auto& now = shrunk.owner(chatId * 7919 - CHATS); now != owner) {
+			failures += owner != "w1";
+			++removed;
+		}
+	}
+	failures += removed != shares["w1"];
+	for (const auto& [w, n] : shares) {
+		failures += n < CHATS / 4 * 7 / 10 || n > CHATS / 4 * 13 / 10;
+	}
+	failures += added < CHATS / 5 * 7 / 10 || added > CHATS / 5 * 13 / 10;
+
+	std::cout << fmt::format("consistent hash: {} of {} chats moved on add, {} on remove, {} failures", added, CHATS,
+	                 removed, failures)
+	          << std::endl;
+	return failures == 0;
+}
+
+// Bot API transport that answers every call with ok and remembers the methods called.
+class RecordingHttpClient: public TgBot::HttpClient {
+  public:
+	std::string makeRequest(const TgBot::Url& url, const std::vector<TgBot::HttpReqArg>&) const override {
+		std::scoped_lock l(_m);
+		++_calls[url.path.substr(url.path.rfind('/') + 1)];
+		return R"({"ok":true,"result":true})";
+	}
+
+	size_t calls(const std::string& method) const {
+		std::scoped_lock l(_m);
+		auto found = _calls.find(method);
+		return found == _calls.end() ? 0 : found->second;
+	}
+
+  private:
+	mutable std::mutex _m;
+	mutable std::map<std::string, size_t> _calls;
+};
+
+// Five quick "+1" clicks on a wizard message: every click is acknowledged, but only the last keyboard is
+// sent and stored, and sending the same keyboard again is skipped.
+bool testClickStorm() {
+	RecordingHttpClient client;
+	RawApi api(client, "1:TEST", "http://fake");
+	const auto coalescedBefore = metrics().counter("edit_queue_coalesced_total", "").value();
+	const auto unchangedBefore = metrics().counter("edit_queue_unchanged_total", "").value();
+	const auto writesSavedBefore = metrics().counter("dynamic_storage_writes_saved_total", "").value();
+
+	std::remove("test_storm.db");
+	up::db db("test_storm.db");
+	DynamicStorage ds(db, "storm");
+	{
+		EditQueue edits(api, 2, std::chrono::milliseconds(100));
+		const auto key = chatMsgKey(7, 42);
+		for (int click = 1; click <= 5; ++click) {
+			auto query = std::make_shared<TgBot::CallbackQuery>();
+			query->id = std::to_string(click);
+			edits.acknowledge(query);
+			ds.make(key, up::value(fmt::format("12:0{}", click)));
+			edits.editMessageText(7, 42, "Время", fmt::format("keyboard 12:0{}", click));
+		}
+		ds.flush();
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		edits.editMessageText(7, 42, "Время", "keyboard 12:05");
+		edits.editMessageText(7, 43, "Время", "keyboard 12:05");
+	}
+
+	const auto acks = client.calls("answerCallbackQuery");
+	const auto sent = client.calls("editMessageText");
+	const auto coalesced = metrics().counter("edit_queue_coalesced_total", "").value() - coalescedBefore;
+	const auto unchanged = metrics().counter("edit_queue_unchanged_total", "").value() - unchangedBefore;
+	const auto writesSaved = metrics().counter("dynamic_storage_writes_saved_total", "").value() - writesSavedBefore;
+	const bool ok = acks == 5 && sent == 2 && coalesced == 4 && unchanged == 1 && writesSaved == 4 &&
+	                ds.find(chatMsgKey(7, 42))->get_string() == "12:05";
+	std::cout << fmt::format("click storm: {} acks, {} edits sent, {} coalesced, {} unchanged, {} writes saved, {}",
+	                 acks, sent, coalesced, unchanged, writesSaved, ok ? "ok" : "FAILED")
+	          << std::endl;
+	return ok;
+}
+
+// Redelivered keys are dropped within the window and accepted again after it; distinct keys never are.
+bool testIdempotencyFilter() {
+	const std::uint64_t KEYS = 200000;
+	IdempotencyFilter seen(std::chrono::seconds(10), 10000);
+	const auto start = std::chrono::steady_clock::now();
+	size_t failures = 0;
+	for (std::uint64_t key = 0; key != KEYS; ++key) {
+		const auto now = start + std::chrono::milliseconds(key);
+		failures += !seen.accept(key, now);
+		failures += key >= 100 && seen.accept(key - 100, now);
+		failures += key >= 11000 && !seen.accept(key - 11000, now);
+	}
+	failures += !seen.accept("7:42:12:05", start) || seen.accept("7:42:12:05", start);
+	std::cout << fmt::format("idempotency filter: {} keys, {} remembered, {} failures", KEYS, seen.size(), failures)
+	          << std::endl;
+	return failures == 0;
+}
+
+// Churned wizard state and reminder edits are compacted away, live state, zones, registrations and
+// reminders survive the swap and later writes land in the new files. A backup holds the reminders and no
+// legacy documents a restore could migrate again.
+bool testDbCompaction() {
+	const std::string backup = "test_compact.backup";
+	for (const auto& path : {"test_compact.db", "test_compact.kv", "test_compact.backup/test_compact.db",
+	         "test_compact.backup/test_compact.kv"}) {
+		std::remove(path);
+	}
+	::rmdir(backup.c_str());
+	up::db db("test_compact.db");
+	ReminderStore store("test_compact.kv");
+	ChatZones zones(db);
+	std::mutex dbMutex;
+	size_t failures = 0;
+	DbMaintenance::Result result;
+	std::string error;
+	{
+		DynamicStorage ds(db, "dynamic_storage");
+		DbMaintenance maintenance(db, "test_compact.db", store, dbMutex, ds, zones);
+		registerChat(db, 1, 1);
+		registerChat(db, 2, 2);
+		ReminderInfo legacy;
+		legacy.parseCommand("/add 01.01.2031 10:00 - Старая", error);
+		up::value v;
+		legacy.toValue(v);
+		up::vm_store_record(db).store_or_throw("reminders_1", v);
+		commitOrThrow(db);
+		migrateReminders(db, store);
+
+		zones.set(2, "Europe/Moscow");
+		for (int i = 0; i != 5000; ++i) {
+			ds.make(chatMsgKey(1, i % 10), up::value(fmt::format("{}", i)));
+			ds.flush();
+		}
+		commitOrThrow(db);
+		ReminderInfo ri;
+		ri.parseCommand("/add 01.01.2031 12:00 - Запись", error);
+		for (int i = 0; i != 20; ++i) {
+			ri._id = storeReminder(store, 1, ri);
+		}
+		for (int i = 0; i != 500; ++i) {
+			ri.descr = fmt::format("Запись {}", i);
+			updateReminder(store, 1, ri);
+		}
+		store.commit();
+
+		maintenance.snapshot(backup);
+		result = maintenance.compact();
+		failures += result.bytesAfter >= result.bytesBefore;
+		ds.make(chatMsgKey(2, 1), up::value("after"));
+		ds.flush();
+		zones.set(1, "Asia/Tokyo");
+		commitOrThrow(db);
+		storeReminder(store, 2, ri);
+		store.commit();
+	}
+	DynamicStorage ds(db, "dynamic_storage");
+	ChatZones reloaded(db);
+	failures += ds.find(chatMsgKey(1, 9))->get_string() != "4999";
+	failures += ds.find(chatMsgKey(2, 1))->get_string() != "after";
+	failures += ds.records().size() != 11;
+	failures += reloaded.zone(2).name() != "Europe/Moscow" || reloaded.zone(1).name() != "Asia/Tokyo";
+	failures += !isChatRegistered(db, 1) || !isChatRegistered(db, 2) || loadUserChats(db).size() != 2;
+	failures += std::ifstream("test_compact.db.previous").good() || std::ifstream("test_compact.kv.previous").good();
+	failures += !loadReminderDocuments(db, 1).empty();
+	auto reminders = loadReminders(store, 1);
+	failures += reminders.size() != 21 || reminders.back().descr != "Запись 499";
+	failures += loadReminders(store, 2).size() != 1;
+	{
+		up::db backupDb(backup + "/test_compact.db");
+		ReminderStore backupStore(backup + "/test_compact.kv");
+		failures += loadUserChats(backupDb).size() != 2 || !loadReminderDocuments(backupDb, 1).empty();
+		failures += loadReminders(backupStore, 1).size() != 21 || backupStore.format() != REMINDER_STORE_FORMAT;
+	}
+	std::cout << fmt::format("db compaction: {} -> {} bytes, {} failures: {}", result.bytesBefore, result.bytesAfter,
+	                 failures, failures == 0 ? "ok" : "FAILED")
+	          << std::endl;
+	return failures == 0;
+}
+
+// Two bots on shared edit workers and one scheduler thread, with the same chat and message ids: each bot's
+// edit and reminder go out through its own API, nothing is coalesced across them.
+bool testTenants() {
+	RecordingHttpClient clientA, clientB;
+	RawApi apiA(clientA, "1:A", "http://fake");
+	RawApi apiB(clientB, "2:B", "http://fake");
+	std::remove("test_tenants.db");
+	up::db db("test_tenants.db");
+	ChatZones zones(db);
+	std::atomic<int> firedA = 0, firedB = 0;
+	SchedulerGroup group;
+	EditWorkers workers(2, std::chrono::milliseconds(50));
+	{
+		EditQueue editsA(apiA, workers);
+		EditQueue editsB(apiB, workers);
+		ReminderQuery qA([&](std::int64_t chatId, const std::string&) { firedA += chatId == 7; }, zones);
+		ReminderQuery qB([&](std::int64_t chatId, const std::string&) { firedB += chatId == 7; }, zones);
+		group.add(qA);
+		group.add(qB);
+		ReminderInfo ri;
+		ri._id = 1;
+		ri.descr = "tenant";
+		const auto due = nowUtc() + std::chrono::seconds(1);
+		qA.addTimer(7, due, ri);
+		qB.addTimer(7, due, ri);
+		editsA.editMessageText(7, 42, "A");
+		editsB.editMessageText(7, 42, "B");
+		editsA.stop();
+		editsB.stop();
+		for (int i = 0; i != 30 && (firedA == 0 || firedB == 0); ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		group.remove(qA);
+		group.remove(qB);
+	}
+	const auto editsA = clientA.calls("editMessageText");
+	const auto editsB = clientB.calls("editMessageText");
+	const bool ok = editsA == 1 && editsB == 1 && firedA == 1 && firedB == 1;
+	std::cout << fmt::format("tenants: edits {}/{}, fired {}/{}, {}", editsA, editsB, firedA.load(), firedB.load(),
+	                 ok ? "ok" : "FAILED")
+	          << std::endl;
+	return ok;
+}
+
+// The phrases of the request read as the reminders they name, a plain message and a time of today that has
+// passed as none.
+bool testPhraseParser() {
+	using namespace std::chrono;
+	const time_point_s now{date::sys_days{date::year(2026) / 10 / 19}.time_since_epoch() + hours(10)}; // Monday
+	const std::pair<const char*, const char*> cases[] = {
+	    {"завтра в 9 позвонить маме", "20/10/2026 09:00  позвонить маме"},
+	    {"каждый понедельник 10:30 планёрка", "19/10/2026 10:30 w1 планёрка"},
+	    {"через 15 минут выключить плиту", "19/10/2026 10:15  выключить плиту"},
+	    {"every tue and thu at 6pm yoga", "19/10/2026 18:00 w24 yoga"},
+	    {"сегодня в 11 созвон", "19/10/2026 11:00  созвон"},
+	    {"сегодня в 9 позвонить", ""},
+	    {"купить хлеб", ""},
+	};
+	size_t failures = 0;
+	for (const auto& [phrase, expected] : cases) {
+		const auto parsed = parsePhrase(phrase, now);
+		const auto got = parsed ? parsed->toString() : std::string();
+		if (got != expected) {
+			++failures;
+			std::cout << fmt::format("phrase \"{}\": got \"{}\", expected \"{}\"", phrase, got, expected) << std::endl;
+		}
+	}
+	std::cout << fmt::format("phrase parser: {} phrases, {} failures", std::size(cases), failures) << std::endl;
+	return failures == 0;
+}
+
 int main() {
+	const bool tzOk = testTimeZoneTransitions();
+	const bool walOk = testWalCrashRecovery();
+	const bool catchUpOk = testCatchUp();
+	const bool storeOk = testReminderStore();
+	const bool flatMapOk = testFlatHashMap();
+	const bool ringOk = testConsistentHash();
+	const bool stormOk = testClickStorm();
+	const bool filterOk = testIdempotencyFilter();
+	const bool compactOk = testDbCompaction();
+	const bool tenantsOk = testTenants();
+	const bool phrasesOk = testPhraseParser();
+
 	{
 		up::db db("test.db");
 		DynamicStorage ds(db, "test");
 
-		ds.make("id1", "WTF", 1);
-		std::cout << ds.find("id1")->get_string_view() << std::endl;
+		ds.make(chatMsgKey(1, 1), "WTF", 1);
+		std::cout << ds.find(chatMsgKey(1, 1))->get_string_view() << std::endl;
 	}
 	{
 		up::db db("test.db");
 		DynamicStorage ds(db, "test");
 
-		std::cout << ds.find("id1")->get_string_view() << std::endl;
+		std::cout << ds.find(chatMsgKey(1, 1))->get_string_view() << std::endl;
 	}
 	{
 		up::db db("test.db");
 		DynamicStorage ds(db, "test");
 
 		ds.vacuum();
-		std::cout << ds.find("id1").has_value() << std::endl;
+		std::cout << ds.find(chatMsgKey(1, 1)).has_value() << std::endl;
 		std::this_thread::sleep_for(std::chrono::seconds(5));
 		ds.vacuum();
-		std::cout << ds.find("id1").has_value() << std::endl;
+		std::cout << ds.find(chatMsgKey(1, 1)).has_value() << std::endl;
 	}
 
-	return 0;
+	return tzOk && walOk && catchUpOk && storeOk && flatMapOk && ringOk && stormOk && filterOk && compactOk &&
+	               tenantsOk && phrasesOk ?
+	           0 :
+	           1;
 }
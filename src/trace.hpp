@@ -0,0 +1,215 @@
+#pragma once
+
+// Scoped trace spans dumped as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+// Built only with TG_REMINDER_TRACE defined, otherwise TRACE_SCOPE expands to nothing.
+
+#ifdef TG_REMINDER_TRACE
+
+#include <fmt/format.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace trace {
+
+struct Event {
+	const char* name;
+	const char* cat;
+	std::int64_t startUs;
+	std::int64_t durUs;
+	std::int64_t arg;
+};
+
+// Single writer (the owning thread), readers only copy it on dump. Every slot carries the sequence
+// number of the event in it, odd while it is being written, so a reader racing the writer skips the
+// slots that changed under it instead of returning a torn event.
+class Ring {
+  public:
+	static constexpr size_t CAPACITY = 1 << 14;
+
+	explicit Ring(std::uint32_t tid): _tid(tid) {}
+
+	void push(const Event& e) {
+		const auto h = _head.load(std::memory_order_relaxed);
+		auto& slot = _slots[h % CAPACITY];
+		slot.seq.store(2 * h + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name.store(e.name, std::memory_order_relaxed);
+		slot.cat.store(e.cat, std::memory_order_relaxed);
+		slot.startUs.store(e.startUs, std::memory_order_relaxed);
+		slot.durUs.store(e.durUs, std::memory_order_relaxed);
+		slot.arg.store(e.arg, std::memory_order_relaxed);
+		slot.seq.store(2 * h + 2, std::memory_order_release);
+		_head.store(h + 1, std::memory_order_release);
+	}
+
+	std::vector<Event> copy() const {
+		const auto h = _head.load(std::memory_order_acquire);
+		const auto from = h > CAPACITY ? h - CAPACITY : 0;
+
+		std::vector<Event> out;
+		out.reserve(h - from);
+		for (auto i = from; i != h; ++i) {
+			const auto& slot = _slots[i % CAPACITY];
+			const auto seq = slot.seq.load(std::memory_order_acquire);
+			if (seq != 2 * i + 2) {
+				continue;
+			}
+			Event e{slot.name.load(std::memory_order_relaxed), slot.cat.load(std::memory_order_relaxed),
+			    slot.startUs.load(std::memory_order_relaxed), slot.durUs.load(std::memory_order_relaxed),
+			    slot.arg.load(std::memory_order_relaxed)};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.seq.load(std::memory_order_relaxed) == seq) {
+				out.push_back(e);
+			}
+		}
+		return out;
+	}
+
+	std::uint32_t tid() const { return _tid; }
+
+  private:
+	struct Slot {
+		std::atomic<std::uint64_t> seq = 0;
+		std::atomic<const char*> name = nullptr;
+		std::atomic<const char*> cat = nullptr;
+		std::atomic<std::int64_t> startUs = 0;
+		std::atomic<std::int64_t> durUs = 0;
+		std::atomic<std::int64_t> arg = 0;
+	};
+
+	const std::uint32_t _tid;
+	std::atomic<std::uint64_t> _head = 0;
+	std::array<Slot, CAPACITY> _slots;
+};
+
+// Rings of exited threads go back to a free list and are handed to the next new thread with the
+// events they hold, so short-lived threads (HTTP connections) don't each keep a ring for good.
+class Registry {
+  public:
+	std::shared_ptr<Ring> acquire() {
+		std::scoped_lock l(_m);
+		if (!_free.empty()) {
+			auto ring = std::move(_free.back());
+			_free.pop_back();
+			return ring;
+		}
+		_rings.push_back(std::make_shared<Ring>(static_cast<std::uint32_t>(_rings.size() + 1)));
+		return _rings.back();
+	}
+
+	void release(std::shared_ptr<Ring> ring) {
+		std::scoped_lock l(_m);
+		_free.push_back(std::move(ring));
+	}
+
+	bool dump(const std::string& path) const {
+		std::vector<std::shared_ptr<Ring>> rings;
+		{
+			std::scoped_lock l(_m);
+			rings = _rings;
+		}
+
+		std::ofstream out(path);
+		if (!out.is_open()) {
+			return false;
+		}
+		out << "{\"traceEvents\":[";
+		bool first = true;
+		for (const auto& r : rings) {
+			for (const auto& e : r->copy()) {
+				out << (first ? "" : ",")
+				    << fmt::format(R"({{"name":"{}","cat":"{}","ph":"X","ts":{},"dur":{},"pid":1,"tid":{},"args":{{"id":{}}}}})",
+				           e.name, e.cat, e.startUs, e.durUs, r->tid(), e.arg);
+				first = false;
+			}
+		}
+		out << "]}\n";
+
+		return true;
+	}
+
+  private:
+	mutable std::mutex _m;
+	std::vector<std::shared_ptr<Ring>> _rings;
+	std::vector<std::shared_ptr<Ring>> _free;
+};
+
+inline Registry& registry() {
+	static Registry r;
+	return r;
+}
+
+inline Ring& threadRing() {
+	struct Owner {
+		std::shared_ptr<Ring> ring = registry().acquire();
+		~Owner() { registry().release(std::move(ring)); }
+	};
+	thread_local Owner owner;
+	return *owner.ring;
+}
+
+inline std::int64_t nowUs() {
+	static const auto start = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// `name` and `cat` must be string literals (or otherwise outlive the process).
+class Span {
+  public:
+	Span(const char* name, const char* cat, std::int64_t arg = 0): _name(name), _cat(cat), _arg(arg), _start(nowUs()) {}
+	~Span() { threadRing().push(Event{_name, _cat, _start, nowUs() - _start, _arg}); }
+
+	Span(const Span&) = delete;
+	Span& operator=(const Span&) = delete;
+
+  private:
+	const char* _name;
+	const char* _cat;
+	const std::int64_t _arg;
+	const std::int64_t _start;
+};
+
+inline std::atomic_bool& dumpRequested() {
+	static std::atomic_bool requested = false;
+	return requested;
+}
+
+// `signum` (e.g. SIGUSR1) dumps the buffers to `path`. The handler only raises a flag, the file is
+// written by a background thread.
+inline void installDumpOnSignal(int signum, std::string path) {
+	signal(signum, [](int) { dumpRequested() = true; });
+
+	std::thread([path = std::move(path)] {
+		while (true) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			if (dumpRequested().exchange(false)) {
+				registry().dump(path);
+			}
+		}
+	}).detach();
+}
+
+} // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name, cat, ...) \
+	trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name, cat, ##__VA_ARGS__)
+#define TRACE_DUMP_ON_SIGNAL(signum, path) trace::installDumpOnSignal(signum, path)
+
+#else
+
+#define TRACE_SCOPE(name, cat, ...)
+#define TRACE_DUMP_ON_SIGNAL(signum, path)
+
+#endif
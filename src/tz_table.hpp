@@ -0,0 +1,98 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <date/date.h>
+#include <date/tz.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr const char* DEFAULT_TIME_ZONE = "Europe/Moscow";
+
+// UTC offsets of a zone flattened into sorted transition points, so a conversion is a binary search
+// over a few hundred integers instead of a tz database rules lookup.
+class TzTable {
+  public:
+	explicit TzTable(const date::time_zone* zone, date::year from = date::year(1970),
+	    date::year to = date::year(2100)):
+	    _name(zone->name()) {
+		auto tp = date::sys_seconds{date::sys_days{from / 1 / 1}};
+		const auto last = date::sys_seconds{date::sys_days{to / 1 / 1}};
+
+		while (true) {
+			auto info = zone->get_info(tp);
+			const auto offset = static_cast<std::int64_t>(info.offset.count());
+			if (_offsets.empty() || _offsets.back() != offset) {
+				const auto begin = std::max(info.begin, tp).time_since_epoch().count();
+				_utcBegins.push_back(begin);
+				_localBegins.push_back(begin + offset);
+				_offsets.push_back(offset);
+			}
+			if (info.end >= last) {
+				break;
+			}
+			tp = info.end;
+		}
+	}
+
+	time_point_s toLocal(time_point_s utc) const {
+		const auto s = utc.time_since_epoch().count();
+
+		return utc + std::chrono::seconds(_offsets[index(_utcBegins, s)]);
+	}
+
+	// Local times skipped by a forward transition are shifted forward by the gap, repeated local times
+	// resolve to the earlier of the two instants.
+	time_point_s toUtc(time_point_s local) const {
+		const auto s = local.time_since_epoch().count();
+		auto i = index(_localBegins, s);
+		if (i > 0 && s - _offsets[i - 1] < _utcBegins[i]) {
+			--i;
+		}
+
+		return local - std::chrono::seconds(_offsets[i]);
+	}
+
+	const std::string& name() const { return _name; }
+	size_t transitions() const { return _offsets.size(); }
+
+  private:
+	static size_t index(const std::vector<std::int64_t>& begins, std::int64_t s) {
+		auto it = std::upper_bound(begins.begin(), begins.end(), s);
+
+		return it == begins.begin() ? 0 : static_cast<size_t>(it - begins.begin() - 1);
+	}
+
+  private:
+	const std::string _name;
+
+	std::vector<std::int64_t> _utcBegins;
+	std::vector<std::int64_t> _localBegins;
+	std::vector<std::int64_t> _offsets;
+};
+
+// Tables are built once per zone name and live as long as the process.
+inline const TzTable& tzTable(const std::string& name) {
+	static std::mutex m;
+	static std::unordered_map<std::string, std::unique_ptr<const TzTable>> tables;
+
+	std::scoped_lock l(m);
+	auto& table = tables[name];
+	if (!table) {
+		table = std::make_unique<const TzTable>(date::locate_zone(name));
+	}
+
+	return *table;
+}
+
+inline const TzTable& defaultTzTable() {
+	static const TzTable& table = tzTable(DEFAULT_TIME_ZONE);
+
+	return table;
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "flat_hash_map.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
 #include <boost/algorithm/string/split.hpp>
 #include <date/date.h>
 #include <date/tz.h>
@@ -14,24 +18,39 @@
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
+#include <cctype>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <optional>
 #include <set>
 #include <shared_mutex>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using time_point_s = std::chrono::time_point<std::chrono::seconds>;
 
 constexpr size_t MAX_MESSAGE_SIZE = 4096;
 
-inline time_point_s now() {
-	static auto zone = date::locate_zone("Europe/Moscow");
+inline time_point_s nowUtc() {
+	return time_point_s(
+	    std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()));
+}
+
+inline std::string prettyDateTime(time_point_s localTp) {
+	using namespace std::chrono;
 
-	return time_point_s(std::chrono::duration_cast<std::chrono::seconds>(
-	    date::make_zoned(zone, std::chrono::system_clock::now()).get_local_time().time_since_epoch()));
+	date::year_month_day ymd{date::sys_days{date::floor<date::days>(localTp.time_since_epoch())}};
+	date::time_of_day<minutes> tod{
+	    date::floor<minutes>(localTp.time_since_epoch() - date::sys_days{ymd}.time_since_epoch())};
+
+	return fmt::format("{:0>2}:{:0>2} {:0>2}/{:0>2}/{}", tod.hours().count(), tod.minutes().count(),
+	    static_cast<unsigned>(ymd.day()), static_cast<unsigned>(ymd.month()), static_cast<int>(ymd.year()));
 }
 
 inline TgBot::InlineKeyboardButton::Ptr makeButon(const std::string& label, const std::string& key) {
@@ -64,6 +83,107 @@ inline std::string findToken() {
 	return token;
 }
 
+// Bot API endpoint, overridden by an "api_url" file next to "token" (e.g. to run against a local fake server).
+inline std::string findApiUrl() {
+	std::string url = "https://api.telegram.org";
+	std::ifstream urlFile("api_url");
+	if (urlFile.is_open()) {
+		urlFile >> url;
+	}
+
+	return url;
+}
+
+// One bot of the process. Its files live in `dir`, empty for the bot run from the working directory.
+struct BotConfig {
+	std::string name;
+	std::string token;
+	std::string apiUrl;
+	std::string dir;
+};
+
+// Bots listed in a "bots" file, one "name token [api_url]" per line, # starts a comment; each keeps its
+// files in bots/<name>/. Empty without the file, the process then runs the bot of "token".
+inline std::vector<BotConfig> findBots() {
+	std::vector<BotConfig> bots;
+	std::ifstream botsFile("bots");
+	std::set<std::string> names;
+	for (std::string line; std::getline(botsFile, line);) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		BotConfig cfg;
+		if (!(in >> cfg.name)) {
+			continue;
+		}
+		if (!(in >> cfg.token)) {
+			throw std::runtime_error("No token for bot " + cfg.name);
+		}
+		if (!(in >> cfg.apiUrl)) {
+			cfg.apiUrl = findApiUrl();
+		}
+		const bool valid = std::all_of(cfg.name.begin(), cfg.name.end(),
+		    [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-'; });
+		if (!valid || !names.insert(cfg.name).second) {
+			throw std::runtime_error("Bad or repeated bot name " + cfg.name);
+		}
+		cfg.dir = "bots/" + cfg.name + "/";
+		bots.push_back(std::move(cfg));
+	}
+
+	return bots;
+}
+
+// Port of the local Prometheus endpoint, overridden by a "metrics_port" file: 0 disables it, "any" gives 0
+// for a port picked by the system, which the bot then writes to "metrics_port.bound".
+inline std::optional<unsigned short> findMetricsPort() {
+	unsigned short port = 9464;
+	std::ifstream portFile("metrics_port");
+	if (portFile.is_open()) {
+		std::string value;
+		portFile >> value;
+		if (value == "any") {
+			return 0;
+		}
+		port = 0;
+		std::istringstream(value) >> port;
+	}
+
+	return port ? std::optional<unsigned short>(port) : std::nullopt;
+}
+
+// Unix socket a primary streams its journal to followers on, from a "replication_socket" file in the bot's
+// directory. Empty if replication is off.
+inline std::string findReplicationSocket(const std::string& dir = "") {
+	std::string path;
+	std::ifstream pathFile(dir + "replication_socket");
+	if (pathFile.is_open()) {
+		pathFile >> path;
+	}
+
+	return path;
+}
+
+// Seconds a chat's due reminder may wait for the chat's next ones to be sent in one message, from a
+// "coalesce_window" file in the bot's directory. 0 (each sweep sends what is due) without it.
+inline std::chrono::seconds findCoalesceWindow(const std::string& dir = "") {
+	std::int64_t seconds = 0;
+	std::ifstream windowFile(dir + "coalesce_window");
+	if (windowFile.is_open() && !(windowFile >> seconds)) {
+		throw std::runtime_error("Bad coalesce_window in " + (dir.empty() ? std::string(".") : dir));
+	}
+
+	return std::chrono::seconds(std::max<std::int64_t>(seconds, 0));
+}
+
+inline void commitOrThrow(up::db& db) {
+	static auto& duration = metrics().histogram("unqlite_commit_seconds", "UnQLite commit duration", latencyBuckets());
+
+	TRACE_SCOPE("commit", "storage");
+	const auto start = std::chrono::steady_clock::now();
+	db.commit_or_throw();
+	duration.observe(std::chrono::steady_clock::now() - start);
+}
+
 inline std::pair<int64_t, int64_t> getUserChatOrThrow(const TgBot::Message::Ptr& msg) {
 	if (!msg->chat) {
 		throw std::runtime_error("Невозможно переслать сообщение");
@@ -76,8 +196,49 @@ inline std::pair<int64_t, int64_t> getUserChatOrThrow(const TgBot::Message::Ptr&
 	return {msg->from->id, msg->chat->id};
 }
 
-inline std::string chatMsgKey(int64_t c, int64_t m) {
-	return std::to_string(c) + "_" + std::to_string(m);
+// Chat of a handler's message for logging, 0 when there is none.
+inline int64_t chatOf(const TgBot::Message::Ptr& msg) { return msg && msg->chat ? msg->chat->id : 0; }
+
+// Key of per-message state: a chat and a message in it. Persisted as "{chatId}_{messageId}".
+struct ChatMsgKey {
+	int64_t chatId;
+	int64_t messageId;
+
+	bool operator==(const ChatMsgKey& other) const {
+		return chatId == other.chatId && messageId == other.messageId;
+	}
+
+	std::string toString() const { return std::to_string(chatId) + "_" + std::to_string(messageId); }
+
+	static std::optional<ChatMsgKey> parse(const std::string& str) {
+		ChatMsgKey key;
+		char* end;
+		const auto sep = str.find('_', 1);
+		if (sep == std::string::npos) {
+			return {};
+		}
+		key.chatId = std::strtoll(str.c_str(), &end, 10);
+		if (end != str.c_str() + sep) {
+			return {};
+		}
+		key.messageId = std::strtoll(str.c_str() + sep + 1, &end, 10);
+		if (end != str.c_str() + str.size() || sep + 1 == str.size()) {
+			return {};
+		}
+
+		return key;
+	}
+};
+
+struct ChatMsgKeyHash {
+	size_t operator()(const ChatMsgKey& key) const {
+		return FlatHash<std::uint64_t>{}(static_cast<std::uint64_t>(key.chatId) * 0x9e3779b97f4a7c15ULL +
+		                                 static_cast<std::uint64_t>(key.messageId));
+	}
+};
+
+inline ChatMsgKey chatMsgKey(int64_t c, int64_t m) {
+	return {c, m};
 }
 
 inline auto split(const std::string& text) {